@@ -0,0 +1,229 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "ChangeDispatchPool.hpp"
+
+#include <cast/architecture/WorkingMemoryReaderComponent.hpp>
+
+using namespace std;
+using namespace IceUtil;
+
+namespace cast {
+
+  namespace {
+
+    //FNV-1a
+    inline unsigned long hashString(const string & _s, unsigned long _hash) {
+      for(string::const_iterator i = _s.begin(); i < _s.end(); ++i) {
+	_hash ^= static_cast<unsigned char>(*i);
+	_hash *= 16777619UL;
+      }
+      return _hash;
+    }
+
+    inline unsigned long hashAddress(const cdl::WorkingMemoryAddress & _wma) {
+      return hashString(_wma.subarchitecture, hashString(_wma.id, 2166136261UL));
+    }
+
+    inline unsigned long hashReceiver(const WorkingMemoryChangeReceiver * _receiver) {
+      //drop the low bits, which are the same for all allocations
+      return reinterpret_cast<unsigned long>(_receiver) >> 4;
+    }
+
+  }
+
+
+  ChangeDispatchPool::ChangeDispatchPool(WorkingMemoryReaderComponent * _component,
+					 const unsigned int & _threads,
+					 const Ordering & _ordering) :
+    m_component(_component),
+    m_ordering(_ordering),
+    m_running(false),
+    m_outstanding(0) {
+    assert(_threads > 0);
+    for(unsigned int i = 0; i < _threads; ++i) {
+      m_lanes.push_back(new Lane());
+    }
+  }
+
+
+  ChangeDispatchPool::~ChangeDispatchPool() {
+    stop();
+    for(vector<Lane *>::iterator i = m_lanes.begin();
+	i < m_lanes.end(); ++i) {
+      delete *i;
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::start() {
+    m_running = true;
+    for(vector<Lane *>::iterator i = m_lanes.begin();
+	i < m_lanes.end(); ++i) {
+      (*i)->thread = new Worker(*this, **i);
+      (*i)->control = (*i)->thread->start();
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::stop() {
+    m_running = false;
+
+    for(vector<Lane *>::iterator i = m_lanes.begin();
+	i < m_lanes.end(); ++i) {
+      Monitor<IceUtil::Mutex>::Lock lock((*i)->monitor);
+      (*i)->tasks.clear();
+      (*i)->monitor.notifyAll();
+    }
+
+    for(vector<Lane *>::iterator i = m_lanes.begin();
+	i < m_lanes.end(); ++i) {
+      if((*i)->thread) {
+	(*i)->control.join();
+	(*i)->thread = 0;
+      }
+    }
+
+    //release anyone draining
+    Monitor<IceUtil::Mutex>::Lock lock(m_outstandingMonitor);
+    m_outstanding = 0;
+    m_outstandingMonitor.notifyAll();
+  }
+
+
+  void
+  ChangeDispatchPool::dispatch(const cdl::WorkingMemoryChange & _wmc,
+			       const vector<WorkingMemoryChangeReceiver *> & _receivers) {
+
+    Task task;
+    //shared between the lanes the change is given to
+    task.change = ChangePtr(new cdl::WorkingMemoryChange(_wmc));
+
+    if(m_ordering == ORDER_BY_ADDRESS) {
+      task.receivers = _receivers;
+      queue(*m_lanes[hashAddress(_wmc.address) % m_lanes.size()], task);
+    }
+    else {
+      task.receivers.resize(1);
+      for(vector<WorkingMemoryChangeReceiver *>::const_iterator i = _receivers.begin();
+	  i < _receivers.end(); ++i) {
+	task.receivers[0] = *i;
+	queue(*m_lanes[hashReceiver(*i) % m_lanes.size()], task);
+      }
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::queue(Lane & _lane, const Task & _task) {
+    {
+      Monitor<IceUtil::Mutex>::Lock lock(m_outstandingMonitor);
+      ++m_outstanding;
+    }
+
+    Monitor<IceUtil::Mutex>::Lock lock(_lane.monitor);
+    _lane.tasks.push_back(_task);
+    //the lane's thread only waits when there is nothing to do
+    if(_lane.tasks.size() == 1) {
+      _lane.monitor.notify();
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::drain() {
+    Monitor<IceUtil::Mutex>::Lock lock(m_outstandingMonitor);
+    while(m_outstanding > 0 && m_running) {
+      m_outstandingMonitor.wait();
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::waitForSpace(const unsigned int & _limit) {
+    Monitor<IceUtil::Mutex>::Lock lock(m_outstandingMonitor);
+    while(m_outstanding >= _limit && m_running) {
+      m_outstandingMonitor.wait();
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::taskDone() {
+    Monitor<IceUtil::Mutex>::Lock lock(m_outstandingMonitor);
+    if(m_outstanding > 0) {
+      --m_outstanding;
+      //wakes drain at zero, and waitForSpace below its limit
+      m_outstandingMonitor.notifyAll();
+    }
+  }
+
+
+  void
+  ChangeDispatchPool::runLane(Lane & _lane) {
+
+    Task task;
+
+    while(m_running) {
+
+      {
+	Monitor<IceUtil::Mutex>::Lock lock(_lane.monitor);
+	while(_lane.tasks.empty() && m_running) {
+	  _lane.monitor.wait();
+	}
+	if(!m_running) {
+	  return;
+	}
+	task = _lane.tasks.front();
+	_lane.tasks.pop_front();
+      }
+
+      for(vector<WorkingMemoryChangeReceiver *>::const_iterator i = task.receivers.begin();
+	  i < task.receivers.end(); ++i) {
+	if((*i)->isRunConcurrently()) {
+	  m_component->forwardToReceiver(*i, *task.change);
+	}
+	else {
+	  m_component->lockComponent();
+	  //stop may have been called while waiting for the lock
+	  if(!m_running) {
+	    m_component->unlockComponent();
+	    return;
+	  }
+	  m_component->forwardToReceiver(*i, *task.change);
+	  m_component->unlockComponent();
+	}
+      }
+
+      taskDone();
+
+      //signal any threads that may have been waiting for new changes
+      if(!task.receivers.empty()) {
+	Monitor<IceUtil::Mutex>::Lock lock(m_component->m_wmcMonitor);
+	m_component->m_wmcMonitor.notifyAll();
+      }
+    }
+  }
+
+} //namespace cast
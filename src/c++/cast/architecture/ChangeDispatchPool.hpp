@@ -0,0 +1,158 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_CHANGE_DISPATCH_POOL_H_
+#define CAST_CHANGE_DISPATCH_POOL_H_
+
+#include <cast/slice/CDL.hpp>
+#include <cast/architecture/WorkingMemoryChangeReceiver.hpp>
+
+#include <IceUtil/Thread.h>
+#include <IceUtil/Monitor.h>
+#include <IceUtil/Mutex.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <vector>
+
+namespace cast {
+
+  //fwd declarations
+  class WorkingMemoryReaderComponent;
+
+  /**
+   * Pool of threads which call a reader component's change receivers,
+   * so that receivers which are not waiting on each other can run at
+   * the same time. Each change is given to a lane, and each lane is
+   * run in order by one thread. Changes are put in lanes either by
+   * their address, so all changes to an entry reach all receivers in
+   * order, or by receiver, so each receiver sees its changes in
+   * order. Receivers are called with the component locked unless they
+   * are marked with WorkingMemoryChangeReceiver::runConcurrently.
+   *
+   * @author nah
+   */
+  class ChangeDispatchPool {
+
+  public:
+
+    enum Ordering {
+      ///keep the order of changes to the same address
+      ORDER_BY_ADDRESS,
+      ///keep the order of changes to the same receiver
+      ORDER_BY_RECEIVER
+    };
+
+    ChangeDispatchPool(WorkingMemoryReaderComponent * _component,
+		       const unsigned int & _threads,
+		       const Ordering & _ordering);
+
+    ~ChangeDispatchPool();
+
+    void start();
+
+    /**
+     * Stop the threads, discarding any changes not yet dispatched.
+     * Must not be called with the component locked, as a thread may
+     * be waiting for the lock.
+     */
+    void stop();
+
+    /**
+     * Queue a change for its receivers, in the order given.
+     */
+    void dispatch(const cdl::WorkingMemoryChange & _wmc,
+		  const std::vector<WorkingMemoryChangeReceiver *> & _receivers);
+
+    /**
+     * Wait until everything dispatched so far has been called. This
+     * must be done before removing receivers. Must not be called with
+     * the component locked.
+     */
+    void drain();
+
+    /**
+     * Wait until fewer than _limit tasks are queued or running, so
+     * that the lanes do not grow without bound when receivers are
+     * slower than changes arrive. Returns at once if the pool has
+     * stopped. Must not be called with the component locked.
+     */
+    void waitForSpace(const unsigned int & _limit);
+
+    unsigned int getThreadCount() const {
+      return m_lanes.size();
+    }
+
+  private:
+
+    typedef boost::shared_ptr<const cdl::WorkingMemoryChange> ChangePtr;
+
+    struct Task {
+      ChangePtr change;
+      std::vector<WorkingMemoryChangeReceiver *> receivers;
+    };
+
+    struct Lane {
+      std::deque<Task> tasks;
+      IceUtil::Monitor<IceUtil::Mutex> monitor;
+      IceUtil::ThreadPtr thread;
+      IceUtil::ThreadControl control;
+    };
+
+    class Worker : public IceUtil::Thread {
+    public:
+      Worker(ChangeDispatchPool & _pool, Lane & _lane) :
+	m_pool(_pool),
+	m_lane(_lane) {}
+      virtual void run() {
+	m_pool.runLane(m_lane);
+      }
+    private:
+      ChangeDispatchPool & m_pool;
+      Lane & m_lane;
+    };
+
+    friend class Worker;
+
+    void runLane(Lane & _lane);
+
+    void queue(Lane & _lane, const Task & _task);
+
+    void taskDone();
+
+    WorkingMemoryReaderComponent * m_component;
+    Ordering m_ordering;
+
+    std::vector<Lane *> m_lanes;
+
+    volatile bool m_running;
+
+    ///tasks queued or running, protected by m_outstandingMonitor
+    unsigned int m_outstanding;
+    IceUtil::Monitor<IceUtil::Mutex> m_outstandingMonitor;
+
+  };
+
+} //namespace cast
+
+#endif
@@ -63,6 +63,7 @@ namespace cast {
     filter.address.subarchitecture = _changeSA;
     filter.type = _type;
     filter.restriction = _restriction;
+    filter.payload = cdl::NOPAYLOAD;
     return filter;
   }
 
@@ -24,9 +24,13 @@
 
 #include <CASTWorkingMemory.hpp>
 #include <CASTUtils.hpp>
+#include <EntryPatch.hpp>
 
 #include <boost/thread/locks.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+
 using namespace std;
 
 /**
@@ -44,13 +48,27 @@ namespace cast {
   using namespace interfaces;
   
   SubarchitectureWorkingMemory::SubarchitectureWorkingMemory() :
-  m_wmDistributedFiltering(true) {
-    
+  //all access is already under m_readWriteLock, so only need to
+  //allow concurrent readers through
+  m_workingMemory(CASTWorkingMemory::SYNC_SHARED),
+  m_wmDistributedFiltering(true),
+  m_sendsSaved(0),
+  m_batchWindow(0),
+  m_batchSize(64),
+  m_holdingChanges(false),
+  m_sendingHeld(false),
+  m_stopNotifying(false),
+  m_nextSequence(1),
+  m_notifiedSequence(0),
+  m_batchedChanges(0),
+  m_batchesSent(0) {
+    
+    m_lockTimer = new IceUtil::Timer();
     setSendXarchChangeNotifications(true);
   }
   
   SubarchitectureWorkingMemory::~SubarchitectureWorkingMemory() {
-    
+    m_lockTimer->destroy();
   }
   
   void SubarchitectureWorkingMemory::addReader(
@@ -59,9 +77,45 @@ namespace cast {
     //only have oneway connections, so now return signal or value
     //TODO see if errors from network are at all likely, and or replace with datagram proxies
     //
-    m_readers.push_back(
-                        interfaces::WorkingMemoryReaderComponentPrx::uncheckedCast(
-                                                                                   _reader->ice_oneway()));
+    //Not collocated, as a collocated oneway runs the reader's
+    //receiveChangeEvent on the notifier thread, which then waits for
+    //the reader when its change queue is full
+    WorkingMemoryReaderComponentPrx oneway(interfaces::WorkingMemoryReaderComponentPrx::uncheckedCast(
+                                                                                                     _reader->ice_oneway()->ice_collocationOptimized(false)));
+
+    //the id of the reader is the origin of the filters it registers,
+    //so use it to route changes to only the readers that want them
+    string readerID;
+    bool routed = true;
+    try {
+      readerID = _reader->getID();
+    }
+    catch(const Ice::Exception & e) {
+      println("unable to get reader id, it will receive all changes: %s", e.what());
+      routed = false;
+    }
+
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
+    if(routed) {
+      if(m_routedReaders.find(readerID) != m_routedReaders.end()) {
+        debug("replacing reader: %s", readerID.c_str());
+        m_routedReaders[readerID] = oneway;
+        return;
+      }
+      m_routedReaders[readerID] = oneway;
+    }
+    else {
+      readerID = oneway->ice_toString();
+      m_unroutedReaders[readerID] = oneway;
+    }
+    m_readers.push_back(oneway);
+
+    cdl::ReaderLag & lag(m_readerLag[readerID]);
+    lag.component = readerID;
+    lag.sent = 0;
+    lag.processed = 0;
+    lag.dropped = 0;
+    lag.overflows = 0;
   }
   
   
@@ -100,6 +154,25 @@ namespace cast {
     
     return found != receivers.end();
   }
+
+  bool SubarchitectureWorkingMemory::isAllowedChange(const std::string & _subarch, 
+                                                     const cdl::WorkingMemoryChange & _change,
+                                                     cdl::ChangePayload & _payload) const {
+    
+    vector< pair<string, cdl::ChangePayload> > receivers;
+    m_wmFilters.get(_change, receivers);
+    
+    bool found = false;
+    _payload = cdl::NOPAYLOAD;
+    for(vector< pair<string, cdl::ChangePayload> >::const_iterator i = receivers.begin();
+        i < receivers.end(); ++i) {
+      if(i->first == _subarch) {
+        found = true;
+        _payload = max(_payload, i->second);
+      }
+    }
+    return found;
+  }
   
   void SubarchitectureWorkingMemory::overwriteWorkingMemory(
                                                             const std::string & _id, const std::string & _subarch,
@@ -110,11 +183,12 @@ namespace cast {
     //if this is for me
     if (getSubarchitectureID() == _subarch) {
       boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
-      bool result = overwriteWorkingMemory(_id, createEntry(_id, _type,
-                                                            _entry), _component);
+      const TypeHierarchy & hierarchy(SymbolTable::hierarchy(_entry));
+      WorkingMemoryEntryPtr stored(createEntry(_id, _type, _entry));
+      bool result = overwriteWorkingMemory(_id, stored, hierarchy.ids, _component);
       //sanity check
       assert(result);
-      signalChange(cdl::OVERWRITE, _component, _id, _type, _entry->ice_ids());
+      signalChange(cdl::OVERWRITE, _component, _id, _type, hierarchy, stored);
     } else {
       //send on to the one that really cares
       getWorkingMemory(_subarch)->overwriteWorkingMemory(_id, _subarch,
@@ -123,7 +197,9 @@ namespace cast {
   }
   
   bool SubarchitectureWorkingMemory::overwriteWorkingMemory(const string & _id,
-                                                            WorkingMemoryEntryPtr _pData, const string & _component)
+                                                            WorkingMemoryEntryPtr _pData, 
+                                                            const vector<string> & _superTypes,
+                                                            const string & _component)
   throw (DoesNotExistOnWMException) {
     
     //first sanity check
@@ -149,11 +225,135 @@ namespace cast {
       }
     }
     
-    bool result = m_workingMemory.overwrite(_id,_pData);
+    bool result = m_workingMemory.overwrite(_id,_pData,_superTypes);
     
     return result;
   }
   
+  void SubarchitectureWorkingMemory::patchWorkingMemory(
+                                                        const std::string & _id, const std::string & _subarch,
+                                                        const std::string & _type, const std::string & _component,
+                                                        const cdl::WorkingMemoryPatchPtr & _patch, const Ice::Current & _ctx)
+  throw (DoesNotExistOnWMException, ConsistencyException, UnknownSubarchitectureException) {
+    
+    //if this is for me
+    if (getSubarchitectureID() == _subarch) {
+      boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+      
+      if (!m_workingMemory.contains(_id)) {
+        throw(DoesNotExistOnWMException(exceptionMessage(__HERE__,"Entry does not exist to patch. Was trying to patch id %s in subarchitecture %s" ,
+                                                         _id.c_str(),getSubarchitectureID().c_str()),
+                                        makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      if (!_patch) {
+        throw(ConsistencyException(exceptionMessage(__HERE__,"Null patch for %s:%s",
+                                                    _id.c_str(),getSubarchitectureID().c_str()),
+                                   makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      WorkingMemoryEntryPtr current(m_workingMemory.get(_id));
+      if(current->version != _patch->baseVersion) {
+        throw(ConsistencyException(exceptionMessage(__HERE__,"Patch for %s:%s is against version %d, but the entry is at version %d",
+                                                    _id.c_str(),getSubarchitectureID().c_str(),
+                                                    _patch->baseVersion, current->version),
+                                   makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      //stored entries are never modified, so rebuild from the stored
+      //bytes. A bad patch must not take down working memory, so
+      //failures go back to the writer
+      Ice::ObjectPtr entry;
+      try {
+        cdl::ByteSeq bytes;
+        marshalEntry(getCommunicator(), current->entry, bytes);
+        applyPatch(_patch, bytes);
+        entry = unmarshalEntry(getCommunicator(), bytes);
+      }
+      catch(const CASTException & e) {
+        throw(ConsistencyException(exceptionMessage(__HERE__,"Unable to apply patch for %s:%s: %s",
+                                                    _id.c_str(),getSubarchitectureID().c_str(),
+                                                    e.message.c_str()),
+                                   makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      catch(const Ice::Exception & e) {
+        throw(ConsistencyException(exceptionMessage(__HERE__,"Unable to unmarshal patched entry for %s:%s: %s",
+                                                    _id.c_str(),getSubarchitectureID().c_str(),
+                                                    e.what()),
+                                   makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      if (!entry) {
+        throw(ConsistencyException(exceptionMessage(__HERE__,"Patch for %s:%s produced a null entry",
+                                                    _id.c_str(),getSubarchitectureID().c_str()),
+                                   makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      const TypeHierarchy & hierarchy(SymbolTable::hierarchy(entry));
+      WorkingMemoryEntryPtr stored(createEntry(_id, _type, entry));
+      bool result = overwriteWorkingMemory(_id, stored, hierarchy.ids, _component);
+      //sanity check
+      assert(result);
+      signalChange(cdl::OVERWRITE, _component, _id, _type, hierarchy, stored, _patch);
+    } else {
+      //send on to the one that really cares
+      getWorkingMemory(_subarch)->patchWorkingMemory(_id, _subarch,
+                                                     _type, _component, _patch);
+    }
+  }
+  
+  cdl::WorkingMemoryEntryPtr
+  SubarchitectureWorkingMemory::overwriteIfVersion(const std::string & _id,
+                                                   const std::string & _subarch,
+                                                   const std::string & _type,
+                                                   const std::string & _component,
+                                                   Ice::Int _expectedVersion,
+                                                   const Ice::ObjectPtr & _entry,
+                                                   Ice::Int & _version,
+                                                   const Ice::Current & _ctx)
+  throw (DoesNotExistOnWMException, PermissionException, UnknownSubarchitectureException) {
+    
+    //if this is for me
+    if (getSubarchitectureID() == _subarch) {
+      //the version check and the write happen under the same lock, so
+      //no other write can come between them
+      boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+      
+      if (!m_workingMemory.contains(_id)) {
+        throw(DoesNotExistOnWMException(exceptionMessage(__HERE__,"Entry does not exist to overwrite. Was trying to overwrite id %s in subarchitecture %s" ,
+                                                         _id.c_str(),getSubarchitectureID().c_str()),
+                                        makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      if (isLockedAgainst(_id, _component, false)) {
+        throw(PermissionException(exceptionMessage(__HERE__,"Overwrite not allowed on locked item: %s:%s" ,
+                                                   _id.c_str(),getSubarchitectureID().c_str()),
+                                  makeWorkingMemoryAddress(_id,getSubarchitectureID())));
+      }
+      
+      _version = m_workingMemory.getOverwriteCount(_id);
+      if(_version != _expectedVersion) {
+        //stored entries are never modified, so the caller can share it
+        return m_workingMemory.get(_id);
+      }
+      
+      const TypeHierarchy & hierarchy(SymbolTable::hierarchy(_entry));
+      WorkingMemoryEntryPtr stored(createEntry(_id, _type, _entry));
+      bool result = overwriteWorkingMemory(_id, stored, hierarchy.ids, _component);
+      //sanity check
+      assert(result);
+      signalChange(cdl::OVERWRITE, _component, _id, _type, hierarchy, stored);
+      _version = m_workingMemory.getOverwriteCount(_id);
+      return 0;
+    } else {
+      //send on to the one that really cares
+      return getWorkingMemory(_subarch)->overwriteIfVersion(_id, _subarch,
+                                                            _type, _component,
+                                                            _expectedVersion, _entry,
+                                                            _version);
+    }
+  }
+  
   void
   SubarchitectureWorkingMemory::deleteFromWorkingMemory(const std::string& _id,
                                                         const std::string & _subarch,
@@ -167,7 +367,8 @@ namespace cast {
       WorkingMemoryEntryPtr entry(deleteFromWorkingMemory(_id, _component));
       //sanity check
       assert(entry);
-      signalChange(cdl::DELETE,_component,_id,entry->type, entry->entry->ice_ids());
+      signalChange(cdl::DELETE,_component,_id,entry->type, 
+                   SymbolTable::hierarchy(entry->entry));
     }
     else {
       //send on to the one that really cares
@@ -218,10 +419,7 @@ namespace cast {
     
     debug("unlocking on deletion before permission removal: %s %s",_id.c_str(),_component.c_str());
     
-    //must unlock around remove as it may block
-    m_readWriteLock.unlock();
     m_permissions.remove(_id);
-    m_readWriteLock.lock();
     
     debug("unlocking on deletion after permission removal: %s %s",_id.c_str(),_component.c_str());
     
@@ -344,75 +542,546 @@ namespace cast {
   void
   SubarchitectureWorkingMemory::receiveChangeEvent(const cdl::WorkingMemoryChange& wmc,
                                                    const Ice::Current & _ctx) {
+    //readers are only sent it if their filters allow external changes
+    queueChange(wmc, false);
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::receiveChangeEvents(const cdl::WorkingMemoryChangeSeq& _wmcs,
+                                                    const Ice::Current & _ctx) {
+    for(WorkingMemoryChangeSeq::const_iterator wmc = _wmcs.begin();
+        wmc < _wmcs.end(); ++wmc) {
+      queueChange(*wmc, false);
+    }
+  }
+
+
+  namespace {
+
+    /**
+     * The versions of a change sent to receivers asking for different
+     * payloads. Each payload includes the ones before it, so a copy
+     * without the entry, and one without the entry or patch, are
+     * enough. These are only made if someone needs them.
+     */
+    class ChangePayloads {
+    public:
+      ChangePayloads(const cdl::WorkingMemoryChange & _wmc) :
+        m_full(_wmc),
+        m_haveNoEntry(false),
+        m_haveBare(false) {}
+
+      const cdl::WorkingMemoryChange & get(cdl::ChangePayload _payload) {
+        if(_payload == cdl::ENTRYPAYLOAD
+           || (!m_full.entry && (_payload == cdl::PATCHPAYLOAD || !m_full.patch))) {
+          return m_full;
+        }
+        else if(_payload == cdl::PATCHPAYLOAD) {
+          if(!m_haveNoEntry) {
+            m_noEntry = m_full;
+            m_noEntry.entry = 0;
+            m_haveNoEntry = true;
+          }
+          return m_noEntry;
+        }
+        else {
+          if(!m_haveBare) {
+            m_bare = m_full;
+            m_bare.entry = 0;
+            m_bare.patch = 0;
+            m_haveBare = true;
+          }
+          return m_bare;
+        }
+      }
+
+    private:
+      const cdl::WorkingMemoryChange & m_full;
+      cdl::WorkingMemoryChange m_noEntry;
+      cdl::WorkingMemoryChange m_bare;
+      bool m_haveNoEntry;
+      bool m_haveBare;
+    };
+
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::signalChange(cdl::WorkingMemoryOperation _op,
+                                             const string & _src,
+                                             const string &  _id,
+                                             const string &  _type,
+                                             const TypeHierarchy & _hierarchy,
+                                             const cdl::WorkingMemoryEntryPtr & _entry,
+                                             const cdl::WorkingMemoryPatchPtr & _patch) {
+	  
     
-    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+    cdl::WorkingMemoryChange wmc;
+    wmc.operation = _op;
+    wmc.src = _src;
+    wmc.address.id = _id;
+    wmc.address.subarchitecture = getSubarchitectureID();
+    wmc.type = _type;
+    //super types are left out, receivers look them up by id
+    wmc.typeHierarchy = _hierarchy.types.front();
+    SymbolTable::registerHierarchy(wmc.address.subarchitecture, wmc.typeHierarchy, _hierarchy);
+    wmc.version = m_workingMemory.getOverwriteCount(_id);
+    wmc.patch = _patch;
+    wmc.entry = _entry;
+    
+    //an entry locked against reading must go through readBlock
+    if(_entry && m_permissions.anyLocked() && m_permissions.isLocked(_id) 
+       && !readAllowed(m_permissions.getPermissions(_id))) {
+      wmc.entry = 0;
+    }
+    
+    if(m_holdingChanges) {
+      m_heldChanges.push_back(wmc);
+    }
+    else {
+      queueChange(wmc, true);
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::queueChange(const cdl::WorkingMemoryChange & _wmc, 
+                                            bool _local) {
+    IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
+    
+    ChangeRecord record;
+    record.sequence = m_nextSequence++;
+    record.change = _wmc;
+    record.local = _local;
+    record.held = false;
+    
+    //the notifier only waits when the queue is empty
+    bool wasEmpty = m_pendingChanges.empty();
+    m_pendingChanges.push_back(record);
+    if(wasEmpty) {
+      m_changeMonitor.notifyAll();
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::releaseChanges() {
+    m_holdingChanges = false;
+    if(m_heldChanges.empty()) {
+      return;
+    }
     
+    IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
+    
+    bool wasEmpty = m_pendingChanges.empty();
+    for(vector<cdl::WorkingMemoryChange>::const_iterator wmc = m_heldChanges.begin();
+        wmc < m_heldChanges.end(); ++wmc) {
+      ChangeRecord record;
+      record.sequence = m_nextSequence++;
+      record.change = *wmc;
+      record.local = true;
+      //queued in one go, so nothing can come between them
+      record.held = (wmc + 1 < m_heldChanges.end());
+      m_pendingChanges.push_back(record);
+    }
+    m_heldChanges.clear();
+    
+    if(wasEmpty) {
+      m_changeMonitor.notifyAll();
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::notifyChanges() {
+    
+    ChangeRecordQueue records;
+    
+    while(true) {
+      {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
+        while(m_pendingChanges.empty() && !m_stopNotifying) {
+          if(m_batchWindow == 0) {
+            m_changeMonitor.wait();
+          }
+          else {
+            //wake up to send batches which have waited long enough
+            m_changeMonitor.timedWait(IceUtil::Time::milliSeconds(m_batchWindow));
+            break;
+          }
+        }
+        
+        //on stop, keep going until everything queued has been sent
+        if(m_pendingChanges.empty() && m_stopNotifying) {
+          return;
+        }
+        
+        records.swap(m_pendingChanges);
+      }
+      
+      //look up the hierarchies of forwarded changes before routing, so
+      //a slow working memory does not hold up filter registration.
+      //Only the first change with a hierarchy id waits for the lookup
+      for(ChangeRecordQueue::iterator record = records.begin();
+          record != records.end(); ++record) {
+        if(!record->local && TypeHierarchyCache::isCompact(record->change)) {
+          try {
+            m_typeHierarchies.resolve(record->change, 
+                                      getWorkingMemory(record->change.address.subarchitecture));
+          }
+          catch(const UnknownSubarchitectureException & e) {
+            println("unable to resolve type hierarchy: %s", e.message.c_str());
+          }
+        }
+      }
+      
+      {
+        boost::lock_guard<boost::mutex> locker(m_routingLock);
+        for(ChangeRecordQueue::iterator record = records.begin();
+            record != records.end(); ++record) {
+          notifyChange(*record);
+        }
+        
+        if(m_batchWindow > 0) {
+          flushBatches<WorkingMemoryReaderComponentPrx>(m_readerBatches, m_readerSends, false);
+          flushBatches<WorkingMemoryPrx>(m_wmBatches, m_wmSends, false);
+        }
+      }
+      records.clear();
+      
+      //receivers may change their filters while they take changes,
+      //which needs the routing lock
+      deliverAll();
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::notifyChange(ChangeRecord & _record) {
+    
+    //records are taken from the queue in order
+    assert(_record.sequence == m_notifiedSequence + 1);
+    m_notifiedSequence = _record.sequence;
+    
+    cdl::WorkingMemoryChange & wmc(_record.change);
+    
+    //the changes of a batch write, including the last one, go out together
+    bool releasing = m_sendingHeld && !_record.held;
+    m_sendingHeld = m_sendingHeld || _record.held;
+    
+    if(_record.local) {
+      wmc.timestamp = getCASTTime();
+      
+      if(m_bDebugOutput) {
+        ostringstream outStream;
+        outStream<<"SubarchitectureWorkingMemory::notifyChange: "<<_record.sequence<<" "<<wmc<<endl;
+        debug(outStream.str());
+      }
+      
+      //signal change locally if allowed
+      if (isAllowedChange(wmc)) {
+        //send locally
+        sendToReaders(wmc);
+      }
+      
+      // signal change across sub-architectures where appropriate
+      if (isSendingXarchChangeNotifications()) {
+        ChangePayloads payloads(wmc);
+        for(WMPrxMap::iterator i = m_workingMemories_oneway.begin();
+            i != m_workingMemories_oneway.end(); ++i) {
+          
+          cdl::ChangePayload payload;
+          if(isAllowedChange(i->first,wmc,payload)) {
+            sendChange(m_wmBatches, m_wmSends, i->first, i->second, payloads.get(payload));
+          }
+        }
+      }
+    }
     // if the filters require external changes, allow them to be
     // forwarded
-    if (!m_componentFilters.localFiltersOnly()) {
+    else if (!m_componentFilters.localFiltersOnly()) {
       
       if(m_bDebugOutput) {
         ostringstream outStream;
-        outStream<<"forwarding change: "<<wmc;
+        outStream<<"forwarding change: "<<_record.sequence<<" "<<wmc;
         debug(outStream.str());
       }
       
-      for(vector<WorkingMemoryReaderComponentPrx>::iterator reader = m_readers.begin();
-          reader < m_readers.end(); ++ reader) {
-        (*reader)->receiveChangeEvent(wmc);
+      sendToReaders(wmc);
+    }
+    
+    if(releasing) {
+      m_sendingHeld = false;
+      //without a window nothing may be left waiting
+      bool all = (m_batchWindow == 0);
+      flushBatches<WorkingMemoryReaderComponentPrx>(m_readerBatches, m_readerSends, all);
+      flushBatches<WorkingMemoryPrx>(m_wmBatches, m_wmSends, all);
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::sendToReaders(const cdl::WorkingMemoryChange & _wmc) {
+    
+    //the origins of all filters which match the change, with the
+    //payload each filter asks for
+    vector< pair<string, cdl::ChangePayload> > origins;
+    m_componentFilters.get(_wmc, origins);
+    //after sorting the last pair for an origin has its largest payload
+    sort(origins.begin(), origins.end());
+    
+    ChangePayloads payloads(_wmc);
+    
+    size_t sent = 0;
+    
+    for(vector< pair<string, cdl::ChangePayload> >::const_iterator origin = origins.begin();
+        origin < origins.end(); ++origin) {
+      if(origin + 1 < origins.end() && (origin + 1)->first == origin->first) {
+        continue;
       }
-      
+      ReaderPrxMap::iterator reader = m_routedReaders.find(origin->first);
+      if(reader != m_routedReaders.end()) {
+        sendChange(m_readerBatches, m_readerSends, reader->first, reader->second, 
+                   payloads.get(origin->second));
+        ++m_readerLag[reader->first].sent;
+        ++sent;
+      }
+    }
+    
+    for(ReaderPrxMap::iterator reader = m_unroutedReaders.begin();
+        reader != m_unroutedReaders.end(); ++ reader) {
+      sendChange(m_readerBatches, m_readerSends, reader->first, reader->second, 
+                 payloads.get(cdl::NOPAYLOAD));
+      ++m_readerLag[reader->first].sent;
+      ++sent;
+    }
+    
+    m_sendsSaved += m_readers.size() - sent;
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::reportReaderProgress(const std::string & _component,
+                                                     Ice::Long _processed,
+                                                     Ice::Long _dropped,
+                                                     bool _overflowing,
+                                                     const Ice::Current & _ctx) {
+    
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
+    
+    cast::StringMap<cdl::ReaderLag>::map::iterator i = m_readerLag.find(_component);
+    if(i == m_readerLag.end()) {
+      debug("progress reported by unknown reader: %s", _component.c_str());
+      return;
+    }
+    
+    cdl::ReaderLag & lag(i->second);
+    //oneway reports may arrive out of order
+    if(_processed < lag.processed) {
+      return;
     }
     
+    Ice::Long newlyDropped = _dropped - lag.dropped;
+    lag.processed = _processed;
+    lag.dropped = _dropped;
+    
+    if(_overflowing) {
+      ++lag.overflows;
+      println("reader %s has a full change queue: %ld changes behind, %ld dropped", 
+              _component.c_str(), 
+              static_cast<long>(lag.sent - lag.processed - lag.dropped), 
+              static_cast<long>(newlyDropped));
+    }
   }
   
   
+  cdl::ReaderLagSeq
+  SubarchitectureWorkingMemory::getReaderLag(const Ice::Current & _ctx) {
+    
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
+    
+    cdl::ReaderLagSeq lags;
+    lags.reserve(m_readerLag.size());
+    for(cast::StringMap<cdl::ReaderLag>::map::const_iterator i = m_readerLag.begin();
+        i != m_readerLag.end(); ++i) {
+      lags.push_back(i->second);
+    }
+    return lags;
+  }
+  
+  
+  cdl::LockStatisticsSeq
+  SubarchitectureWorkingMemory::getLockStatistics(const Ice::Current & _ctx) {
+    
+    CASTWMPermissionsMap::LockStatisticsMap statistics;
+    m_permissions.getStatistics(statistics);
+    
+    cdl::LockStatisticsSeq result;
+    result.reserve(statistics.size());
+    for(CASTWMPermissionsMap::LockStatisticsMap::const_iterator i = statistics.begin();
+        i != statistics.end(); ++i) {
+      cdl::LockStatistics stats;
+      stats.type = i->first;
+      stats.holdTimes.assign(i->second.holdTimes, 
+                             i->second.holdTimes + CASTWMPermissionsMap::LockStatistics::BUCKETS);
+      stats.waitTimes.assign(i->second.waitTimes, 
+                             i->second.waitTimes + CASTWMPermissionsMap::LockStatistics::BUCKETS);
+      stats.timeouts = i->second.timeouts;
+      result.push_back(stats);
+    }
+    return result;
+  }
+  
+  
+  cdl::StringSeq
+  SubarchitectureWorkingMemory::getTypeHierarchy(const std::string & _subarch,
+                                                 Ice::Int _typeHierarchy,
+                                                 const Ice::Current & _ctx)
+  throw (UnknownSubarchitectureException) {
+    
+    //if this is for me
+    if(getSubarchitectureID() == _subarch) {
+      const TypeHierarchy * hierarchy = SymbolTable::findHierarchy(_typeHierarchy);
+      if(hierarchy) {
+        return hierarchy->ids;
+      }
+      return cdl::StringSeq();
+    }
+    else {
+      //send on to the one that really cares
+      return getWorkingMemory(_subarch)->getTypeHierarchy(_subarch, _typeHierarchy);
+    }
+  }
   
   
+  template <class Prx>
   void
-  SubarchitectureWorkingMemory::signalChange(cdl::WorkingMemoryOperation _op,
-                                             const string & _src,
-                                             const string &  _id,
-                                             const string &  _type,
-                                             const vector<string> & _typeHierarchy) {
-	  
+  SubarchitectureWorkingMemory::sendChange(typename cast::StringMap< ChangeBatch<Prx> >::map & _batches,
+                                           typename OutgoingChanges<Prx>::list & _outgoing,
+                                           const std::string & _key,
+                                           const Prx & _destination,
+                                           const cdl::WorkingMemoryChange & _wmc) {
+    if(m_batchWindow == 0 && !m_sendingHeld) {
+      _outgoing.push_back(make_pair(_destination, cdl::WorkingMemoryChangeSeq(1, _wmc)));
+      return;
+    }
     
-    cdl::WorkingMemoryChange wmc;
-    wmc.operation = _op;
-    wmc.src = _src;
-    wmc.address.id = _id;
-    wmc.address.subarchitecture = getSubarchitectureID();
-    wmc.type = _type;
-    wmc.superTypes = _typeHierarchy;
-    wmc.timestamp = getCASTTime();
+    ChangeBatch<Prx> & batch(_batches[_key]);
+    //a reader may have been replaced since the batch was started
+    batch.destination = _destination;
+    if(batch.changes.empty()) {
+      batch.age.restart();
+    }
+    batch.changes.push_back(_wmc);
     
-    if(m_bDebugOutput) {
-      ostringstream outStream;
-      outStream<<"SubarchitectureWorkingMemory::signalChange: "<<wmc<<endl;
-      debug(outStream.str());
+    if(batch.changes.size() >= m_batchSize ||
+       (!m_sendingHeld && isBatchDue(batch.changes, batch.age))) {
+      flushBatch(batch, _outgoing);
+    }
+  }
+  
+  
+  template <class Prx>
+  void
+  SubarchitectureWorkingMemory::flushBatch(ChangeBatch<Prx> & _batch,
+                                           typename OutgoingChanges<Prx>::list & _outgoing) {
+    m_batchedChanges += _batch.changes.size();
+    ++m_batchesSent;
+    _outgoing.push_back(make_pair(_batch.destination, cdl::WorkingMemoryChangeSeq()));
+    _outgoing.back().second.swap(_batch.changes);
+  }
+  
+  
+  template <class Prx>
+  void
+  SubarchitectureWorkingMemory::deliver(typename OutgoingChanges<Prx>::list & _outgoing) {
+    for(typename OutgoingChanges<Prx>::list::const_iterator i = _outgoing.begin();
+        i != _outgoing.end(); ++i) {
+      if(i->second.size() == 1) {
+        i->first->receiveChangeEvent(i->second.front());
+      }
+      else {
+        i->first->receiveChangeEvents(i->second);
+      }
+    }
+    _outgoing.clear();
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::deliverAll() {
+    deliver<WorkingMemoryReaderComponentPrx>(m_readerSends);
+    deliver<WorkingMemoryPrx>(m_wmSends);
+  }
+  
+  
+  template <class Prx>
+  void
+  SubarchitectureWorkingMemory::flushBatches(typename cast::StringMap< ChangeBatch<Prx> >::map & _batches,
+                                             typename OutgoingChanges<Prx>::list & _outgoing,
+                                             bool _all) {
+    for(typename cast::StringMap< ChangeBatch<Prx> >::map::iterator i = _batches.begin();
+        i != _batches.end(); ++i) {
+      if(!i->second.changes.empty() &&
+         (_all || isBatchDue(i->second.changes, i->second.age))) {
+        flushBatch(i->second, _outgoing);
+      }
     }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::startInternal() {
+    SubarchitectureComponent::startInternal();
+    m_notifyThread = new NotifyThread(*this);
+    m_notifyThreadControl = m_notifyThread->start();
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::stopInternal() {
     
-    //signal change locally if allowed
-    if (isAllowedChange(wmc)) {
-      //send locally
-      for(vector<WorkingMemoryReaderComponentPrx>::iterator reader = m_readers.begin();
-          reader < m_readers.end(); ++ reader) {
-        (*reader)->receiveChangeEvent(wmc);
+    if(m_notifyThread) {
+      {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
+        m_stopNotifying = true;
+        m_changeMonitor.notifyAll();
       }
+      m_notifyThreadControl.join();
+      m_notifyThread = 0;
+      log("notified %ld changes", static_cast<long>(m_notifiedSequence));
     }
     
-    // signal change across sub-architectures where appropriate
-    if (isSendingXarchChangeNotifications()) {
-      for(WMPrxMap::iterator i = m_workingMemories_oneway.begin();
-          i != m_workingMemories_oneway.end(); ++i) {
-        
-        if(isAllowedChange(i->first,wmc)) {
-          
-          i->second->receiveChangeEvent(wmc);
-        }
+    if(m_batchWindow > 0) {
+      {
+        boost::lock_guard<boost::mutex> locker(m_routingLock);
+        flushBatches<WorkingMemoryReaderComponentPrx>(m_readerBatches, m_readerSends, true);
+        flushBatches<WorkingMemoryPrx>(m_wmBatches, m_wmSends, true);
       }
+      //the notifier thread has finished, so nothing else delivers
+      deliverAll();
+      log("sent %lu batched changes in %lu invocations", 
+          m_batchedChanges, m_batchesSent);
     }
     
+    SubarchitectureComponent::stopInternal();
+    log("change routing saved %lu reader sends", m_sendsSaved);
+    
+    if(m_permissions.getCycleCount() > 0) {
+      log("found %lu lock wait cycles", m_permissions.getCycleCount());
+    }
+    
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
+    for(cast::StringMap<cdl::ReaderLag>::map::const_iterator i = m_readerLag.begin();
+        i != m_readerLag.end(); ++i) {
+      if(i->second.dropped > 0 || i->second.overflows > 0) {
+        log("reader %s dropped %ld changes, queue full %ld times",
+            i->first.c_str(), 
+            static_cast<long>(i->second.dropped), 
+            static_cast<long>(i->second.overflows));
+      }
+    }
   }
   
   
@@ -420,6 +1089,10 @@ namespace cast {
   SubarchitectureWorkingMemory::readBlock(const std::string & _id,
                                           const std::string & _component) {
     
+    //nothing can block a read while nothing is locked
+    if(!m_permissions.anyLocked()) {
+      return;
+    }
     
     debug("start readBlock: %s %s", _id.c_str(), _component.c_str());
     
@@ -438,8 +1111,10 @@ namespace cast {
       
       m_readWriteLock.unlock_shared();
       
-      //lock entry, this will block
-      m_permissions.lock(_id,_component, cdl::LOCKEDODR);
+      //lock entry, this will block. Readers only hold the lock for a
+      //moment, so they go ahead of writers if waiters are prioritised.
+      CASTWMPermissionsMap::LockResult result = 
+        m_permissions.timedLock(_id,_component, cdl::LOCKEDODR, -1, 1);
       
       debug("locked readBlock: %s %s", _id.c_str(), _component.c_str());
       
@@ -450,7 +1125,9 @@ namespace cast {
       debug("and inside locked readBlock: %s %s", _id.c_str(), _component.c_str());
       
       
-      m_permissions.unlock(_id,_component);
+      if(result == CASTWMPermissionsMap::LOCKED) {
+        m_permissions.unlock(_id,_component);
+      }
       
       debug("unlocked readBlock: %s %s", _id.c_str(), _component.c_str());
       
@@ -487,6 +1164,48 @@ namespace cast {
       
     }
     
+    key = _config.find("--sync");
+    if(key != _config.end()) {
+      CASTWorkingMemory::SyncStrategy sync;
+      if(CASTWorkingMemory::parseSyncStrategy(key->second, sync)) {
+        m_workingMemory.setSyncStrategy(sync);
+        log("working memory sync strategy: %s", key->second.c_str());
+      }
+      else {
+        throw CASTException(exceptionMessage(__HERE__,
+                                             "unknown sync strategy \"%s\", expected none, exclusive or shared",
+                                             key->second.c_str()));
+      }
+    }
+    
+    key = _config.find("--lock-order");
+    if(key != _config.end()) {
+      if(key->second == "fifo") {
+        m_permissions.setWaitOrdering(CASTWMPermissionsMap::FIFO);
+      }
+      else if(key->second == "priority") {
+        m_permissions.setWaitOrdering(CASTWMPermissionsMap::PRIORITY);
+      }
+      else {
+        throw CASTException(exceptionMessage(__HERE__,
+                                             "unknown lock order \"%s\", expected fifo or priority",
+                                             key->second.c_str()));
+      }
+      log("lock waiters ordered by: %s", key->second.c_str());
+    }
+    
+    key = _config.find("--batch-window");
+    if(key != _config.end()) {
+      m_batchWindow = strtoul(key->second.c_str(), NULL, 10);
+      log("batching changes over %lu ms", m_batchWindow);
+    }
+    
+    key = _config.find("--batch-size");
+    if(key != _config.end()) {
+      m_batchSize = max(1ul, strtoul(key->second.c_str(), NULL, 10));
+      log("batching up to %lu changes", static_cast<unsigned long>(m_batchSize));
+    }
+    
     buildIDLists(_config);
   }
   
@@ -590,76 +1309,310 @@ namespace cast {
   }
   
   
+  namespace {
+
+    /**
+     * Passes the result of a lockEntry call forwarded to another
+     * working memory back to the original caller.
+     */
+    template <class AMDPtr>
+    class LockForwarder : public IceUtil::Shared {
+    public:
+      LockForwarder(const AMDPtr & _cb) :
+        m_cb(_cb) {}
+      void locked() {
+        m_cb->ice_response();
+      }
+      void timedLocked(bool _locked) {
+        m_cb->ice_response(_locked);
+      }
+      void failed(const Ice::Exception & _e) {
+        m_cb->ice_exception(_e);
+      }
+    private:
+      AMDPtr m_cb;
+    };
+
+  }
+
+
+  /**
+   * A lockEntry call parked in an entry's wait queue. It is also the
+   * timer task which times the call out.
+   */
+  class SubarchitectureWorkingMemory::PendingLock :
+    public CASTWMPermissionsMap::LockCallback,
+    public IceUtil::TimerTask {
+
+  public:
+
+    PendingLock(SubarchitectureWorkingMemory & _wm,
+                const std::string & _id,
+                const std::string & _subarch,
+                const std::string & _component,
+                const cdl::WorkingMemoryPermissions & _perm,
+                const AMD_WorkingMemory_lockEntryPtr & _cb) :
+      m_wm(_wm), m_id(_id), m_subarch(_subarch), 
+      m_component(_component), m_perm(_perm),
+      m_lockCallback(_cb) {}
+
+    PendingLock(SubarchitectureWorkingMemory & _wm,
+                const std::string & _id,
+                const std::string & _subarch,
+                const std::string & _component,
+                const cdl::WorkingMemoryPermissions & _perm,
+                const AMD_WorkingMemory_lockEntryWithTimeoutPtr & _cb) :
+      m_wm(_wm), m_id(_id), m_subarch(_subarch), 
+      m_component(_component), m_perm(_perm),
+      m_timedLockCallback(_cb) {}
+
+    //called by whoever unlocked or removed the entry, who may be
+    //holding the working memory lock, so finish on the timer thread
+    virtual void locked();
+    virtual void removed();
+
+    ///the timeout
+    virtual void runTimerTask();
+
+    /**
+     * Answer the call once the lock is held, or if the entry has
+     * gone. Must be called without m_readWriteLock held.
+     */
+    void complete(bool _locked);
+
+    void timedOut() {
+      m_wm.debug("%s lock timed out: %s",m_component.c_str(),m_id.c_str());
+      assert(m_timedLockCallback);
+      m_timedLockCallback->ice_response(false);
+    }
+
+    void fail(const Ice::Exception & _e) {
+      if(m_lockCallback) {
+        m_lockCallback->ice_exception(_e);
+      }
+      else {
+        m_timedLockCallback->ice_exception(_e);
+      }
+    }
+
+    const std::string & id() const {
+      return m_id;
+    }
+
+    const std::string & component() const {
+      return m_component;
+    }
+
+    const cdl::WorkingMemoryPermissions & permissions() const {
+      return m_perm;
+    }
+
+  private:
+
+    void schedule(bool _locked);
+
+    SubarchitectureWorkingMemory & m_wm;
+    std::string m_id;
+    std::string m_subarch;
+    std::string m_component;
+    cdl::WorkingMemoryPermissions m_perm;
+    AMD_WorkingMemory_lockEntryPtr m_lockCallback;
+    AMD_WorkingMemory_lockEntryWithTimeoutPtr m_timedLockCallback;
+
+  };
+
+
+  class SubarchitectureWorkingMemory::LockCompletion : 
+    public IceUtil::TimerTask {
+  public:
+    LockCompletion(const PendingLockPtr & _pending, bool _locked) :
+      m_pending(_pending),
+      m_locked(_locked) {}
+    virtual void runTimerTask() {
+      m_pending->complete(m_locked);
+    }
+  private:
+    PendingLockPtr m_pending;
+    bool m_locked;
+  };
+
+
   void
-  SubarchitectureWorkingMemory::lockEntry(const std::string & _id,
-                                          const std::string & _subarch,
-                                          const std::string & _component,
-                                          cdl::WorkingMemoryPermissions _perm,
-                                          const Ice::Current & _ctx)
-  throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+  SubarchitectureWorkingMemory::PendingLock::schedule(bool _locked) {
+    m_wm.m_lockTimer->cancel(this);
+    try {
+      m_wm.m_lockTimer->schedule(new LockCompletion(this, _locked), IceUtil::Time());
+    }
+    catch(const IceUtil::Exception & e) {
+      //the timer has been destroyed, so the working memory is stopping
+      m_wm.debug("dropping lock result for %s: %s", m_id.c_str(), e.what());
+    }
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::PendingLock::locked() {
+    schedule(true);
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::PendingLock::removed() {
+    schedule(false);
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::PendingLock::runTimerTask() {
+    //if the wait can't be cancelled the lock has been decided, and
+    //the result is on its way
+    if(m_wm.m_permissions.cancelWait(m_id, this)) {
+      timedOut();
+    }
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::PendingLock::complete(bool _locked) {
     
-    //if this is for me
-    if(getSubarchitectureID() == _subarch) {
-      //
-      
-      m_readWriteLock.lock_shared();
-      
-      if (m_workingMemory.contains(_id)) {
-        
-        debug("%s locking: %s",_component.c_str(),_id.c_str());
-        
-        
-        // now unlock incase the WM locking blocks
-        m_readWriteLock.unlock_shared();
+    boost::shared_lock<boost::shared_mutex> locker(m_wm.m_readWriteLock);
+    
+    //now check that it still exists, because it could've been
+    //deleted before the lock was released
+    if (!_locked || !m_wm.m_workingMemory.contains(m_id)) {
+      if(_locked) {
+        m_wm.m_permissions.unlock(m_id, m_component);
+      }
+      fail(DoesNotExistOnWMException(exceptionMessage(__HERE__,
+                                                      "Entry deleted whiile waiting for lock. Component %s was looking in subarch %s for id %s",
+                                                      m_component.c_str(),
+                                                      m_subarch.c_str(),
+                                                      m_id.c_str()),
+                                     makeWorkingMemoryAddress(m_id,m_subarch)));
+      return;
+    }
 
-        m_permissions.lock(_id, _component, _perm);
-        
-        
-        // relock so we're back in control
-        m_readWriteLock.lock_shared();
-        
-        
-        //now check that it still exists, because it could've been
-        //deleted before the lock was released
-        
-        
-        
-        if (!m_workingMemory.contains(_id)) {
-          m_permissions.unlock(_id, _component);
-          m_readWriteLock.unlock_shared();
-          throw(DoesNotExistOnWMException(exceptionMessage(__HERE__,
-                                                           "Entry deleted whiile waiting for lock. Component %s was looking in subarch %s for id %s",
-                                                           _component.c_str(),
-                                                           _subarch.c_str(),
-                                                           _id.c_str()),
-                                          makeWorkingMemoryAddress(_id,_subarch)));
-        }
-        else {          
-          assert(m_permissions.isLockHolder(_id,_component));
-          assert(m_permissions.getPermissions(_id) == _perm);
-//          debug("%s locked: ok",_component.c_str());
-        }
+    assert(m_wm.m_permissions.isLockHolder(m_id,m_component));
+    assert(m_wm.m_permissions.getPermissions(m_id) == m_perm);
+    
+    if(m_lockCallback) {
+      m_lockCallback->ice_response();
+    }
+    else {
+      m_timedLockCallback->ice_response(true);
+    }
+  }
+
+
+  void
+  SubarchitectureWorkingMemory::lockLocalEntry(const PendingLockPtr & _pending,
+                                               const long & _timeoutMillis) {
+    
+    const string & id(_pending->id());
+
+    {
+      boost::shared_lock<boost::shared_mutex> locker(m_readWriteLock);
+      
+      //kick up a fuss
+      if (!m_workingMemory.contains(id)) {
+        _pending->fail(DoesNotExistOnWMException(exceptionMessage(__HERE__,
+                                                                  "Entry does not exist for locking. Was looking in subarch %s for id %s",
+                                                                  getSubarchitectureID().c_str(),id.c_str()),
+                                                 makeWorkingMemoryAddress(id,getSubarchitectureID())));
+        return;
+      }
+    }
+    
+    debug("%s locking: %s",_pending->component().c_str(),id.c_str());
+    
+    if(_timeoutMillis == 0) {
+      //like a tryLock, but with the same outcome as the timed waits
+      CASTWMPermissionsMap::LockResult result = 
+        m_permissions.timedLock(id, _pending->component(), _pending->permissions(), 0);
+      if(result == CASTWMPermissionsMap::TIMED_OUT) {
+        _pending->timedOut();
       }
-      //else kick up a fuss
       else {
-        m_readWriteLock.unlock_shared();
-        throw(DoesNotExistOnWMException(exceptionMessage(__HERE__,
-                                                         "Entry does not exist for locking. Was looking in subarch %s for id %s",
-                                                         _subarch.c_str(),_id.c_str()),
-                                        makeWorkingMemoryAddress(_id,_subarch)));
+        _pending->complete(result == CASTWMPermissionsMap::LOCKED);
       }
-      
-      m_readWriteLock.unlock_shared();
+      return;
+    }
+
+    //schedule the timeout first, so it can't miss a quick grant
+    if(_timeoutMillis > 0) {
+      m_lockTimer->schedule(_pending, IceUtil::Time::milliSeconds(_timeoutMillis));
+    }
+
+    CASTWMPermissionsMap::LockResult result = 
+      m_permissions.lockAsync(id, _pending->component(), _pending->permissions(), _pending);
+
+    if(result != CASTWMPermissionsMap::QUEUED) {
+      if(_timeoutMillis > 0) {
+        m_lockTimer->cancel(_pending);
+      }
+      _pending->complete(result == CASTWMPermissionsMap::LOCKED);
+    }
+  }
+  
+  
+  void
+  SubarchitectureWorkingMemory::lockEntry_async(const AMD_WorkingMemory_lockEntryPtr & _cb,
+                                                const std::string & _id,
+                                                const std::string & _subarch,
+                                                const std::string & _component,
+                                                cdl::WorkingMemoryPermissions _perm,
+                                                const Ice::Current & _ctx) {
+    
+    //if this is for me
+    if(getSubarchitectureID() == _subarch) {
+      lockLocalEntry(new PendingLock(*this, _id, _subarch, _component, _perm, _cb), -1);
     }
     else {
-      getWorkingMemory(_subarch)->lockEntry(_id,_subarch, _component, _perm);
+      try {
+        typedef LockForwarder<AMD_WorkingMemory_lockEntryPtr> Forwarder;
+        IceUtil::Handle<Forwarder> forwarder(new Forwarder(_cb));
+        getWorkingMemory(_subarch)->begin_lockEntry(_id,_subarch, _component, _perm,
+                                                    newCallback_WorkingMemory_lockEntry(forwarder, 
+                                                                                        &Forwarder::locked,
+                                                                                        &Forwarder::failed));
+      }
+      catch(const UnknownSubarchitectureException & e) {
+        _cb->ice_exception(e);
+      }
     }
   }
   
   
+  void
+  SubarchitectureWorkingMemory::lockEntryWithTimeout_async(const AMD_WorkingMemory_lockEntryWithTimeoutPtr & _cb,
+                                                           const std::string & _id,
+                                                           const std::string & _subarch,
+                                                           const std::string & _component,
+                                                           cdl::WorkingMemoryPermissions _perm,
+                                                           Ice::Int _timeout,
+                                                           const Ice::Current & _ctx) {
+    
+    //if this is for me
+    if(getSubarchitectureID() == _subarch) {
+      lockLocalEntry(new PendingLock(*this, _id, _subarch, _component, _perm, _cb), _timeout);
+    }
+    else {
+      try {
+        typedef LockForwarder<AMD_WorkingMemory_lockEntryWithTimeoutPtr> Forwarder;
+        IceUtil::Handle<Forwarder> forwarder(new Forwarder(_cb));
+        getWorkingMemory(_subarch)->begin_lockEntryWithTimeout(_id,_subarch, _component, _perm, _timeout,
+                                                               newCallback_WorkingMemory_lockEntryWithTimeout(forwarder, 
+                                                                                                              &Forwarder::timedLocked,
+                                                                                                              &Forwarder::failed));
+      }
+      catch(const UnknownSubarchitectureException & e) {
+        _cb->ice_exception(e);
+      }
+    }
+  }
   
   
-  bool
+    bool
   SubarchitectureWorkingMemory::tryLockEntry(const std::string & _id,
                                              const std::string & _subarch,
                                              const std::string & _component,
@@ -749,10 +1702,11 @@ namespace cast {
   
   bool
   SubarchitectureWorkingMemory::addToWorkingMemory(const string & _id,
-                                                   WorkingMemoryEntryPtr _entry) {
-    bool result = m_workingMemory.add(_id,_entry);
+                                                   WorkingMemoryEntryPtr _entry,
+                                                   const vector<string> & _superTypes) {
+    bool result = m_workingMemory.add(_id,_entry,_superTypes);
     if (result) {
-      m_permissions.add(_id);
+      m_permissions.add(_id, _entry->type);
     }
     return result;
   }
@@ -785,10 +1739,12 @@ namespace cast {
       }
       //else get stuck in
       else {
-        bool result = addToWorkingMemory(_id, createEntry(_id,_type,_entry));
+        const TypeHierarchy & hierarchy(SymbolTable::hierarchy(_entry));
+        WorkingMemoryEntryPtr stored(createEntry(_id,_type,_entry));
+        bool result = addToWorkingMemory(_id, stored, hierarchy.ids);
         //sanity check
         assert(result);
-        signalChange(cdl::ADD,_component,_id,_type, _entry->ice_ids());
+        signalChange(cdl::ADD,_component,_id,_type, hierarchy, stored);
       }
     }
     else {
@@ -799,21 +1755,160 @@ namespace cast {
   
   
   
+  bool
+  SubarchitectureWorkingMemory::isLockedAgainst(const std::string & _id,
+                                                const std::string & _component,
+                                                bool _delete) {
+    if(!m_permissions.isLocked(_id)) {
+      return false;
+    }
+    const WorkingMemoryPermissions & permissions = m_permissions.getPermissions(_id);
+    bool allowed = _delete ? deleteAllowed(permissions) : overwriteAllowed(permissions);
+    return !allowed && !m_permissions.isLockHolder(_id, _component);
+  }
+  
+  
+  cdl::WorkingMemoryBatchResultSeq
+  SubarchitectureWorkingMemory::addToWorkingMemoryBatch(const std::string & _subarch,
+                                                        const std::string & _component,
+                                                        const cdl::WorkingMemoryBatchItemSeq & _items,
+                                                        const Ice::Current & _ctx)
+  throw (UnknownSubarchitectureException) {
+    
+    if(getSubarchitectureID() != _subarch) {
+      return getWorkingMemory(_subarch)->addToWorkingMemoryBatch(_subarch, _component, _items);
+    }
+    
+    WorkingMemoryBatchResultSeq results(_items.size());
+    
+    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+    ChangeHold hold(*this);
+    
+    for(size_t i = 0; i < _items.size(); ++i) {
+      const WorkingMemoryBatchItem & item(_items[i]);
+      
+      if(m_workingMemory.contains(item.id)) {
+        results[i].outcome = BATCHALREADYEXISTS;
+      }
+      else if(!item.entry) {
+        results[i].outcome = BATCHNOENTRY;
+      }
+      else {
+        const TypeHierarchy & hierarchy(SymbolTable::hierarchy(item.entry));
+        WorkingMemoryEntryPtr stored(createEntry(item.id, item.type, item.entry));
+        bool result = addToWorkingMemory(item.id, stored, hierarchy.ids);
+        //sanity check
+        assert(result);
+        signalChange(cdl::ADD, _component, item.id, item.type, hierarchy, stored);
+        results[i].outcome = BATCHWRITTEN;
+      }
+      results[i].version = m_workingMemory.getOverwriteCount(item.id);
+    }
+    
+    return results;
+  }
+  
+  
+  cdl::WorkingMemoryBatchResultSeq
+  SubarchitectureWorkingMemory::overwriteWorkingMemoryBatch(const std::string & _subarch,
+                                                            const std::string & _component,
+                                                            const cdl::WorkingMemoryBatchItemSeq & _items,
+                                                            const Ice::Current & _ctx)
+  throw (UnknownSubarchitectureException) {
+    
+    if(getSubarchitectureID() != _subarch) {
+      return getWorkingMemory(_subarch)->overwriteWorkingMemoryBatch(_subarch, _component, _items);
+    }
+    
+    WorkingMemoryBatchResultSeq results(_items.size());
+    
+    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+    ChangeHold hold(*this);
+    
+    for(size_t i = 0; i < _items.size(); ++i) {
+      const WorkingMemoryBatchItem & item(_items[i]);
+      
+      if(!m_workingMemory.contains(item.id)) {
+        results[i].outcome = BATCHDOESNOTEXIST;
+      }
+      else if(isLockedAgainst(item.id, _component, false)) {
+        results[i].outcome = BATCHLOCKED;
+      }
+      else if(!item.entry) {
+        results[i].outcome = BATCHNOENTRY;
+      }
+      else {
+        const TypeHierarchy & hierarchy(SymbolTable::hierarchy(item.entry));
+        WorkingMemoryEntryPtr stored(createEntry(item.id, item.type, item.entry));
+        bool result = overwriteWorkingMemory(item.id, stored, hierarchy.ids, _component);
+        //sanity check
+        assert(result);
+        signalChange(cdl::OVERWRITE, _component, item.id, item.type, hierarchy, stored);
+        results[i].outcome = BATCHWRITTEN;
+      }
+      results[i].version = m_workingMemory.getOverwriteCount(item.id);
+    }
+    
+    return results;
+  }
+  
+  
+  cdl::WorkingMemoryBatchResultSeq
+  SubarchitectureWorkingMemory::deleteFromWorkingMemoryBatch(const std::string & _subarch,
+                                                             const std::string & _component,
+                                                             const cdl::StringSeq & _ids,
+                                                             const Ice::Current & _ctx)
+  throw (UnknownSubarchitectureException) {
+    
+    if(getSubarchitectureID() != _subarch) {
+      return getWorkingMemory(_subarch)->deleteFromWorkingMemoryBatch(_subarch, _component, _ids);
+    }
+    
+    WorkingMemoryBatchResultSeq results(_ids.size());
+    
+    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+    ChangeHold hold(*this);
+    
+    for(size_t i = 0; i < _ids.size(); ++i) {
+      const string & id(_ids[i]);
+      
+      if(!m_workingMemory.contains(id)) {
+        results[i].outcome = BATCHDOESNOTEXIST;
+      }
+      else if(isLockedAgainst(id, _component, true)) {
+        results[i].outcome = BATCHLOCKED;
+      }
+      else {
+        WorkingMemoryEntryPtr entry(deleteFromWorkingMemory(id, _component));
+        //sanity check
+        assert(entry);
+        signalChange(cdl::DELETE, _component, id, entry->type, 
+                     SymbolTable::hierarchy(entry->entry));
+        results[i].outcome = BATCHWRITTEN;
+      }
+      results[i].version = m_workingMemory.getOverwriteCount(id);
+    }
+    
+    return results;
+  }
+  
+  
   void
   SubarchitectureWorkingMemory::registerComponentFilter(const cdl::WorkingMemoryChangeFilter & _filter,
                                                         Ice::Int priority,
                                                         const ::Ice::Current & _ctx) {
     
     
-    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
-    
     debug("SubarchitectureWorkingMemory::registerComponentFilter()");
     ostringstream outStream;
     outStream<<_filter;
     debug(outStream.str());
     
-    int prio = priority;
-    m_componentFilters.put(_filter,_filter.origin,prio);
+    {
+      boost::lock_guard<boost::mutex> locker(m_routingLock);
+      int prio = priority;
+      m_componentFilters.put(_filter,_filter.origin,prio);
+    }
     
     //cout<<"new filters length: "<<m_componentFilters.size()<<endl;
     //cout<<"only local: "<<m_componentFilters.localFiltersOnly()<<endl;
@@ -839,13 +1934,12 @@ namespace cast {
                                                             Ice::Int priority,
                                                             const ::Ice::Current & _ctx) {
     
-    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
-    
     debug("SubarchitectureWorkingMemory::registerWorkingMemoryFilter()");
     ostringstream outStream;
     outStream<<_filter;
     debug(outStream.str());
     
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
     m_wmFilters.put(_filter,_subarch,(int)priority);
   }
   
@@ -855,16 +1949,17 @@ namespace cast {
                                                       const ::Ice::Current & _ctx) {
     
     
-    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
-    
     //     debug("SubarchitectureWorkingMemory::deleteComponentChangeFilter()");
     //     debug(_src);
     //     ostringstream outStream;
     //     outStream<<_filter;
     //    debug(outStream.str());
     
-    vector<string> removed;
-    m_componentFilters.remove(_filter, removed);
+    {
+      boost::lock_guard<boost::mutex> locker(m_routingLock);
+      vector<string> removed;
+      m_componentFilters.remove(_filter, removed);
+    }
     
     
     for(WMPrxMap::iterator i = m_workingMemories.begin();
@@ -880,7 +1975,7 @@ namespace cast {
                                                           const ::Ice::Current & _ctx) {
     
     
-    boost::lock_guard<boost::shared_mutex> locker(m_readWriteLock);
+    boost::lock_guard<boost::mutex> locker(m_routingLock);
     
     
     //     debug("SubarchitectureWorkingMemory::deleteWMChangeFilter()");
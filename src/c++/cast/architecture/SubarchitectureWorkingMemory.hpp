@@ -26,20 +26,31 @@
 #include <cast/core/SubarchitectureComponent.hpp>
 #include <cast/core/CASTWorkingMemory.hpp>
 #include <cast/core/CASTWMPermissionsMap.hpp>
+#include <cast/core/SymbolTable.hpp>
 #include <cast/architecture/WorkingMemoryChangeFilterMap.hpp>
+#include <cast/architecture/TypeHierarchyCache.hpp>
 #include <cast/core/StringMap.hpp>
+#include <cast/core/CASTTimer.hpp>
 
 
 #include <vector>
+#include <deque>
 #include <memory>
 #include <tr1/unordered_set>
 
+#include <IceUtil/Timer.h>
+#include <IceUtil/Thread.h>
+#include <IceUtil/Monitor.h>
+#include <IceUtil/Mutex.h>
+
 #include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/mutex.hpp>
 
 namespace cast {
 
   typedef std::tr1::unordered_set<std::string> StringSet;
   typedef StringMap<interfaces::WorkingMemoryPrx>::map WMPrxMap;
+  typedef StringMap<interfaces::WorkingMemoryReaderComponentPrx>::map ReaderPrxMap;
   
   
   class SubarchitectureWorkingMemory: 
@@ -90,12 +101,12 @@ namespace cast {
 
     virtual 
     void
-    lockEntry(const std::string & _id, 
-	      const std::string & _subarch, 
-	      const std::string & _component, 
-	      cdl::WorkingMemoryPermissions _perm, 
-	      const Ice::Current & _ctx) 
-      throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
+    lockEntry_async(const interfaces::AMD_WorkingMemory_lockEntryPtr & _cb,
+		    const std::string & _id, 
+		    const std::string & _subarch, 
+		    const std::string & _component, 
+		    cdl::WorkingMemoryPermissions _perm, 
+		    const Ice::Current & _ctx);
 
     virtual 
     bool 
@@ -106,6 +117,16 @@ namespace cast {
 		 const Ice::Current & _ctx)
       throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
 
+    virtual 
+    void
+    lockEntryWithTimeout_async(const interfaces::AMD_WorkingMemory_lockEntryWithTimeoutPtr & _cb,
+			       const std::string & _id, 
+			       const std::string & _subarch,
+			       const std::string & _component,  
+			       cdl::WorkingMemoryPermissions _perm, 
+			       Ice::Int _timeout,
+			       const Ice::Current & _ctx);
+
     virtual
     void
     unlockEntry(const std::string & _id, 
@@ -123,8 +144,9 @@ namespace cast {
       debug("setting wm for subarch %s", _subarch.c_str());
       _wm->ice_ping();
       m_workingMemories[_subarch] = _wm;
-      //has to be unchecked cast for the following, as the oneway proxy has no way to return from the check
-      m_workingMemories_oneway[_subarch] = interfaces::WorkingMemoryPrx::uncheckedCast(_wm->ice_oneway());
+      //has to be unchecked cast for the following, as the oneway proxy has no way to return from the check.
+      //Not collocated, so a change is never received on the notifier thread
+      m_workingMemories_oneway[_subarch] = interfaces::WorkingMemoryPrx::uncheckedCast(_wm->ice_oneway()->ice_collocationOptimized(false));
     }
 
     interfaces::WorkingMemoryPrx &
@@ -158,6 +180,28 @@ namespace cast {
 			   const Ice::Current & _ctx)
       throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
 
+    virtual 
+    void 
+    patchWorkingMemory(const std::string & _id, 
+		       const std::string & _subarch, 
+		       const std::string & _type, 
+		       const std::string & _component, 
+		       const cdl::WorkingMemoryPatchPtr & _patch, 
+		       const Ice::Current & _ctx)
+      throw (DoesNotExistOnWMException, ConsistencyException, UnknownSubarchitectureException);
+
+    virtual 
+    cdl::WorkingMemoryEntryPtr
+    overwriteIfVersion(const std::string & _id, 
+		       const std::string & _subarch, 
+		       const std::string & _type, 
+		       const std::string & _component, 
+		       Ice::Int _expectedVersion, 
+		       const Ice::ObjectPtr & _entry, 
+		       Ice::Int & _version, 
+		       const Ice::Current & _ctx)
+      throw (DoesNotExistOnWMException, PermissionException, UnknownSubarchitectureException);
+
     virtual 
     void 
     deleteFromWorkingMemory(const std::string & _id, 
@@ -166,6 +210,30 @@ namespace cast {
 			    const Ice::Current & _ctx)
       throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
 
+    virtual 
+    cdl::WorkingMemoryBatchResultSeq
+    addToWorkingMemoryBatch(const std::string & _subarch, 
+			    const std::string & _component, 
+			    const cdl::WorkingMemoryBatchItemSeq & _items, 
+			    const Ice::Current & _ctx)
+      throw (UnknownSubarchitectureException);
+
+    virtual 
+    cdl::WorkingMemoryBatchResultSeq
+    overwriteWorkingMemoryBatch(const std::string & _subarch, 
+				const std::string & _component, 
+				const cdl::WorkingMemoryBatchItemSeq & _items, 
+				const Ice::Current & _ctx)
+      throw (UnknownSubarchitectureException);
+
+    virtual 
+    cdl::WorkingMemoryBatchResultSeq
+    deleteFromWorkingMemoryBatch(const std::string & _subarch, 
+				 const std::string & _component, 
+				 const cdl::StringSeq & _ids, 
+				 const Ice::Current & _ctx)
+      throw (UnknownSubarchitectureException);
+
     virtual 
     cdl::WorkingMemoryEntryPtr 
     getWorkingMemoryEntry(const std::string & _id, 
@@ -233,6 +301,42 @@ namespace cast {
     receiveChangeEvent(const cdl::WorkingMemoryChange& wmc, 
 		       const Ice::Current & _ctx);
 
+    virtual
+    void 
+    receiveChangeEvents(const cdl::WorkingMemoryChangeSeq& _wmcs, 
+			const Ice::Current & _ctx);
+
+    virtual
+    void
+    reportReaderProgress(const std::string & _component,
+			 Ice::Long _processed,
+			 Ice::Long _dropped,
+			 bool _overflowing,
+			 const Ice::Current & _ctx);
+
+    virtual
+    cdl::ReaderLagSeq
+    getReaderLag(const Ice::Current & _ctx);
+
+    virtual
+    cdl::LockStatisticsSeq
+    getLockStatistics(const Ice::Current & _ctx);
+
+    virtual
+    cdl::StringSeq
+    getTypeHierarchy(const std::string & _subarch,
+		     Ice::Int _typeHierarchy,
+		     const Ice::Current & _ctx)
+      throw (UnknownSubarchitectureException);
+
+    /**
+     * The number of change sends to readers which were avoided by
+     * only sending changes to readers with matching filters.
+     */
+    unsigned long getSendsSaved() const {
+      return m_sendsSaved;
+    }
+
 
   protected: 
   
@@ -266,6 +370,15 @@ namespace cast {
     isAllowedChange(const std::string & _wmid,
 		    const cdl::WorkingMemoryChange & _change) const;
 
+    /**
+     * As above, also giving the largest payload asked for by the
+     * filters of that wm which match the change.
+     */
+    bool
+    isAllowedChange(const std::string & _wmid,
+		    const cdl::WorkingMemoryChange & _change,
+		    cdl::ChangePayload & _payload) const;
+
 
     /**
      * Add some data to working memory. If the given id already exists
@@ -276,12 +389,16 @@ namespace cast {
      *            The id to use for the data.
      * @param _pData
      *            The data itself.
+     * @param _superTypes
+     *            The type hierarchy of the data, used to index it by
+     *            super type.
      * @return True if the data is added successfully, else false.
      */
     virtual 
     bool 
     addToWorkingMemory(const std::string & _id, 
-		       cdl::WorkingMemoryEntryPtr _entry);
+		       cdl::WorkingMemoryEntryPtr _entry,
+		       const std::vector<std::string> & _superTypes);
 
 
     /**
@@ -293,12 +410,16 @@ namespace cast {
      *            The id to use for the data.
      * @param _data
      *            The data itself.
+     * @param _superTypes
+     *            The type hierarchy of the data, used to index it by
+     *            super type.
      * @return True if the data is overwritten successfully, else false.
      */
     virtual 
     bool 
     overwriteWorkingMemory(const std::string & _id, 
 			   cdl::WorkingMemoryEntryPtr _data,
+			   const std::vector<std::string> & _superTypes,
 			   const std::string & _component)
       throw (DoesNotExistOnWMException);
   
@@ -322,10 +443,11 @@ namespace cast {
   
 
     /**
-     * Empty run method. Does nothing.
-     * 
+     * Starts the thread which sends out changes.
      */
-    virtual void runComponent(){};
+    virtual void startInternal();
+
+    virtual void stopInternal();
 
     /**
      * Determines whether to forward change notifications to other
@@ -382,10 +504,125 @@ namespace cast {
     void readBlock(const std::string & _id, 
 		   const std::string & _component);
 
+    class PendingLock;
+    typedef IceUtil::Handle<PendingLock> PendingLockPtr;
+    class LockCompletion;
+    friend class PendingLock;
+    friend class LockCompletion;
+
+    /**
+     * Lock an entry on this working memory for a lockEntry call. If
+     * the entry is locked, the call is parked in the entry's wait
+     * queue, and answered when the lock is handed over or
+     * _timeoutMillis passes, if it is not negative.
+     */
+    void lockLocalEntry(const PendingLockPtr & _pending,
+			const long & _timeoutMillis);
+
+
+    /**
+     * Whether a lock held by another component prevents _component
+     * from overwriting (or deleting if _delete is true) the entry.
+     */
+    bool isLockedAgainst(const std::string & _id, 
+			 const std::string & _component,
+			 bool _delete);
+
+    /**
+     * Hold all changes signalled until releaseChanges is called, so
+     * the changes from a batch write are queued, and then sent,
+     * together. Must be called with m_readWriteLock held exclusively,
+     * and released before it is unlocked.
+     */
+    void holdChanges() {
+      m_holdingChanges = true;
+    }
+
+    void releaseChanges();
+
+    /**
+     * Holds changes for as long as it exists, so held changes are
+     * released however a batch write ends. Must be destroyed before
+     * m_readWriteLock is unlocked.
+     */
+    class ChangeHold {
+    public:
+      ChangeHold(SubarchitectureWorkingMemory & _wm) :
+	m_wm(_wm) {
+	m_wm.holdChanges();
+      }
+
+      ~ChangeHold() {
+	m_wm.releaseChanges();
+      }
+
+    private:
+      SubarchitectureWorkingMemory & m_wm;
+    };
+
+    friend class ChangeHold;
+
+    /**
+     * A change waiting for the notifier thread.
+     */
+    struct ChangeRecord {
+      ///position in the order changes were queued
+      Ice::Long sequence;
+      cdl::WorkingMemoryChange change;
+      ///true if the change was made here rather than forwarded by
+      ///another working memory, so it needs a timestamp and may be
+      ///forwarded in turn
+      bool local;
+      ///true if the next record comes from the same batch write
+      bool held;
+    };
+
+    typedef std::deque<ChangeRecord> ChangeRecordQueue;
+
+    /**
+     * Thread which sends queued changes to readers and other working
+     * memories.
+     */
+    class NotifyThread : public IceUtil::Thread {
+    public:
+      NotifyThread(SubarchitectureWorkingMemory & _wm) : 
+	m_wm(_wm) {}
+      virtual void run() {
+	m_wm.notifyChanges();
+      }
+    private:
+      SubarchitectureWorkingMemory & m_wm;
+    };
+
+    friend class NotifyThread;
+
+    /**
+     * Queue a change for the notifier thread. Changes made here must
+     * be queued with m_readWriteLock held exclusively, so they are
+     * queued in the order they were made.
+     */
+    void queueChange(const cdl::WorkingMemoryChange & _wmc, 
+		     bool _local);
+
+    /**
+     * Body of the notifier thread. Takes changes from the queue in
+     * order, stamps, filters and sends them, and sends batches as they
+     * become due. Returns once stopping and the queue is empty.
+     */
+    void notifyChanges();
+
+    /**
+     * Route a single queued change. Called by the notifier thread
+     * with m_routingLock held; the changes it routes are sent by
+     * deliverAll once the lock has been released.
+     */
+    void notifyChange(ChangeRecord & _record);
+
 
     /**
      * Signal that an operation has occurred to all connected
-     * components.
+     * components. This only queues the change, it is stamped and sent
+     * by the notifier thread.
      * 
      * @param _op
      *            The operation type to signal.
@@ -397,11 +634,109 @@ namespace cast {
      * @param _type
      *            The ontological type of the entry that was the subject
      *            of the operation.
+     * @param _hierarchy
+     *            The interned type hierarchy of the entry. Only its
+     *            id is put in the change.
+     * @param _entry
+     *            The entry as stored by an add or overwrite, if any.
+     * @param _patch
+     *            The patch the entry was overwritten with, if any.
      */
     void 
     signalChange(cdl::WorkingMemoryOperation _op, const std::string & _src,
 		 const std::string &  _id,  const std::string &  _type, 
-		 const std::vector<std::string> & _typeHierarchy);
+		 const TypeHierarchy & _hierarchy,
+		 const cdl::WorkingMemoryEntryPtr & _entry = 0,
+		 const cdl::WorkingMemoryPatchPtr & _patch = 0);
+
+    /**
+     * Route a change to the readers whose filters match it, plus any
+     * readers which could not be identified. The entry and patch in
+     * the change are only passed on to readers whose filters ask for
+     * them. Must be called with m_routingLock held.
+     */
+    void 
+    sendToReaders(const cdl::WorkingMemoryChange & _wmc);
+
+    /**
+     * Changes waiting to be sent to a single reader or working memory.
+     */
+    template <class Prx>
+    struct ChangeBatch {
+      Prx destination;
+      cdl::WorkingMemoryChangeSeq changes;
+      ///time since the first change was added
+      CASTTimer age;
+    };
+
+    typedef ChangeBatch<interfaces::WorkingMemoryReaderComponentPrx> ReaderBatch;
+    typedef ChangeBatch<interfaces::WorkingMemoryPrx> WMBatch;
+    typedef StringMap<ReaderBatch>::map ReaderBatchMap;
+    typedef StringMap<WMBatch>::map WMBatchMap;
+
+    /**
+     * Changes which have been routed to a destination but not yet
+     * sent. They are sent once m_routingLock has been released, as a
+     * receiver may call back into this working memory to change its
+     * filters.
+     */
+    template <class Prx>
+    struct OutgoingChanges {
+      typedef std::vector< std::pair<Prx, cdl::WorkingMemoryChangeSeq> > list;
+    };
+
+    typedef OutgoingChanges<interfaces::WorkingMemoryReaderComponentPrx>::list ReaderSendList;
+    typedef OutgoingChanges<interfaces::WorkingMemoryPrx>::list WMSendList;
+
+    /**
+     * Route a change to a destination, either to be sent immediately
+     * or via its batch if batching is on. Must be called with
+     * m_routingLock held.
+     */
+    template <class Prx>
+    void 
+    sendChange(typename StringMap< ChangeBatch<Prx> >::map & _batches,
+	       typename OutgoingChanges<Prx>::list & _outgoing,
+	       const std::string & _key,
+	       const Prx & _destination,
+	       const cdl::WorkingMemoryChange & _wmc);
+
+    /**
+     * Route the batches which are full or have waited longer than the
+     * window, or all non-empty batches if _all is true. Must be called
+     * with m_routingLock held.
+     */
+    template <class Prx>
+    void 
+    flushBatches(typename StringMap< ChangeBatch<Prx> >::map & _batches,
+		 typename OutgoingChanges<Prx>::list & _outgoing,
+		 bool _all);
+
+    template <class Prx>
+    void 
+    flushBatch(ChangeBatch<Prx> & _batch,
+	       typename OutgoingChanges<Prx>::list & _outgoing);
+
+    /**
+     * Send routed changes on and empty the list. Must be called
+     * without m_routingLock held, and only by one thread at a time so
+     * changes leave in order.
+     */
+    template <class Prx>
+    void 
+    deliver(typename OutgoingChanges<Prx>::list & _outgoing);
+
+    /**
+     * Send all routed changes on.
+     */
+    void deliverAll();
+
+    bool 
+    isBatchDue(const cdl::WorkingMemoryChangeSeq & _changes,
+	       CASTTimer & _age) const {
+      return _changes.size() >= m_batchSize 
+	|| _age.split() * 1000 >= m_batchWindow;
+    }
 
 
 
@@ -428,15 +763,107 @@ namespace cast {
      * Used for locks and permissions
      */
     CASTWMPermissionsMap m_permissions;
+
+    /**
+     * Times out parked lockEntry calls, and answers them once their
+     * lock is handed over.
+     */
+    IceUtil::TimerPtr m_lockTimer;
   
     std::vector<interfaces::WorkingMemoryReaderComponentPrx> m_readers;
 
+    /**
+     * Oneway proxies to readers keyed by component id, which matches
+     * the origin of the filters they register.
+     */
+    ReaderPrxMap m_routedReaders;
+
+    /**
+     * Readers whose id could not be determined, keyed by proxy
+     * string. These receive all changes.
+     */
+    ReaderPrxMap m_unroutedReaders;
+
+    /**
+     * Changes sent to each reader and its last report of progress,
+     * keyed as m_routedReaders and m_unroutedReaders.
+     */
+    StringMap<cdl::ReaderLag>::map m_readerLag;
+
+    /**
+     * Count of reader sends avoided by routing.
+     */
+    unsigned long m_sendsSaved;
+
+    /**
+     * Time in milliseconds that outgoing changes may be held to batch
+     * them with later changes to the same destination. If 0, changes
+     * are sent immediately.
+     */
+    unsigned long m_batchWindow;
+
+    /**
+     * Number of changes at which a batch is sent regardless of the
+     * window.
+     */
+    size_t m_batchSize;
+
+    ///pending changes for readers, keyed as m_routedReaders and m_unroutedReaders
+    ReaderBatchMap m_readerBatches;
+
+    ///pending changes for other working memories, keyed by subarchitecture
+    WMBatchMap m_wmBatches;
+
+    ///changes routed to readers but not yet sent
+    ReaderSendList m_readerSends;
+
+    ///changes routed to other working memories but not yet sent
+    WMSendList m_wmSends;
+
+    ///true while a batch write is collecting its changes
+    bool m_holdingChanges;
+
+    ///changes collected by the current batch write
+    std::vector<cdl::WorkingMemoryChange> m_heldChanges;
+
+    ///true while the notifier is sending the changes of a batch write
+    bool m_sendingHeld;
+
+    ///changes waiting for the notifier thread
+    ChangeRecordQueue m_pendingChanges;
+    IceUtil::Monitor<IceUtil::Mutex> m_changeMonitor;
+    bool m_stopNotifying;
+
+    ///sequence number for the next queued change
+    Ice::Long m_nextSequence;
+
+    ///sequence number of the last change the notifier sent on
+    Ice::Long m_notifiedSequence;
+
+    IceUtil::ThreadPtr m_notifyThread;
+    IceUtil::ThreadControl m_notifyThreadControl;
+
+    ///count of batched changes sent, and the invocations used to send them
+    unsigned long m_batchedChanges;
+    unsigned long m_batchesSent;
+
 
     /**
      * Shared lock used to manage read/write synchronisation
      */
     boost::shared_mutex m_readWriteLock;
 
+    /**
+     * Protects the state used to send changes on: filters, readers,
+     * reader lag and batches. Never held while waiting for
+     * m_readWriteLock.
+     */
+    boost::mutex m_routingLock;
+
+    /**
+     * Super types of changes forwarded from other subarchitectures.
+     */
+    TypeHierarchyCache m_typeHierarchies;
 
   };
 
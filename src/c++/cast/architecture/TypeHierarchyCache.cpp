@@ -0,0 +1,100 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "TypeHierarchyCache.hpp"
+
+#include <cast/core/SymbolTable.hpp>
+
+#include <boost/thread/locks.hpp>
+
+using namespace std;
+
+namespace cast {
+
+  TypeHierarchyCache::SuperTypes
+  TypeHierarchyCache::resolve(const cdl::WorkingMemoryChange & _wmc,
+			      const interfaces::WorkingMemoryPrx & _wm) {
+    if(!isCompact(_wmc)) {
+      return SuperTypes();
+    }
+
+    pair<string, int> key(_wmc.address.subarchitecture, _wmc.typeHierarchy);
+    return lookup(key, _wm);
+  }
+
+
+  TypeHierarchyCache::SuperTypes
+  TypeHierarchyCache::lookup(const pair<string, int> & _key,
+			     const interfaces::WorkingMemoryPrx & _wm) {
+    {
+      boost::lock_guard<boost::mutex> lock(m_access);
+      SuperTypesMap::const_iterator i = m_superTypes.find(_key);
+      if(i != m_superTypes.end()) {
+	return i->second;
+      }
+    }
+
+    //not holding the lock while waiting for working memory
+    cdl::StringSeq ids;
+    try {
+      ids = _wm->getTypeHierarchy(_key.first, _key.second);
+    }
+    catch(const Ice::Exception &) {
+      return SuperTypes();
+    }
+
+    //unknown ids are not cached, so they are asked about again
+    if(ids.empty()) {
+      return SuperTypes();
+    }
+
+    //filters can now match compact changes with this id
+    SymbolTable::registerHierarchy(_key.first, _key.second, 
+				   SymbolTable::hierarchy(ids));
+
+    boost::lock_guard<boost::mutex> lock(m_access);
+    SuperTypes & superTypes(m_superTypes[_key]);
+    if(!superTypes) {
+      superTypes = SuperTypes(new vector<string>(ids));
+      ++m_lookups;
+    }
+    return superTypes;
+  }
+
+
+  void
+  TypeHierarchyCache::expand(cdl::WorkingMemoryChange & _wmc,
+			     const interfaces::WorkingMemoryPrx & _wm) {
+    SuperTypes superTypes(resolve(_wmc, _wm));
+    if(superTypes) {
+      _wmc.superTypes = *superTypes;
+    }
+  }
+
+
+  unsigned long
+  TypeHierarchyCache::getLookups() const {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    return m_lookups;
+  }
+
+} //namespace cast
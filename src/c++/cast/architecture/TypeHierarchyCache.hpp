@@ -0,0 +1,106 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_TYPE_HIERARCHY_CACHE_H_
+#define CAST_TYPE_HIERARCHY_CACHE_H_
+
+#include <cast/slice/CDL.hpp>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace cast {
+
+  /**
+   * Super types for the type hierarchy ids carried by changes, keyed
+   * by the subarchitecture which signalled the change. Working memory
+   * only sends a type's super types on request, so each hierarchy is
+   * fetched once with WorkingMemory::getTypeHierarchy and then shared
+   * by every change which refers to it. Thread safe.
+   */
+  class TypeHierarchyCache {
+
+  public:
+
+    typedef boost::shared_ptr< const std::vector<std::string> > SuperTypes;
+
+    TypeHierarchyCache() : 
+      m_lookups(0) {}
+
+    /**
+     * Whether a change refers to its type hierarchy by id instead of
+     * carrying its super types.
+     */
+    static bool isCompact(const cdl::WorkingMemoryChange & _wmc) {
+      return _wmc.superTypes.empty() && _wmc.typeHierarchy != 0;
+    }
+
+    /**
+     * Get the super types of a compact change, and make sure the
+     * symbol table knows the hierarchy its id stands for so it can be
+     * filtered as it is.
+     *
+     * @param _wmc The change.
+     * @param _wm The working memory to ask if the hierarchy is not
+     * cached. It must be able to reach the subarchitecture of the
+     * change.
+     * @return The super types, or null if the change is not compact
+     * or they could not be found.
+     */
+    SuperTypes resolve(const cdl::WorkingMemoryChange & _wmc,
+		       const interfaces::WorkingMemoryPrx & _wm);
+
+    /**
+     * As resolve, but also copy the super types into the change.
+     */
+    void expand(cdl::WorkingMemoryChange & _wmc,
+		const interfaces::WorkingMemoryPrx & _wm);
+
+    /**
+     * The number of hierarchies fetched from working memory.
+     */
+    unsigned long getLookups() const;
+
+  private:
+
+    typedef std::map< std::pair<std::string, int>, SuperTypes > SuperTypesMap;
+
+    /**
+     * Get the super types for a subarchitecture and id, from the
+     * cache or from working memory.
+     */
+    SuperTypes lookup(const std::pair<std::string, int> & _key,
+		      const interfaces::WorkingMemoryPrx & _wm);
+
+    SuperTypesMap m_superTypes;
+    unsigned long m_lookups;
+    mutable boost::mutex m_access;
+
+  };
+
+} //namespace cast
+
+#endif
@@ -48,6 +48,30 @@ namespace cast {
         SubarchitectureComponent::configureInternal(_config);
         m_permissions = 
         boost::shared_ptr< CASTComponentPermissionsMap >(new CASTComponentPermissionsMap(getSubarchitectureID()));
+        m_stopLockOutcomes = false;
+    }
+
+
+    void WorkingMemoryAttachedComponent::stopInternal() {
+        bool started;
+        {
+            IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_lockOutcomesMonitor);
+            m_stopLockOutcomes = true;
+            m_lockOutcomes.clear();
+            m_lockOutcomesMonitor.notifyAll();
+            started = m_lockOutcomeThread ? true : false;
+        }
+
+        if(started) {
+            //the component is locked while it stops, and the thread may
+            //be waiting for the lock, so let it in to see it must stop
+            unlockComponent();
+            m_lockOutcomeThreadControl.join();
+            lockComponent();
+            m_lockOutcomeThread = 0;
+        }
+
+        SubarchitectureComponent::stopInternal();
     }
 
 
@@ -176,7 +200,12 @@ namespace cast {
         assert (isVersioned(_id));
 
         int ownedVersion = getStoredVersionNumber(_id);
-        int wmVersion = getVersionNumber(_id, _subarch);
+        int wmVersion;
+
+        //a known version older than the one owned is out of date
+        if(!findLatestVersion(_id, _subarch, wmVersion) || wmVersion < ownedVersion) {
+            wmVersion = getVersionNumber(_id, _subarch);
+        }
 
         debug("haveLatestVersion(%s,%s): %d == %d", _id.c_str(), _subarch.c_str(), wmVersion, ownedVersion);
 
@@ -257,6 +286,171 @@ namespace cast {
     }
 
 
+    bool WorkingMemoryAttachedComponent::lockEntry(const cdl::WorkingMemoryAddress & _wma,
+                                                   const cdl::WorkingMemoryPermissions & _permissions,
+                                                   const unsigned int & _timeoutMillis)
+    throw(DoesNotExistOnWMException, UnknownSubarchitectureException) {
+        return lockEntry(_wma.id, 
+                         _wma.subarchitecture,
+                         _permissions,
+                         _timeoutMillis);
+    }
+
+
+    bool 
+    WorkingMemoryAttachedComponent::lockEntry(const std::string & _id, 
+                                              const std::string & _subarch,
+                                              const cdl::WorkingMemoryPermissions & _permissions,
+                                              const unsigned int & _timeoutMillis) 
+    throw(DoesNotExistOnWMException, UnknownSubarchitectureException) {
+
+        assert(!_id.empty());//id must not be empty
+        assert(!_subarch.empty());//id must not be empty
+        assert(m_workingMemory);
+
+        //will throw here if doesn't exist
+        bool succeeded = m_workingMemory->lockEntryWithTimeout(_id,_subarch, getComponentID(),
+                                                               _permissions, _timeoutMillis);
+
+        if (succeeded) {
+            m_permissions->setPermissions(_id, _subarch, _permissions);
+        }
+
+        return succeeded;
+    }
+
+
+    /**
+     * Reply handler for lockEntryAsync. Runs on an Ice thread, so only
+     * queues the outcome for the lock outcome thread.
+     */
+    class WorkingMemoryAttachedComponent::AsyncLock : public IceUtil::Shared {
+    public:
+        AsyncLock(WorkingMemoryAttachedComponent & _component,
+                  const cdl::WorkingMemoryAddress & _wma,
+                  const cdl::WorkingMemoryPermissions & _permissions,
+                  WorkingMemoryLockReceiver * _receiver) :
+            m_component(_component) {
+            m_outcome.receiver = _receiver;
+            m_outcome.wma = _wma;
+            m_outcome.permissions = _permissions;
+        }
+
+        void locked() {
+            m_component.queueLockOutcome(m_outcome);
+        }
+
+        void failed(const Ice::Exception & _e) {
+            LockOutcome outcome(m_outcome);
+            outcome.failure = boost::shared_ptr<Ice::Exception>(_e.ice_clone());
+            m_component.queueLockOutcome(outcome);
+        }
+
+    private:
+        WorkingMemoryAttachedComponent & m_component;
+        LockOutcome m_outcome;
+    };
+
+
+    /**
+     * Gives lockEntryAsync outcomes to their receivers.
+     */
+    class WorkingMemoryAttachedComponent::LockOutcomeThread : public IceUtil::Thread {
+    public:
+        LockOutcomeThread(WorkingMemoryAttachedComponent & _component) :
+            m_component(_component) {}
+
+        virtual void run() {
+            m_component.deliverLockOutcomes();
+        }
+
+    private:
+        WorkingMemoryAttachedComponent & m_component;
+    };
+
+
+    void 
+    WorkingMemoryAttachedComponent::queueLockOutcome(const LockOutcome & _outcome) {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_lockOutcomesMonitor);
+        if(!m_stopLockOutcomes) {
+            m_lockOutcomes.push_back(_outcome);
+            m_lockOutcomesMonitor.notify();
+        }
+    }
+
+
+    void 
+    WorkingMemoryAttachedComponent::deliverLockOutcomes() {
+        while(true) {
+            LockOutcome outcome;
+            {
+                IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_lockOutcomesMonitor);
+                while(m_lockOutcomes.empty() && !m_stopLockOutcomes) {
+                    m_lockOutcomesMonitor.wait();
+                }
+                if(m_stopLockOutcomes) {
+                    return;
+                }
+                outcome = m_lockOutcomes.front();
+                m_lockOutcomes.pop_front();
+            }
+
+            lockComponent();
+            {
+                //stop may have been called while waiting for the lock
+                IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_lockOutcomesMonitor);
+                if(m_stopLockOutcomes) {
+                    unlockComponent();
+                    return;
+                }
+            }
+
+            try {
+                if(outcome.failure) {
+                    outcome.receiver->lockFailed(outcome.wma, *outcome.failure);
+                }
+                else {
+                    m_permissions->setPermissions(outcome.wma.id, outcome.wma.subarchitecture, 
+                                                  outcome.permissions);
+                    outcome.receiver->entryLocked(outcome.wma);
+                }
+            }
+            catch(const std::exception & e) {
+                println("exception from lock receiver for %s:%s: %s", outcome.wma.id.c_str(),
+                        outcome.wma.subarchitecture.c_str(), e.what());
+            }
+            unlockComponent();
+        }
+    }
+
+
+    void 
+    WorkingMemoryAttachedComponent::lockEntryAsync(const cdl::WorkingMemoryAddress & _wma,
+                                                   const cdl::WorkingMemoryPermissions & _permissions,
+                                                   WorkingMemoryLockReceiver * _receiver) {
+
+        assert(!_wma.id.empty());//id must not be empty
+        assert(!_wma.subarchitecture.empty());//id must not be empty
+        assert(_receiver);
+        assert(m_workingMemory);
+
+        {
+            //started here rather than in the reply handler, which must not block
+            IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_lockOutcomesMonitor);
+            if(!m_lockOutcomeThread && !m_stopLockOutcomes) {
+                m_lockOutcomeThread = new LockOutcomeThread(*this);
+                m_lockOutcomeThreadControl = m_lockOutcomeThread->start();
+            }
+        }
+
+        IceUtil::Handle<AsyncLock> asyncLock(new AsyncLock(*this, _wma, _permissions, _receiver));
+        m_workingMemory->begin_lockEntry(_wma.id, _wma.subarchitecture, getComponentID(), _permissions,
+                                         interfaces::newCallback_WorkingMemory_lockEntry(asyncLock,
+                                                                                         &AsyncLock::locked,
+                                                                                         &AsyncLock::failed));
+    }
+
+
     bool 
     WorkingMemoryAttachedComponent::tryLockEntry(const std::string & _id,
                                                  const cdl::WorkingMemoryPermissions & _permissions) 
@@ -30,6 +30,7 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include <deque>
 #include <list>
 #include <vector>
 
@@ -37,6 +38,31 @@ namespace cast {
 
   typedef StringMap<int>::map IntMap;
 
+  /**
+   * Told the outcome of WorkingMemoryAttachedComponent::lockEntryAsync.
+   * Methods are called from a thread of the component with the
+   * component locked, so they may use working memory as
+   * runComponent does.
+   *
+   * @author nah
+   */
+  class WorkingMemoryLockReceiver {
+  public:
+    virtual ~WorkingMemoryLockReceiver() {}
+
+    /**
+     * The component now holds the lock on the entry.
+     */
+    virtual void entryLocked(const cdl::WorkingMemoryAddress & _wma) = 0;
+
+    /**
+     * The lock could not be obtained, usually because the entry does
+     * not exist or was deleted while waiting.
+     */
+    virtual void lockFailed(const cdl::WorkingMemoryAddress & _wma,
+			    const Ice::Exception & _e) = 0;
+  };
+
   /**
    * The absolute simplest component that can be attached to a working
    * memory. Just checks whether an entry exists on a local working memory or
@@ -218,6 +244,59 @@ namespace cast {
 
 
 
+    /**
+     * Try to obtain a lock on a working memory entry with the given
+     * permissions, blocking for at most _timeoutMillis. Waiting
+     * components are given the lock in the order the working memory
+     * is configured for.
+     * 
+     * @param _id
+     * @param _subarch
+     * @param _permissions
+     * @param _timeoutMillis
+     * @return true if the lock was obtained, false if the wait timed out.
+     * @throws DoesNotExistOnWMException
+     */
+    virtual bool lockEntry(const std::string & _id, 
+			   const std::string & _subarch,
+			   const cdl::WorkingMemoryPermissions & _permissions,
+			   const unsigned int & _timeoutMillis)
+      throw(DoesNotExistOnWMException, UnknownSubarchitectureException);
+
+
+
+    /**
+     * Try to obtain a lock on a working memory entry with the given
+     * permissions, blocking for at most _timeoutMillis.
+     * 
+     * @param _wma
+     * @param _permissions
+     * @param _timeoutMillis
+     * @return true if the lock was obtained, false if the wait timed out.
+     * @throws DoesNotExistOnWMException
+     */
+    virtual bool lockEntry(const cdl::WorkingMemoryAddress & _wma,
+			   const cdl::WorkingMemoryPermissions & _permissions,
+			   const unsigned int & _timeoutMillis)
+      throw(DoesNotExistOnWMException, UnknownSubarchitectureException);
+
+
+
+    /**
+     * Ask for a lock on a working memory entry with the given
+     * permissions without waiting for it. _receiver is told when the
+     * lock is obtained or fails, and must stay valid until then.
+     * 
+     * @param _wma
+     * @param _permissions
+     * @param _receiver
+     */
+    virtual void lockEntryAsync(const cdl::WorkingMemoryAddress & _wma,
+				const cdl::WorkingMemoryPermissions & _permissions,
+				WorkingMemoryLockReceiver * _receiver);
+
+
+
     /**
      * Try to obtain a lock on a working memory entry. This will return true if
      * the item is locked, or false if not. This method does not block.
@@ -315,8 +394,50 @@ namespace cast {
     //need to initialise later, so use smart ptr
     boost::shared_ptr<CASTComponentPermissionsMap> m_permissions;
 
+    class AsyncLock;
+    friend class AsyncLock;
+
+    class LockOutcomeThread;
+    friend class LockOutcomeThread;
+
+    /**
+     * The outcome of a lockEntryAsync, waiting to be given to its
+     * receiver.
+     */
+    struct LockOutcome {
+      WorkingMemoryLockReceiver * receiver;
+      cdl::WorkingMemoryAddress wma;
+      cdl::WorkingMemoryPermissions permissions;
+      ///null if the lock was obtained
+      boost::shared_ptr<Ice::Exception> failure;
+    };
+
+    /**
+     * Called from the Ice thread which receives the reply, so it must
+     * not block.
+     */
+    void queueLockOutcome(const LockOutcome & _outcome);
+
+    /**
+     * Body of the lock outcome thread.
+     */
+    void deliverLockOutcomes();
+
+    ///lock outcomes are given to receivers on their own thread, as
+    ///receivers may call working memory
+    IceUtil::Monitor<IceUtil::Mutex> m_lockOutcomesMonitor;
+    std::deque<LockOutcome> m_lockOutcomes;
+    bool m_stopLockOutcomes;
+    IceUtil::ThreadPtr m_lockOutcomeThread;
+    IceUtil::ThreadControl m_lockOutcomeThreadControl;
+
   protected:
 
+    /**
+     * Stops the thread which gives lockEntryAsync outcomes to their
+     * receivers.
+     */
+    virtual void stopInternal();
 
     /**
      * Associate the given id with the given version number. This should not be
@@ -415,6 +536,24 @@ namespace cast {
     haveLatestVersion(const std::string &_id, const std::string &_subarch)
       throw(ConsistencyException,DoesNotExistOnWMException, UnknownSubarchitectureException);
 
+    /**
+     * Get the version an entry has on working memory without asking
+     * working memory, if this component keeps track of it. Used by
+     * haveLatestVersion, which asks working memory if this returns
+     * false. This implementation always returns false.
+     * 
+     * @param _id
+     * @param _subarch
+     * @param _version Set to the version if it is known.
+     * @return true if the version is known.
+     */
+    virtual 
+    bool findLatestVersion(const std::string & _id, 
+			   const std::string & _subarch,
+			   int & _version) {
+      return false;
+    }
+
 
 
     /**
@@ -90,6 +90,14 @@ namespace cast {
       return AFTER;
     }
 
+    // payload
+    if (_f1.payload < _f2.payload) {
+      return BEFORE;
+    }
+    if (_f1.payload > _f2.payload) {
+      return AFTER;
+    }
+
   
     return EQUAL;
   
@@ -184,6 +192,16 @@ namespace cast {
     
     return true;
   }
+
+
+  void
+  WorkingMemoryChangeFilterComparator::intern(const cdl::WorkingMemoryChangeFilter &_filter,
+					      InternedFilter &_interned) {
+    _interned.operation = _filter.operation;
+    _interned.src = SymbolTable::intern(_filter.src);
+    _interned.subarchitecture = SymbolTable::intern(_filter.address.subarchitecture);
+    _interned.type = SymbolTable::intern(_filter.type);
+  }
     
 
 } //namespace cast
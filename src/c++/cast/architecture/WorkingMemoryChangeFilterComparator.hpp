@@ -24,9 +24,21 @@
 #define CAST_WORKING_MEMORY_CHANGE_FILTER_COMPARATOR_H_
 
 #include <cast/slice/CDL.hpp>
+#include <cast/core/SymbolTable.hpp>
 
 namespace cast {
 
+  /**
+   * The fields of a filter checked by allowsChange, with strings
+   * interned. EMPTY_SYMBOL means the field is not set.
+   */
+  struct InternedFilter {
+    cdl::WorkingMemoryOperation operation;
+    Symbol src;
+    Symbol subarchitecture;
+    Symbol type;
+  };
+
   struct WorkingMemoryChangeFilterComparator {
     
     bool operator () (const cdl::WorkingMemoryChangeFilter & _f1, 
@@ -37,6 +49,30 @@ namespace cast {
     allowsChange(const cdl::WorkingMemoryChangeFilter &_filter,
 		 const cdl::WorkingMemoryChange &_change);
 
+    static
+    void
+    intern(const cdl::WorkingMemoryChangeFilter &_filter,
+	   InternedFilter &_interned);
+
+    /**
+     * Equivalent to the string version, except that entry ids are not
+     * compared, so the caller must match them separately.
+     */
+    static
+    bool 
+    allowsChange(const InternedFilter &_filter,
+		 const InternedChange &_change) {
+      return (_filter.subarchitecture == EMPTY_SYMBOL 
+	      || _filter.subarchitecture == _change.subarchitecture)
+	&& (_filter.type == EMPTY_SYMBOL 
+	    || _filter.type == _change.type
+	    || _change.hierarchy->contains(_filter.type))
+	&& (_filter.operation == cdl::WILDCARD 
+	    || _filter.operation == _change.operation)
+	&& (_filter.src == EMPTY_SYMBOL 
+	    || _filter.src == _change.src);
+    }
+
   };
 } //namespace cast
 
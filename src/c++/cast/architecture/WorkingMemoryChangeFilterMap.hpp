@@ -26,13 +26,22 @@
 #include <map>
 #include <vector>
 #include <utility>
+#include <algorithm>
 
 #include <cast/architecture/WorkingMemoryChangeFilterComparator.hpp>
+#include <cast/core/StringMap.hpp>
 
 namespace cast {
 
   /**
    * Map to store change filters against objects.
+   *
+   * Filters are also indexed by the most selective field they set
+   * (entry id, then type) and then by operation, so matching a change
+   * only has to check filters which could possibly match it, rather
+   * than every filter in the map. Type, source and subarchitecture
+   * names are interned via SymbolTable so the remaining checks are
+   * integer comparisons.
    * 
    * @author nah
    */
@@ -62,11 +71,43 @@ namespace cast {
     typedef typename InternalFilterMap::size_type size_type;
 
   private:
+
+    typedef std::vector<const_iterator> IteratorVector;
+
+    /**
+     * A filter in the index, with its interned fields so matching
+     * compares integers rather than strings.
+     */
+    struct IndexEntry {
+      const_iterator filter;
+      InternedFilter interned;
+    };
+
+    typedef std::vector<IndexEntry> EntryVector;
+
+    /**
+     * Filters in the index which share a key, split by operation. The
+     * last slot holds WILDCARD filters.
+     */
+    struct OperationIndex {
+      EntryVector operations[cdl::WILDCARD + 1];
+    };
+
+    typedef typename StringMap<OperationIndex>::map KeyedIndex;
    
     InternalFilterMap m_map;
 
     bool m_localOnly;
 
+    ///filters which match a specific entry id
+    KeyedIndex m_byID;
+
+    ///filters with no id which match a type, indexed by type symbol
+    std::vector<OperationIndex> m_byType;
+
+    ///filters with neither an id or a type
+    OperationIndex m_unkeyed;
+
     void 
     updateFilters() {
       m_localOnly = true;
@@ -81,6 +122,140 @@ namespace cast {
       }           
     }
 
+    /**
+     * Get the vector a filter is indexed in, creating it if necessary.
+     */
+    EntryVector &
+    indexFor(const cdl::WorkingMemoryChangeFilter & _filter,
+	     const InternedFilter & _interned) {
+      OperationIndex * index;
+      if(!_filter.address.id.empty()) {
+	index = &m_byID[_filter.address.id];
+      }
+      else if(_interned.type != EMPTY_SYMBOL) {
+	if(_interned.type >= static_cast<Symbol>(m_byType.size())) {
+	  m_byType.resize(_interned.type + 1);
+	}
+	index = &m_byType[_interned.type];
+      }
+      else {
+	index = &m_unkeyed;
+      }
+      return index->operations[_filter.operation];
+    }
+
+    void 
+    index(const_iterator _filter) {
+      IndexEntry entry;
+      entry.filter = _filter;
+      WorkingMemoryChangeFilterComparator::intern(_filter->first, entry.interned);
+      indexFor(_filter->first, entry.interned).push_back(entry);
+    }
+
+    void 
+    unindex(const_iterator _filter) {
+      InternedFilter interned;
+      WorkingMemoryChangeFilterComparator::intern(_filter->first, interned);
+      EntryVector & indexed(indexFor(_filter->first, interned));
+      typename EntryVector::iterator i = indexed.begin();
+      while(i < indexed.end() && i->filter != _filter) {
+	++i;
+      }
+      assert(i != indexed.end());
+      indexed.erase(i);
+    }
+
+    void
+    reindex() {
+      m_byID.clear();
+      m_byType.clear();
+      m_unkeyed = OperationIndex();
+      for(const_iterator i = m_map.begin(); i != m_map.end(); ++i) {
+	index(i);
+      }
+    }
+
+    /**
+     * Add the filters from _index that allow _wmc to _matches. Stops
+     * after the first match if _firstOnly is true.
+     */
+    static bool
+    collect(const OperationIndex & _index,
+	    const InternedChange & _wmc,
+	    IteratorVector & _matches,
+	    bool _firstOnly) {
+      const EntryVector * candidates[2] = {
+	&_index.operations[_wmc.operation],
+	&_index.operations[cdl::WILDCARD]
+      };
+      //WILDCARD changes do not exist, but be safe
+      int lists = (_wmc.operation == cdl::WILDCARD) ? 1 : 2;
+      for(int l = 0; l < lists; ++l) {
+	for(typename EntryVector::const_iterator i = candidates[l]->begin();
+	    i < candidates[l]->end(); ++i) {
+	  if (WorkingMemoryChangeFilterComparator::allowsChange(i->interned, _wmc)) {
+	    _matches.push_back(i->filter);
+	    if(_firstOnly) {
+	      return true;
+	    }
+	  }
+	}
+      }
+      return !_matches.empty();
+    }
+
+    /**
+     * Find the filters which allow the change.
+     */
+    bool
+    match(const cdl::WorkingMemoryChange & _wmc,
+	  IteratorVector & _matches,
+	  bool _firstOnly) const {
+
+      InternedChange interned;
+      SymbolTable::intern(_wmc, interned);
+
+      //ids are matched by the lookup, the rest by the interned fields
+      typename KeyedIndex::const_iterator byID = m_byID.find(_wmc.address.id);
+      if(byID != m_byID.end()) {
+	if(collect(byID->second, interned, _matches, _firstOnly) && _firstOnly) {
+	  return true;
+	}
+      }
+
+      //the type the entry was stored as, then the entry's own
+      //hierarchy, which normally contains it too
+      if(interned.type < static_cast<Symbol>(m_byType.size())) {
+	if(collect(m_byType[interned.type], interned, _matches, _firstOnly) && _firstOnly) {
+	  return true;
+	}
+      }
+      const std::vector<Symbol> & types(interned.hierarchy->types);
+      for(std::vector<Symbol>::const_iterator i = types.begin();
+	  i < types.end(); ++i) {
+	if(*i == interned.type) {
+	  continue;
+	}
+	if(*i < static_cast<Symbol>(m_byType.size())) {
+	  if(collect(m_byType[*i], interned, _matches, _firstOnly) && _firstOnly) {
+	    return true;
+	  }
+	}
+      }
+
+      collect(m_unkeyed, interned, _matches, _firstOnly);
+      
+      return !_matches.empty();
+    }
+
+    /**
+     * Orders matches the same way as the underlying map.
+     */
+    struct IteratorOrder {
+      bool operator()(const const_iterator & _a, const const_iterator & _b) const {
+	return WorkingMemoryChangeFilterComparator()(_a->first, _b->first);
+      }
+    };
 
   public:
     
@@ -89,6 +264,25 @@ namespace cast {
      */
     WorkingMemoryChangeFilterMap() : m_localOnly(true) {}
 
+    /**
+     * Copy ctor. The index holds iterators, so must be rebuilt.
+     */
+    WorkingMemoryChangeFilterMap(const WorkingMemoryChangeFilterMap & _other) : 
+      m_map(_other.m_map), 
+      m_localOnly(_other.m_localOnly) {
+      reindex();
+    }
+
+    WorkingMemoryChangeFilterMap & 
+    operator=(const WorkingMemoryChangeFilterMap & _other) {
+      if(this != &_other) {
+	m_map = _other.m_map;
+	m_localOnly = _other.m_localOnly;
+	reindex();
+      }
+      return *this;
+    }
+
     /**
      * Determines whether the filter set contains only local filters on
      * whether it needs xarch changes too.
@@ -105,15 +299,8 @@ namespace cast {
      * Whether this filter set allows a change to pass
      */
     bool allowsChange(const cdl::WorkingMemoryChange & _wmc) const {
-      for(const_iterator i = m_map.begin();
-	  i != m_map.end();
-	  ++i) {
-	if (WorkingMemoryChangeFilterComparator::allowsChange(i->first,_wmc)) {
-	  return true;
-	}
-      }
-      return false;
-      
+      IteratorVector matches;
+      return match(_wmc, matches, true);
     }
     
 
@@ -127,24 +314,55 @@ namespace cast {
      */
     void get(const cdl::WorkingMemoryChange & _wmc, 
 	     std::vector<Stored> & _receivers) const {
-      //cout<<"get"<<endl;      
-      for(const_iterator i = m_map.begin();
-	  i != m_map.end();
-	  ++i) {
-	if (WorkingMemoryChangeFilterComparator::allowsChange(i->first, _wmc)) {
-	  PairVector pReceiver = i->second;
-	  assert(pReceiver.size() > 0);
-	  
-	  //insert all receivers from stored vector into input vector
-	  //_receivers.insert(_receivers.begin(), pReceiver.begin(), pReceiver.end());
+
+      IteratorVector matches;
+      if(!match(_wmc, matches, false)) {
+	return;
+      }
+
+      //return receivers in map order, as a full scan would
+      if(matches.size() > 1) {
+	std::sort(matches.begin(), matches.end(), IteratorOrder());
+      }
+
+      for(typename IteratorVector::const_iterator i = matches.begin();
+	  i < matches.end(); ++i) {
+	const PairVector & pReceiver = (*i)->second;
+	assert(pReceiver.size() > 0);
 	  
-	  for(typename PairVector::const_iterator j = pReceiver.begin();
-	      j < pReceiver.end(); ++j) {
-	    _receivers.push_back(j->first);
-	  }
+	for(typename PairVector::const_iterator j = pReceiver.begin();
+	    j < pReceiver.end(); ++j) {
+	  _receivers.push_back(j->first);
+	}
+      }
+    }
+    
+
+    /**
+     * As get, but also gives the payload asked for by the filter each
+     * receiver was found through. A receiver is listed once for each
+     * of its filters that match.
+     */
+    void get(const cdl::WorkingMemoryChange & _wmc, 
+	     std::vector< std::pair<Stored, cdl::ChangePayload> > & _receivers) const {
+
+      IteratorVector matches;
+      if(!match(_wmc, matches, false)) {
+	return;
+      }
+
+      if(matches.size() > 1) {
+	std::sort(matches.begin(), matches.end(), IteratorOrder());
+      }
+
+      for(typename IteratorVector::const_iterator i = matches.begin();
+	  i < matches.end(); ++i) {
+	const PairVector & pReceiver = (*i)->second;
+	for(typename PairVector::const_iterator j = pReceiver.begin();
+	    j < pReceiver.end(); ++j) {
+	  _receivers.push_back(std::make_pair(j->first, (*i)->first.payload));
 	}
       }
-      //cout<<"done"<<endl;           
     }
     
 
@@ -156,6 +374,7 @@ namespace cast {
 	  j < i->second.end(); ++j) {
 	_removed.push_back(j->first);
       }
+      unindex(i);
       m_map.erase(i);
       updateFilters();
     }
@@ -194,7 +413,11 @@ namespace cast {
 	//now deleted stored things
 	for(std::vector<cdl::WorkingMemoryChangeFilter>::iterator i = _removed.begin();
 	    i < _removed.end(); ++i){ 
-	  m_map.erase(*i);
+	  iterator found = m_map.find(*i);
+	  if(found != m_map.end()) {
+	    unindex(found);
+	    m_map.erase(found);
+	  }
 	}
 
 	updateFilters();
@@ -241,14 +464,15 @@ namespace cast {
       //if it doesn't add one in.
       if(i == m_map.end()) {
 	PairVector receiverList;
-	m_map[_key] = receiverList;       
+	i = m_map.insert(std::make_pair(_key, receiverList)).first;
+	index(i);
 	
 	//update local flag on new filter
 	m_localOnly = m_localOnly && (_key.restriction == cdl::LOCALSA);
       }
 
-      m_map[_key].push_back(PairType(_value,_priority));
-      stable_sort(m_map[_key].begin(), m_map[_key].end(), PrioritySort());
+      i->second.push_back(PairType(_value,_priority));
+      stable_sort(i->second.begin(), i->second.end(), PrioritySort());
 
     }
 
@@ -0,0 +1,211 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "WorkingMemoryChangeQueue.hpp"
+
+namespace cast {
+
+  namespace {
+
+    //x86 does not reorder loads with loads or stores with stores, so
+    //acquire and release only need to stop the compiler reordering
+#if defined(__i386__) || defined(__x86_64__)
+    inline void acquireBarrier() {
+      __asm__ __volatile__("" ::: "memory");
+    }
+    inline void releaseBarrier() {
+      __asm__ __volatile__("" ::: "memory");
+    }
+#else
+    inline void acquireBarrier() {
+      __sync_synchronize();
+    }
+    inline void releaseBarrier() {
+      __sync_synchronize();
+    }
+#endif
+
+    inline unsigned long loadAcquire(const volatile unsigned long & _value) {
+      unsigned long value = _value;
+      acquireBarrier();
+      return value;
+    }
+
+    inline void storeRelease(volatile unsigned long & _target,
+			     const unsigned long & _value) {
+      releaseBarrier();
+      _target = _value;
+    }
+
+  }
+
+  const unsigned int WorkingMemoryChangeQueue::DEFAULT_CAPACITY;
+
+  WorkingMemoryChangeQueue::WorkingMemoryChangeQueue(const unsigned int & _capacity) :
+    m_mask(0),
+    m_tail(0),
+    m_head(0),
+    m_highWaterMark(0) {
+    setCapacity(_capacity);
+  }
+
+
+  void
+  WorkingMemoryChangeQueue::setCapacity(const unsigned int & _capacity) {
+    unsigned long capacity = 1;
+    while(capacity < _capacity) {
+      capacity <<= 1;
+    }
+
+    m_slots.assign(capacity, Slot());
+    for(unsigned long i = 0; i < capacity; ++i) {
+      m_slots[i].sequence = i;
+    }
+    m_mask = capacity - 1;
+    m_tail = 0;
+    m_head = 0;
+    m_highWaterMark = 0;
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::tryPush(const cdl::WorkingMemoryChange & _change,
+                                    unsigned long * _position) {
+
+    unsigned long position = m_tail;
+    Slot * slot;
+
+    //claim a position
+    while(true) {
+      slot = &m_slots[position & m_mask];
+      long difference = static_cast<long>(loadAcquire(slot->sequence) - position);
+      if(difference == 0) {
+	unsigned long current = __sync_val_compare_and_swap(&m_tail, position, position + 1);
+	if(current == position) {
+	  break;
+	}
+	position = current;
+      }
+      else if(difference < 0) {
+	//the consumer has not read this slot from the last lap yet
+	return false;
+      }
+      else {
+	position = m_tail;
+      }
+    }
+
+    slot->change = _change;
+    storeRelease(slot->sequence, position + 1);
+
+    if(_position) {
+      *_position = position;
+    }
+
+    unsigned int depth = position + 1 - m_head;
+    unsigned int highWaterMark = m_highWaterMark;
+    while(depth > highWaterMark) {
+      unsigned int current = __sync_val_compare_and_swap(&m_highWaterMark, highWaterMark, depth);
+      if(current == highWaterMark) {
+	break;
+      }
+      highWaterMark = current;
+    }
+
+    return true;
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::tryReplace(const unsigned long & _position,
+                                       const cdl::WorkingMemoryChange & _change) {
+    Slot & slot(m_slots[_position & m_mask]);
+    if(loadAcquire(slot.sequence) != _position + 1) {
+      return false;
+    }
+    slot.change = _change;
+    return true;
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::claimFront(unsigned long & _position) {
+
+    unsigned long position = m_head;
+
+    while(true) {
+      Slot & slot(m_slots[position & m_mask]);
+      long difference = static_cast<long>(loadAcquire(slot.sequence) - (position + 1));
+      if(difference == 0) {
+	//producers discarding from the front may race with the consumer
+	unsigned long current = __sync_val_compare_and_swap(&m_head, position, position + 1);
+	if(current == position) {
+	  _position = position;
+	  return true;
+	}
+	position = current;
+      }
+      else if(difference < 0) {
+	//empty, or the change at the front is still being written
+	return false;
+      }
+      else {
+	position = m_head;
+      }
+    }
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::tryPop(cdl::WorkingMemoryChange & _change) {
+    unsigned long position;
+    if(!claimFront(position)) {
+      return false;
+    }
+
+    Slot & slot(m_slots[position & m_mask]);
+    _change = slot.change;
+
+    //free the slot for the producer one lap ahead
+    storeRelease(slot.sequence, position + m_mask + 1);
+    return true;
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::tryDiscard() {
+    unsigned long position;
+    if(!claimFront(position)) {
+      return false;
+    }
+    storeRelease(m_slots[position & m_mask].sequence, position + m_mask + 1);
+    return true;
+  }
+
+
+  bool
+  WorkingMemoryChangeQueue::empty() const {
+    unsigned long position = m_head;
+    return loadAcquire(m_slots[position & m_mask].sequence) != position + 1;
+  }
+
+} //namespace cast
@@ -0,0 +1,235 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_WORKING_MEMORY_CHANGE_QUEUE_H_
+#define CAST_WORKING_MEMORY_CHANGE_QUEUE_H_
+
+#include <cast/slice/CDL.hpp>
+
+#include <IceUtil/Monitor.h>
+#include <IceUtil/Mutex.h>
+#include <IceUtil/Time.h>
+
+#include <vector>
+
+namespace cast {
+
+  /**
+   * Lets threads sleep until another thread signals them, without the
+   * signalling thread taking a lock unless a thread is actually
+   * asleep. A waiting thread calls prepareWait, checks its condition
+   * again, and then either carries on or calls wait with the key
+   * prepareWait returned.
+   *
+   * @author nah
+   */
+  class EventCount {
+
+  public:
+
+    EventCount() :
+      m_state(0) {}
+
+    /**
+     * Announce an intention to wait.
+     */
+    unsigned int prepareWait() {
+      return __sync_fetch_and_or(&m_state, 1u) & ~1u;
+    }
+
+    /**
+     * Sleep until notifyAll is called after the matching prepareWait.
+     */
+    void wait(const unsigned int & _key) {
+      IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_monitor);
+      while((m_state & ~1u) == _key) {
+	m_monitor.wait();
+      }
+    }
+
+    /**
+     * As wait, but give up after _timeout.
+     *
+     * @return false if the wait timed out.
+     */
+    bool timedWait(const unsigned int & _key, const IceUtil::Time & _timeout) {
+      IceUtil::Time end(IceUtil::Time::now(IceUtil::Time::Monotonic) + _timeout);
+      IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_monitor);
+      while((m_state & ~1u) == _key) {
+	IceUtil::Time left(end - IceUtil::Time::now(IceUtil::Time::Monotonic));
+	if(left <= IceUtil::Time()) {
+	  return false;
+	}
+	m_monitor.timedWait(left);
+      }
+      return true;
+    }
+
+    /**
+     * Wake all threads that have prepared to wait. This is a barrier
+     * and a read when no thread is waiting.
+     */
+    void notifyAll() {
+      __sync_synchronize();
+      if(m_state & 1u) {
+	IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_monitor);
+	if(m_state & 1u) {
+	  //clears the waiting bit and moves on to the next epoch
+	  __sync_fetch_and_add(&m_state, 1u);
+	  m_monitor.notifyAll();
+	}
+      }
+    }
+
+  private:
+
+    ///epoch in the upper bits, whether anyone is waiting in the lowest
+    volatile unsigned int m_state;
+
+    IceUtil::Monitor<IceUtil::Mutex> m_monitor;
+
+  };
+
+
+  /**
+   * Bounded queue of change events which any number of threads may
+   * add to without locking, and a single thread removes from. Adding
+   * threads may also discard from the front to make room. Slots are
+   * allocated up front and reused, so in the steady state adding a
+   * change copies into existing strings rather than allocating.
+   *
+   * @author nah
+   */
+  class WorkingMemoryChangeQueue {
+
+  public:
+
+    static const unsigned int DEFAULT_CAPACITY = 4096;
+
+    /**
+     * @param _capacity Rounded up to a power of two.
+     */
+    WorkingMemoryChangeQueue(const unsigned int & _capacity = DEFAULT_CAPACITY);
+
+    /**
+     * Change the capacity, discarding anything queued. Must not be
+     * called while other threads are using the queue.
+     */
+    void setCapacity(const unsigned int & _capacity);
+
+    unsigned int capacity() const {
+      return m_slots.size();
+    }
+
+    /**
+     * Add a change to the back of the queue. May be called from any
+     * thread.
+     *
+     * @param _position If not null, set to the position the change
+     * was added at.
+     * @return false if the queue is full.
+     */
+    bool tryPush(const cdl::WorkingMemoryChange & _change,
+		 unsigned long * _position = 0);
+
+    /**
+     * Replace the change added at _position, if it has not been
+     * removed yet. The caller must make sure the change is not
+     * removed by another thread while it is being replaced.
+     *
+     * @return false if the change has been removed.
+     */
+    bool tryReplace(const unsigned long & _position,
+		    const cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Copy the change at the front of the queue into _change and
+     * remove it. Must only be called from the consuming thread.
+     *
+     * @return false if there is no change ready.
+     */
+    bool tryPop(cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Remove the change at the front of the queue without reading
+     * it. May be called from any thread.
+     *
+     * @return false if there is no change ready.
+     */
+    bool tryDiscard();
+
+    /**
+     * Whether there is a change ready at the front of the queue. Must
+     * only be called from the consuming thread.
+     */
+    bool empty() const;
+
+    /**
+     * The number of changes queued. Only approximate while other
+     * threads are using the queue.
+     */
+    unsigned int depth() const {
+      return m_tail - m_head;
+    }
+
+    /**
+     * The largest depth seen by tryPush.
+     */
+    unsigned int highWaterMark() const {
+      return m_highWaterMark;
+    }
+
+  private:
+
+    /**
+     * Take the position at the front of the queue if the change there
+     * is ready.
+     */
+    bool claimFront(unsigned long & _position);
+
+    struct Slot {
+      Slot() :
+	sequence(0) {}
+      ///the position this slot can next be written (== position) or read (== position + 1) at
+      volatile unsigned long sequence;
+      cdl::WorkingMemoryChange change;
+    };
+
+    std::vector<Slot> m_slots;
+    unsigned long m_mask;
+
+    ///next position to write, shared by producers
+    volatile unsigned long m_tail;
+
+    //keep the consumer's position on a separate cache line
+    char m_padding[64];
+
+    ///next position to read, or to discard from
+    volatile unsigned long m_head;
+
+    volatile unsigned int m_highWaterMark;
+
+  };
+
+} //namespace cast
+
+#endif
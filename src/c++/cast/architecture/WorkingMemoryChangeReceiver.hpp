@@ -31,14 +31,33 @@ namespace cast {
 
 
   public:
-    WorkingMemoryChangeReceiver() : m_deleteOnRemoval(false) {};
+    WorkingMemoryChangeReceiver() : m_deleteOnRemoval(false), m_concurrent(false), m_coalesceOverwrites(false) {};
     virtual ~WorkingMemoryChangeReceiver() {};
     virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) = 0;
     void deleteOnRemoval() const {m_deleteOnRemoval = true;};
     bool isDeletedOnRemoval() const {return m_deleteOnRemoval;};
 
+    /**
+     * Mark this receiver as safe to call without the component lock,
+     * at the same time as other receivers of the component. This only
+     * has an effect when the component uses a dispatch pool
+     * (--dispatch-threads).
+     */
+    void runConcurrently() const {m_concurrent = true;};
+    bool isRunConcurrently() const {return m_concurrent;};
+
+    /**
+     * Skip an overwrite event if a later overwrite of the same entry
+     * that this receiver also matches is already queued. Set by
+     * WorkingMemoryReaderComponent::addChangeFilter.
+     */
+    void coalesceOverwrites() const {m_coalesceOverwrites = true;};
+    bool isCoalescingOverwrites() const {return m_coalesceOverwrites;};
+
   private:
     mutable bool m_deleteOnRemoval;
+    mutable bool m_concurrent;
+    mutable bool m_coalesceOverwrites;
   };
 
 
@@ -0,0 +1,147 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "WorkingMemoryEntryCache.hpp"
+
+#include <boost/thread/locks.hpp>
+
+#include <cassert>
+
+using namespace std;
+
+namespace cast {
+
+  WorkingMemoryEntryCache::WorkingMemoryEntryCache(const size_t & _budget) :
+    m_budget(_budget),
+    m_size(0),
+    m_generation(0),
+    m_hits(0),
+    m_misses(0) {
+  }
+
+
+  cdl::WorkingMemoryEntryPtr
+  WorkingMemoryEntryCache::get(const cdl::WorkingMemoryAddress & _wma) {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    EntryMap::iterator i = m_entries.find(_wma);
+    if(i == m_entries.end()) {
+      ++m_misses;
+      return 0;
+    }
+    ++m_hits;
+    m_uses.splice(m_uses.begin(), m_uses, i->second.use);
+    return i->second.entry;
+  }
+
+
+  unsigned long
+  WorkingMemoryEntryCache::getGeneration() const {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    return m_generation;
+  }
+
+
+  void
+  WorkingMemoryEntryCache::put(const cdl::WorkingMemoryAddress & _wma,
+			       const cdl::WorkingMemoryEntryPtr & _entry,
+			       const size_t & _bytes,
+			       const unsigned long & _generation) {
+    if(_bytes > m_budget) {
+      return;
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_access);
+
+    //a change seen during the read may be to this entry
+    if(_generation != m_generation) {
+      return;
+    }
+
+    EntryMap::iterator existing = m_entries.find(_wma);
+    if(existing != m_entries.end()) {
+      erase(existing);
+    }
+
+    while(m_size + _bytes > m_budget) {
+      erase(m_entries.find(m_uses.back()));
+    }
+
+    m_uses.push_front(_wma);
+    CachedEntry & cached(m_entries[_wma]);
+    cached.entry = _entry;
+    cached.bytes = _bytes;
+    cached.use = m_uses.begin();
+    m_size += _bytes;
+  }
+
+
+  void
+  WorkingMemoryEntryCache::invalidate(const cdl::WorkingMemoryAddress & _wma) {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    ++m_generation;
+    EntryMap::iterator i = m_entries.find(_wma);
+    if(i != m_entries.end()) {
+      erase(i);
+    }
+  }
+
+
+  void
+  WorkingMemoryEntryCache::clear() {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    ++m_generation;
+    m_entries.clear();
+    m_uses.clear();
+    m_size = 0;
+  }
+
+
+  unsigned long
+  WorkingMemoryEntryCache::getHits() const {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    return m_hits;
+  }
+
+
+  unsigned long
+  WorkingMemoryEntryCache::getMisses() const {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    return m_misses;
+  }
+
+
+  size_t
+  WorkingMemoryEntryCache::getSize() const {
+    boost::lock_guard<boost::mutex> lock(m_access);
+    return m_size;
+  }
+
+
+  void
+  WorkingMemoryEntryCache::erase(EntryMap::iterator _entry) {
+    assert(_entry != m_entries.end());
+    m_size -= _entry->second.bytes;
+    m_uses.erase(_entry->second.use);
+    m_entries.erase(_entry);
+  }
+
+} //namespace cast
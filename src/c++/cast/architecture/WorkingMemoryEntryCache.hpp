@@ -0,0 +1,132 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_WORKING_MEMORY_ENTRY_CACHE_H_
+#define CAST_WORKING_MEMORY_ENTRY_CACHE_H_
+
+#include <cast/slice/CDL.hpp>
+
+#include <boost/thread/mutex.hpp>
+
+#include <list>
+#include <map>
+
+namespace cast {
+
+  /**
+   * Entries a component has read from working memory, keyed by
+   * address, so an entry which has not changed since it was last read
+   * can be returned without fetching it from working memory again. Entries are
+   * dropped when a change to them is seen, and the least recently used
+   * ones are dropped when the cache holds more than its budget of
+   * marshalled bytes. Cached entries are never modified, so they must
+   * be copied before being handed out as mutable. Thread safe.
+   */
+  class WorkingMemoryEntryCache {
+
+  public:
+
+    /**
+     * @param _budget The most marshalled bytes to hold.
+     */
+    WorkingMemoryEntryCache(const size_t & _budget);
+
+    /**
+     * Get a cached entry, counting a hit or a miss.
+     *
+     * @return The entry, or null if it is not cached.
+     */
+    cdl::WorkingMemoryEntryPtr get(const cdl::WorkingMemoryAddress & _wma);
+
+    /**
+     * The number of invalidations so far. Take this before reading an
+     * entry from working memory and pass it to put, so that an entry
+     * which may have changed during the read is not cached.
+     */
+    unsigned long getGeneration() const;
+
+    /**
+     * Cache an entry read from working memory, unless anything was
+     * invalidated since _generation or the entry is larger than the
+     * whole budget.
+     *
+     * @param _wma The address the entry was read from.
+     * @param _entry The entry as read, which must not be modified
+     * after this.
+     * @param _bytes The marshalled size of the entry.
+     * @param _generation The value of getGeneration before the read.
+     */
+    void put(const cdl::WorkingMemoryAddress & _wma,
+	     const cdl::WorkingMemoryEntryPtr & _entry,
+	     const size_t & _bytes,
+	     const unsigned long & _generation);
+
+    /**
+     * Drop the entry at an address, if it is cached.
+     */
+    void invalidate(const cdl::WorkingMemoryAddress & _wma);
+
+    /**
+     * Drop all entries.
+     */
+    void clear();
+
+    unsigned long getHits() const;
+    unsigned long getMisses() const;
+
+    /**
+     * The marshalled bytes currently held.
+     */
+    size_t getSize() const;
+
+  private:
+
+    ///addresses, most recently used first
+    typedef std::list<cdl::WorkingMemoryAddress> UseList;
+
+    struct CachedEntry {
+      cdl::WorkingMemoryEntryPtr entry;
+      size_t bytes;
+      UseList::iterator use;
+    };
+
+    typedef std::map<cdl::WorkingMemoryAddress, CachedEntry> EntryMap;
+
+    /**
+     * Drop an entry. Caller must hold m_access.
+     */
+    void erase(EntryMap::iterator _entry);
+
+    EntryMap m_entries;
+    UseList m_uses;
+    size_t m_budget;
+    size_t m_size;
+    unsigned long m_generation;
+    unsigned long m_hits;
+    unsigned long m_misses;
+    mutable boost::mutex m_access;
+
+  };
+
+} //namespace cast
+
+#endif
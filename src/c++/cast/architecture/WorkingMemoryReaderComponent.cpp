@@ -22,7 +22,13 @@
 
 #include "WorkingMemoryReaderComponent.hpp"
 
+#include <cast/architecture/ChangeFilterFactory.hpp>
+#include <cast/core/SymbolTable.hpp>
+
 #include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
 
 using namespace std;
 using namespace boost;
@@ -34,6 +40,15 @@ namespace cast {
   using namespace cdl;
 
   WorkingMemoryChangeThread::WorkingMemoryChangeThread(WorkingMemoryReaderComponent * _pWMRP) :
+    m_coalescedChanges(0),
+    m_overflowPolicy(BLOCK),
+    m_processedChanges(0),
+    m_droppedChanges(0),
+    m_overflowing(0),
+    m_reportedProcessed(0),
+    m_reportedDropped(0),
+    m_reportedOverflow(false),
+    m_progressInterval(Time::milliSeconds(1000)),
     m_bRun(false),
     m_pWMRP(_pWMRP) {
     
@@ -48,107 +63,225 @@ namespace cast {
  
   void WorkingMemoryChangeThread::run() {
     m_bRun = true;
+    m_lastReport = Time::now(Time::Monotonic);
 
     //m_pWMRP->println("running change thread");
 
-    if(cdl::DISCARD == m_pWMRP->m_queueBehaviour) {
+    if(m_pWMRP->m_dispatchPool) {
+      runDispatch();
+    }
+    else if(cdl::DISCARD == m_pWMRP->m_queueBehaviour) {
       runDiscard();
     }
     else if(cdl::QUEUE == m_pWMRP->m_queueBehaviour) {
       runQueue();
     }
+
+    if(isProgressUnreported()) {
+      reportProgress();
+    }
   }
   
 
-  //TODO locking needs a massive reworking and probably simplification
+  void WorkingMemoryChangeThread::waitForChanges() {
+    while(m_bRun && m_changeQueue.empty()) {
+      unsigned int key = m_changesQueued.prepareWait();
+      //check again now the producers know to wake us
+      if(!m_bRun || !m_changeQueue.empty()) {
+	return;
+      }
+      if(!isProgressUnreported()) {
+	m_changesQueued.wait(key);
+      }
+      //tell the working memory the queue has been emptied once the
+      //interval is up
+      else if(!m_changesQueued.timedWait(key, m_lastReport + m_progressInterval - 
+					 Time::now(Time::Monotonic))) {
+	reportProgress();
+      }
+    }
+  }
+
+
+  bool WorkingMemoryChangeThread::isProgressUnreported() const {
+    return m_progressInterval > Time() &&
+      (m_processedChanges != m_reportedProcessed || 
+       m_droppedChanges != m_reportedDropped ||
+       m_overflowing != 0);
+  }
+
+
+  void WorkingMemoryChangeThread::changesProcessed(const unsigned int & _count) {
+    m_processedChanges += _count;
+
+    if(m_progressInterval == Time()) {
+      return;
+    }
+
+    //a new overflow is reported straight away
+    if((m_overflowing != 0 && !m_reportedOverflow) ||
+       Time::now(Time::Monotonic) - m_lastReport >= m_progressInterval) {
+      reportProgress();
+    }
+  }
+
+
+  void WorkingMemoryChangeThread::reportProgress() {
+    bool overflowing = (__sync_lock_test_and_set(&m_overflowing, 0u) != 0);
+    unsigned long processed = m_processedChanges;
+    unsigned long dropped = m_droppedChanges;
+
+    m_pWMRP->reportChangeProgress(processed, dropped, overflowing);
+
+    m_reportedProcessed = processed;
+    m_reportedDropped = dropped;
+    m_reportedOverflow = overflowing;
+    m_lastReport = Time::now(Time::Monotonic);
+  }
+
+
   void WorkingMemoryChangeThread::runQueue() {
 
-    list<cdl::WorkingMemoryChange> changeList;
-    bool listEmpty = true;
     bool used = false;
 
     while(m_bRun) {
-    
-      m_queueAccess.lock();
-      listEmpty = m_changeList.empty();
-      m_queueAccess.unlock();
 
-      //m_pWMRP->println("list empty: %d",listEmpty);
+      waitForChanges();
 
-      while(!listEmpty) {
+      if(!m_bRun) {
+	break;
+      }
 
-	//      m_pWMRP->println("doing");
+      m_pWMRP->lockComponent();
 
+      //only forward what was there when we started, so a steady
+      //stream of changes doesn't keep the component locked
+      unsigned int pending = popPending();
+      bool coalescing = findNewerOverwrites(pending);
+      
+      //remove any outstanding change filters before forwarding
+      //changes
+      removeChangeFilters();
 
-	m_pWMRP->lockComponent();
+      used = false;
+      for(unsigned int i = 0; i < pending; ++i) {
+	const cdl::WorkingMemoryChange * newer = NULL;
+	if(coalescing && m_newer[i] >= 0) {
+	  newer = &m_pending[m_newer[i]];
+	}
+	used = forwardToSubclass(m_pending[i], newer) || used;
+      }
+      
+      //unlock this thread now something has been done
+      m_pWMRP->unlockComponent();
 
-	//      m_pWMRP->println("component locked");
+      //wake any senders waiting on a full queue
+      m_spaceFreed.notifyAll();
 
+      changesProcessed(pending);
 
-	m_queueAccess.lock();
+      //now signal any threads that may have been waiting for new
+      //changes
+      if(used) {
+	Monitor<IceUtil::Mutex>::Lock lock(m_pWMRP->m_wmcMonitor);      
+	m_pWMRP->m_wmcMonitor.notifyAll();
+      }
+    }
 
-	//      m_pWMRP->println("queue locked");
+  }
 
-	
-	while(!m_changeList.empty()) {
-	  //get last element
-	  changeList.push_front(m_changeList.back());
-	  //and remove it
-	  m_changeList.pop_back();
-	}	
-      
-	assert(m_changeList.size() == 0); //"error: emptied change list is not empty!");
-       
-	
-	m_queueAccess.unlock();
 
-	
-	//remove any outstanding change filters before forwarding
-	//changes
-	removeChangeFilters();
-	
-	//then write to derived class
-	used = forwardToSubclass(changeList);
-	assert(changeList.size() == 0);
-	
+  unsigned int WorkingMemoryChangeThread::popPending() {
+    unsigned int pending = m_changeQueue.depth();
+    if(m_pending.size() < pending) {
+      m_pending.resize(pending);
+    }
+    unsigned int count = 0;
+    while(count < pending && popChange(m_pending[count])) {
+      ++count;
+    }
+    return count;
+  }
 
-	//unlock this thread now something has been done
-	m_pWMRP->unlockComponent();
 
-	//now signal any threads that may have been waiting for new
-	//changes
-	if(used) {
-	  Monitor<IceUtil::Mutex>::Lock lock(m_pWMRP->m_wmcMonitor);      
-	  m_pWMRP->m_wmcMonitor.notifyAll();
+  namespace {
+    struct AddressLess {
+      bool operator()(const cdl::WorkingMemoryAddress * _a, 
+		      const cdl::WorkingMemoryAddress * _b) const {
+	int id = _a->id.compare(_b->id);
+	if(id != 0) {
+	  return id < 0;
 	}
-	//cout<<m_pWMRP->getComponentIdentifier()<<": "<<" RUN DONE "<<endl;
+	return _a->subarchitecture < _b->subarchitecture;
+      }
+    };
+  }
 
 
-	m_queueAccess.lock();
-	listEmpty = m_changeList.empty();
-	m_queueAccess.unlock();
+  bool WorkingMemoryChangeThread::findNewerOverwrites(const unsigned int & _count) {
 
-      }
-        
-      //make sure someone else gets a turn...
-      //yield(); -- doesn't work!
+    if(!m_pWMRP->m_coalescing) {
+      return false;
+    }
+
+    m_newer.assign(_count, -1);
 
+    //from the newest back, the last overwrite of each entry seen since
+    //its last add or delete
+    map<const cdl::WorkingMemoryAddress *, int, AddressLess> next;
 
-      {//in a block to ensure proper lock/unlock
-	Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
-	//	m_pWMRP->println("queue waiting");	
-	m_changeMonitor.wait();	      
+    for(int i = static_cast<int>(_count) - 1; i >= 0; --i) {
+      const cdl::WorkingMemoryChange & wmc(m_pending[i]);
+      if(wmc.operation == cdl::OVERWRITE) {
+	pair<map<const cdl::WorkingMemoryAddress *, int, AddressLess>::iterator, bool> 
+	  inserted(next.insert(make_pair(&wmc.address, i)));
+	if(!inserted.second) {
+	  m_newer[i] = inserted.first->second;
+	  inserted.first->second = i;
+	}
+      }
+      else if(wmc.operation == cdl::ADD || wmc.operation == cdl::DELETE) {
+	//overwrites must not be moved across these
+	next.erase(&wmc.address);
       }
-      
-      //      m_pWMRP->println("queue awake");
-    
     }
 
+    return true;
+  }
+
+
+  void 
+  WorkingMemoryChangeThread::removeCoalesced(vector<WorkingMemoryChangeReceiver *> & _receivers,
+					     const cdl::WorkingMemoryChange * _newer) {
+    if(_newer == NULL) {
+      return;
+    }
+
+    bool gotNewer = false;
+    vector<WorkingMemoryChangeReceiver *>::iterator kept = _receivers.begin();
+    for(vector<WorkingMemoryChangeReceiver *>::iterator i = _receivers.begin();
+	i < _receivers.end(); ++i) {
+      if(*i != NULL && (*i)->isCoalescingOverwrites()) {
+	if(!gotNewer) {
+	  m_pWMRP->m_pChangeObjects->get(*_newer, m_newerReceivers);
+	  gotNewer = true;
+	}
+	//only skip if the receiver will see the newer overwrite
+	if(find(m_newerReceivers.begin(), m_newerReceivers.end(), *i) != m_newerReceivers.end()) {
+	  ++m_coalescedChanges;
+	  continue;
+	}
+      }
+      *kept++ = *i;
+    }
+    _receivers.erase(kept, _receivers.end());
+    m_newerReceivers.clear();
   }
 
 
   bool 
-  WorkingMemoryChangeThread::forwardToSubclass(std::list<cdl::WorkingMemoryChange> & _wmcl) {
+  WorkingMemoryChangeThread::forwardToSubclass(const cdl::WorkingMemoryChange & _wmc,
+					       const cdl::WorkingMemoryChange * _newer) {
   
     bool used  = false;
     
@@ -157,219 +290,281 @@ namespace cast {
       //remove any previously flagged filters
       removeChangeFilters();
 
-      //for(unsigned int i = 0; i < _wmcl.length(); i++) {
-      while(!_wmcl.empty()) {
-	      
-
-	// 	WorkingMemoryChangeFilterMap::const_iterator receiverList
-	// 	  = m_pWMRP->m_pChangeObjects->get(_wmcl[i]);
-	m_pWMRP->m_pChangeObjects->get(_wmcl.back(), m_receivers);
+      m_pWMRP->m_pChangeObjects->get(_wmc, m_receivers);
 	
-	if(m_pWMRP->m_bDebugOutput) {
-	  ostringstream outStream;
-	  outStream<<"change: "<<_wmcl.back()<<" , receivers: "<< m_receivers.size();
-	  m_pWMRP->debug(outStream.str());
-	}
+      if(m_pWMRP->m_bDebugOutput) {
+	ostringstream outStream;
+	outStream<<"change: "<<_wmc<<" , receivers: "<< m_receivers.size();
+	m_pWMRP->debug(outStream.str());
+      }
 
-	if(!m_receivers.empty()) {
+      if(!m_receivers.empty()) {
 
-	  //m_pWMRP->printfln("receiver list length = %i",receiverList->second.size());
+	//m_pWMRP->printfln("receiver list length = %i",receiverList->second.size());
 	  
-	  m_pWMRP->logSubscribedChange(_wmcl.back());
+	m_pWMRP->logSubscribedChange(_wmc);
 
+	removeCoalesced(m_receivers, _newer);
     
-	  WorkingMemoryChangeReceiver * pReceiver = NULL;
+	WorkingMemoryChangeReceiver * pReceiver = NULL;
 
-	  for(vector<WorkingMemoryChangeReceiver *>::iterator j = m_receivers.begin();
-	      j < m_receivers.end();
-	      j++) {
+	for(vector<WorkingMemoryChangeReceiver *>::iterator j = m_receivers.begin();
+	    j < m_receivers.end();
+	    j++) {
 
-	    pReceiver = *j;
+	  pReceiver = *j;
 
-	    //m_pWMRP->println("pReceiver got");
+	  //m_pWMRP->println("pReceiver got");
 
-	    //if the filter matches
-	    if(NULL != pReceiver) {
-	    
-	      try {
-		//m_pWMRP->println("calling change");
-	  
-		pReceiver->workingMemoryChanged(_wmcl.back());
-		used = true;
-		//m_pWMRP->println("done");
-	      }
-	      catch(const WMException &e) {
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("WorkingMemoryChangeThread::forwardToSubclass WMException caught");
-		m_pWMRP->error("The type of change event involved in this error was: " + string(_wmcl.back().type) );	  		
-		m_pWMRP->error("The changed address involved in this error was: " + 
-				 string(_wmcl.back().address.id) + " in " + 
-				 string(_wmcl.back().address.subarchitecture));	  		
-		m_pWMRP->error("what(): %s", e.what());
-		m_pWMRP->error("message: %s", e.message.c_str());
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		std::abort();
-	      }
-	      catch(const CASTException &e) {
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		m_pWMRP->error("WorkingMemoryChangeThread::forwardToSubclass CASTException caught");
-		m_pWMRP->error("The type of change event involved in this error was: " + string(_wmcl.back().type) );	  		
-		m_pWMRP->error("The changed address involved in this error was: " + 
-				 string(_wmcl.back().address.id) + " in " + 
-				 string(_wmcl.back().address.subarchitecture));	  		
-		m_pWMRP->error("what(): %s", e.what());
-		m_pWMRP->error("message: %s", e.message.c_str());
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		std::abort();
-	      }
-	      catch(const std::exception &e) {
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		m_pWMRP->error("WorkingMemoryChangeThread::forwardToSubclass std::exception caught");
-		m_pWMRP->error("The type of change event involved in this error was: " + string(_wmcl.back().type) );	  		
-		m_pWMRP->error("The changed address involved in this error was: " + 
-				 string(_wmcl.back().address.id) + " in " + 
-				 string(_wmcl.back().address.subarchitecture));	  		
-		m_pWMRP->error("what(): %s", e.what());
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		std::abort();
-	      }
-	      catch(...) {
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		m_pWMRP->error("WorkingMemoryChangeThread::forwardToSubclass unknown exception caught");
-		m_pWMRP->error("The type of change event involved in this error was: " + string(_wmcl.back().type) );	  		
-		m_pWMRP->error("The changed address involved in this error was: " + 
-				 string(_wmcl.back().address.id) + " in " + 
-				 string(_wmcl.back().address.subarchitecture));	  		
-		m_pWMRP->error("***************************************************************");
-		m_pWMRP->error("***************************************************************");
-
-		std::abort();
-	      }
-
-	    }
-	    else {
-	      //this is ok now
-	      //ostringstream ostr;	
-	      //ostr<<"Missing change object for filtered change: "
-	      //    <<m_tmpFilter.m_type<<m_tmpFilter.m_operation<<endl;
-	      //throw BALTException(__HERE__, ostr.str().c_str());
-	    }
+	  //if the filter matches
+	  if(NULL != pReceiver) {
+	    m_pWMRP->forwardToReceiver(pReceiver, _wmc);
+	    used = true;
+	  }
+	  else {
+	    //this is ok now
+	    //ostringstream ostr;	
+	    //ostr<<"Missing change object for filtered change: "
+	    //    <<m_tmpFilter.m_type<<m_tmpFilter.m_operation<<endl;
+	    //throw BALTException(__HERE__, ostr.str().c_str());
 	  }
-
-	  m_receivers.clear(); 
-
-	}
-	else {
-	  m_pWMRP->logUnsubscribedChange(_wmcl.back());		  
 	}
-	
-	//processing  done for that change
-	_wmcl.pop_back();
 
+	m_receivers.clear(); 
 
-	//remove any outstanding change filters before forwarding
-	//changes
-	removeChangeFilters();
-	
       }
+      else {
+	m_pWMRP->logUnsubscribedChange(_wmc);		  
+      }
+	
+      //remove any outstanding change filters before forwarding
+      //changes
+      removeChangeFilters();
     
     }
 
     return used;
   }
 
+  void 
+  WorkingMemoryReaderComponent::forwardToReceiver(WorkingMemoryChangeReceiver * _receiver, 
+						  const cdl::WorkingMemoryChange & _wmc) {
+    try {
+      _receiver->workingMemoryChanged(_wmc);
+    }
+    catch(const WMException &e) {
+      error("***************************************************************");
+      error("***************************************************************");
+      error("WorkingMemoryReaderComponent::forwardToReceiver WMException caught");
+      error("The type of change event involved in this error was: " + string(_wmc.type) );	  		
+      error("The changed address involved in this error was: " + 
+		       string(_wmc.address.id) + " in " + 
+		       string(_wmc.address.subarchitecture));	  		
+      error("what(): %s", e.what());
+      error("message: %s", e.message.c_str());
+      error("***************************************************************");
+      error("***************************************************************");
+
+      std::abort();
+    }
+    catch(const CASTException &e) {
+      error("***************************************************************");
+      error("***************************************************************");
+
+      error("WorkingMemoryReaderComponent::forwardToReceiver CASTException caught");
+      error("The type of change event involved in this error was: " + string(_wmc.type) );	  		
+      error("The changed address involved in this error was: " + 
+		       string(_wmc.address.id) + " in " + 
+		       string(_wmc.address.subarchitecture));	  		
+      error("what(): %s", e.what());
+      error("message: %s", e.message.c_str());
+      error("***************************************************************");
+      error("***************************************************************");
+
+      std::abort();
+    }
+    catch(const std::exception &e) {
+      error("***************************************************************");
+      error("***************************************************************");
+
+      error("WorkingMemoryReaderComponent::forwardToReceiver std::exception caught");
+      error("The type of change event involved in this error was: " + string(_wmc.type) );	  		
+      error("The changed address involved in this error was: " + 
+		       string(_wmc.address.id) + " in " + 
+		       string(_wmc.address.subarchitecture));	  		
+      error("what(): %s", e.what());
+      error("***************************************************************");
+      error("***************************************************************");
+
+      std::abort();
+    }
+    catch(...) {
+      error("***************************************************************");
+      error("***************************************************************");
+
+      error("WorkingMemoryReaderComponent::forwardToReceiver unknown exception caught");
+      error("The type of change event involved in this error was: " + string(_wmc.type) );	  		
+      error("The changed address involved in this error was: " + 
+		       string(_wmc.address.id) + " in " + 
+		       string(_wmc.address.subarchitecture));	  		
+      error("***************************************************************");
+      error("***************************************************************");
+
+      std::abort();
+    }
+
+  }
+
+
   void WorkingMemoryChangeThread::removeChangeFilters() const {
 
-    if(!m_pWMRP->m_receiversToRemove.empty()) {
-//           m_pWMRP->error("receivers to remove: %s", m_pWMRP->m_receiversToRemove.size());
-// 	  m_pWMRP->error("receivers: %s", m_pWMRP->m_pChangeObjects->size());
-    
-      //remove any receivers as requested during event componenting
-      for(vector<const WorkingMemoryChangeReceiver *>::iterator i = m_pWMRP->m_receiversToRemove.begin();
-	  i < m_pWMRP->m_receiversToRemove.end();
-	  ++i) {
-	m_pWMRP->removeChangeFilterHelper(*i);	
+    vector<const WorkingMemoryChangeReceiver *> receiversToRemove;
+    {
+      IceUtil::Mutex::Lock lock(m_pWMRP->m_receiversToRemoveAccess);
+      if(m_pWMRP->m_receiversToRemove.empty()) {
+	return;
       }
-      m_pWMRP->m_receiversToRemove.clear();
-
-//           m_pWMRP->error("after receivers to remove: %s", m_pWMRP->m_receiversToRemove.size());
-// 	  m_pWMRP->error("after receivers: %s", m_pWMRP->m_pChangeObjects->size());
+      receiversToRemove.swap(m_pWMRP->m_receiversToRemove);
+    }
 
+    //remove any receivers as requested during event componenting
+    for(vector<const WorkingMemoryChangeReceiver *>::iterator i = receiversToRemove.begin();
+	i < receiversToRemove.end();
+	++i) {
+      m_pWMRP->removeChangeFilterHelper(*i);	
     }
   }
 
 
   void WorkingMemoryChangeThread::runDiscard() {
 
-    list<cdl::WorkingMemoryChange> changeList;
-    bool listEmpty = true;
     bool used = false;
 	
     while(m_bRun) {
     
-      m_queueAccess.lock();
-      listEmpty = m_changeList.empty();
-      m_queueAccess.unlock();
+      waitForChanges();
 
-      while(!listEmpty) {
+      if(!m_bRun) {
+	break;
+      }
 
-	m_pWMRP->lockComponent();
+      m_pWMRP->lockComponent();
 
+      //keep only the most recent change
+      unsigned int popped = 0;
+      while(popChange(m_change)) {
+	++popped;
+      }
+
+      m_spaceFreed.notifyAll();
 
-	m_queueAccess.lock();
+      if(popped == 0) {
+	m_pWMRP->unlockComponent();
+	continue;
+      }
 	
-	if(m_changeList.size() > 1 && m_pWMRP->m_bDebugOutput) {
-	  ostringstream outStream;
-	  outStream<<"discarding "<<m_changeList.size() - 1<<" change events ";
-	  m_pWMRP->debug(outStream.str());
-	}
+      if(popped > 1 && m_pWMRP->m_bDebugOutput) {
+	ostringstream outStream;
+	outStream<<"discarding "<<popped - 1<<" change events ";
+	m_pWMRP->debug(outStream.str());
+      }
 
-	changeList.push_front(m_changeList.front());
+      //remove any outstanding change filters before forwarding
+      //changes
+      removeChangeFilters();
 	
-	m_changeList.clear();
-	m_queueAccess.unlock();
+      //then write to derived class
+      used = forwardToSubclass(m_change);
 	
+      m_pWMRP->unlockComponent();
 
-	//remove any outstanding change filters before forwarding
-	//changes
-	removeChangeFilters();
-	
-	//then write to derived class
-	used = forwardToSubclass(changeList);
-	assert(changeList.size() == 0);
+      changesProcessed(popped);
+
+      //now signal any threads that may have been waiting for new
+      //changes
+      if(used) {
+	Monitor<IceUtil::Mutex>::Lock lock(m_pWMRP->m_wmcMonitor);      
+	m_pWMRP->m_wmcMonitor.notifyAll();
+      }
+    }
+
+  }
+  
+  
+
+  void WorkingMemoryChangeThread::runDispatch() {
+
+    ChangeDispatchPool & pool(*m_pWMRP->m_dispatchPool);
 	
+    while(m_bRun) {
+    
+      waitForChanges();
+
+      if(!m_bRun) {
+	break;
+      }
+
+      //the pool must not be holding changes for receivers that are
+      //about to be removed (and maybe deleted)
+      bool removing = false;
+      {
+	IceUtil::Mutex::Lock lock(m_pWMRP->m_receiversToRemoveAccess);
+	removing = !m_pWMRP->m_receiversToRemove.empty();
+      }
+      if(removing) {
+	pool.drain();
+	m_pWMRP->lockComponent();
+	removeChangeFilters();
 	m_pWMRP->unlockComponent();
+      }
 
-	//now signal any threads that may have been waiting for new
-	//changes
-	if(used) {
-	  Monitor<IceUtil::Mutex>::Lock lock(m_pWMRP->m_wmcMonitor);      
-	  m_pWMRP->m_wmcMonitor.notifyAll();
+      //leave changes in the bounded queue until the lanes have room,
+      //so a full queue still holds up senders and shows as lag
+      pool.waitForSpace(m_changeQueue.capacity());
+
+      //the lock protects the filters, receivers are called by the pool
+      m_pWMRP->lockComponent();
+
+      unsigned int pending = popPending();
+      bool coalescing = findNewerOverwrites(pending);
+
+      for(unsigned int i = 0; i < pending; ++i) {
+
+	if(!m_pWMRP->m_pChangeObjects) {
+	  continue;
 	}
-	
-	m_queueAccess.lock();
-	listEmpty = m_changeList.empty();
-	m_queueAccess.unlock();
 
+	const cdl::WorkingMemoryChange & wmc(m_pending[i]);
+
+	m_pWMRP->m_pChangeObjects->get(wmc, m_receivers);
+
+	if(m_pWMRP->m_bDebugOutput) {
+	  ostringstream outStream;
+	  outStream<<"change: "<<wmc<<" , receivers: "<< m_receivers.size();
+	  m_pWMRP->debug(outStream.str());
+	}
+
+	if(!m_receivers.empty()) {
+	  m_pWMRP->logSubscribedChange(wmc);
+	  if(coalescing && m_newer[i] >= 0) {
+	    removeCoalesced(m_receivers, &m_pending[m_newer[i]]);
+	  }
+	  if(!m_receivers.empty()) {
+	    pool.dispatch(wmc, m_receivers);
+	  }
+	  m_receivers.clear();
+	}
+	else {
+	  m_pWMRP->logUnsubscribedChange(wmc);		  
+	}
       }
-    
-      {//in a block to ensure proper lock/unlock
-	Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
-	m_changeMonitor.wait();
-      }
+
+      m_pWMRP->unlockComponent();
+
+      //wake any senders waiting on a full queue
+      m_spaceFreed.notifyAll();
+
+      changesProcessed(pending);
     }
 
   }
@@ -378,41 +573,153 @@ namespace cast {
 
   void WorkingMemoryChangeThread::stop() {
     m_bRun = false;
- 
-    m_queueAccess.lock();
-    m_changeList.clear();
-    m_queueAccess.unlock();
 
-   
-    {//in a block to ensure proper lock/unlock
-      Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
-      m_changeMonitor.notifyAll();
+    //anything still queued is dropped when the thread exits
+    m_changesQueued.notifyAll();
+    m_spaceFreed.notifyAll();
+  }
+
+
+  bool WorkingMemoryChangeThread::pushChange(const cdl::WorkingMemoryChange & _change) {
+    while(!tryPushChange(_change)) {
+      unsigned int key = m_spaceFreed.prepareWait();
+      if(!m_bRun) {
+	return false;
+      }
+      //check again now the consumer knows to wake us
+      if(tryPushChange(_change)) {
+	break;
+      }
+      //the consumer may be asleep waiting for the changes already
+      //pushed from this batch, which it will not hear about until
+      //the whole batch is queued
+      m_changesQueued.notifyAll();
+      m_spaceFreed.wait(key);
+    }
+    return true;
+  }
+
+
+  bool WorkingMemoryChangeThread::tryPushChange(const cdl::WorkingMemoryChange & _change) {
+
+    if(m_overflowPolicy == COALESCE) {
+      return tryPushCoalescing(_change);
+    }
+
+    if(m_changeQueue.tryPush(_change)) {
+      return true;
+    }
+
+    overflowed();
+
+    if(m_overflowPolicy == DROP_OLDEST) {
+      while(!m_changeQueue.tryPush(_change)) {
+	if(m_changeQueue.tryDiscard()) {
+	  __sync_fetch_and_add(&m_droppedChanges, 1ul);
+	}
+      }
+      return true;
+    }
+
+    return false;
+  }
+
+
+  bool WorkingMemoryChangeThread::tryPushCoalescing(const cdl::WorkingMemoryChange & _change) {
+
+    {
+      IceUtil::Mutex::Lock lock(m_queuedOverwritesAccess);
+
+      unsigned long position;
+      if(m_changeQueue.tryPush(_change, &position)) {
+	//only the last change of an entry may be replaced, so an
+	//earlier overwrite never stands in for a later one
+	map<QueuedOverwrite, unsigned long>::iterator i = 
+	  m_queuedOverwrites.lower_bound(QueuedOverwrite(_change.address, ""));
+	while(i != m_queuedOverwrites.end() && i->first.first == _change.address) {
+	  m_queuedOverwrites.erase(i++);
+	}
+	if(_change.operation == cdl::OVERWRITE) {
+	  m_queuedOverwrites[QueuedOverwrite(_change.address, _change.src)] = position;
+	}
+	return true;
+      }
+
+      //put this change in place of the queued overwrite, so
+      //receivers get the entry as it is now rather than as it was.
+      //The queued one is the change which is dropped
+      if(_change.operation == cdl::OVERWRITE) {
+	map<QueuedOverwrite, unsigned long>::const_iterator queued = 
+	  m_queuedOverwrites.find(QueuedOverwrite(_change.address, _change.src));
+	if(queued != m_queuedOverwrites.end() && 
+	   m_changeQueue.tryReplace(queued->second, _change)) {
+	  __sync_fetch_and_add(&m_droppedChanges, 1ul);
+	  overflowed();
+	  return true;
+	}
+      }
     }
 
+    overflowed();
+    return false;
   }
 
 
+  bool WorkingMemoryChangeThread::popChange(cdl::WorkingMemoryChange & _change) {
+
+    if(m_overflowPolicy != COALESCE) {
+      return m_changeQueue.tryPop(_change);
+    }
+
+    IceUtil::Mutex::Lock lock(m_queuedOverwritesAccess);
+    if(!m_changeQueue.tryPop(_change)) {
+      return false;
+    }
+    if(_change.operation == cdl::OVERWRITE) {
+      m_queuedOverwrites.erase(QueuedOverwrite(_change.address, _change.src));
+    }
+    return true;
+  }
+
+
+  void WorkingMemoryChangeThread::overflowed() {
+    //the change thread sends the report, as a sender may be the
+    //working memory itself
+    if(m_overflowing == 0) {
+      __sync_lock_test_and_set(&m_overflowing, 1u);
+    }
+  }
+
 
   void WorkingMemoryChangeThread::queueChange(const cdl::WorkingMemoryChange & _change) {
     if(m_bRun) {
-      
-      m_queueAccess.lock();
-      m_changeList.push_front(_change);
-      m_queueAccess.unlock();
-      
-      {//in a block to ensure proper lock/unlock
-	Monitor<IceUtil::Mutex>::Lock lock(m_changeMonitor);
-	m_changeMonitor.notify();
+      if(pushChange(_change)) {
+	m_changesQueued.notifyAll();
       }
-      
-      //m_pWMRP->println("queued change and notified");
+    }
+  }
+
+
+  void WorkingMemoryChangeThread::queueChanges(const cdl::WorkingMemoryChangeSeq & _changes) {
+    if(m_bRun && !_changes.empty()) {
+      for(cdl::WorkingMemoryChangeSeq::const_iterator i = _changes.begin();
+	  i < _changes.end(); ++i) {
+	if(!pushChange(*i)) {
+	  return;
+	}
+      }
+      m_changesQueued.notifyAll();
     }
   }
 
 
   WorkingMemoryReaderComponent::WorkingMemoryReaderComponent() 
     : m_pWMChangeThread(new WorkingMemoryChangeThread(this)),
-      m_queueBehaviour(cdl::QUEUE) {
+      m_dispatchThreads(0),
+      m_dispatchOrdering(ChangeDispatchPool::ORDER_BY_ADDRESS),
+      m_coalescing(false),
+      m_queueBehaviour(cdl::QUEUE),
+      m_copyOnRead(false) {
 
     setReceiveXarchChangeNotifications(false);
     receiveChanges();
@@ -424,10 +731,95 @@ namespace cast {
   }
 
 
+  void 
+  WorkingMemoryReaderComponent::configureInternal(const map<string,string> & _config) {
+
+    WorkingMemoryWriterComponent::configureInternal(_config);
+
+    map<string,string>::const_iterator key = _config.find("--change-queue-size");
+    if(key != _config.end()) {
+      int capacity = atoi(key->second.c_str());
+      if(capacity > 0) {
+	m_pWMChangeThread->setQueueCapacity(capacity);
+      }
+      else {
+	println("ignoring --change-queue-size: %s", key->second.c_str());
+      }
+    }
+
+    key = _config.find("--dispatch-threads");
+    if(key != _config.end()) {
+      int threads = atoi(key->second.c_str());
+      if(threads >= 0) {
+	m_dispatchThreads = threads;
+      }
+      else {
+	println("ignoring --dispatch-threads: %s", key->second.c_str());
+      }
+    }
+
+    key = _config.find("--dispatch-order");
+    if(key != _config.end()) {
+      if(key->second == "address") {
+	m_dispatchOrdering = ChangeDispatchPool::ORDER_BY_ADDRESS;
+      }
+      else if(key->second == "receiver") {
+	m_dispatchOrdering = ChangeDispatchPool::ORDER_BY_RECEIVER;
+      }
+      else {
+	println("ignoring --dispatch-order: %s", key->second.c_str());
+      }
+    }
+
+    key = _config.find("--change-queue-overflow");
+    if(key != _config.end()) {
+      if(key->second == "block") {
+	m_pWMChangeThread->setOverflowPolicy(WorkingMemoryChangeThread::BLOCK);
+      }
+      else if(key->second == "drop-oldest") {
+	m_pWMChangeThread->setOverflowPolicy(WorkingMemoryChangeThread::DROP_OLDEST);
+      }
+      else if(key->second == "coalesce") {
+	m_pWMChangeThread->setOverflowPolicy(WorkingMemoryChangeThread::COALESCE);
+      }
+      else {
+	println("ignoring --change-queue-overflow: %s", key->second.c_str());
+      }
+    }
+
+    key = _config.find("--progress-interval");
+    if(key != _config.end()) {
+      int interval = atoi(key->second.c_str());
+      if(interval >= 0) {
+	m_pWMChangeThread->setProgressInterval(Time::milliSeconds(interval));
+      }
+      else {
+	println("ignoring --progress-interval: %s", key->second.c_str());
+      }
+    }
+
+    key = _config.find("--read-cache");
+    if(key != _config.end()) {
+      long budget = atol(key->second.c_str());
+      if(budget > 0) {
+	m_entryCache = boost::shared_ptr<WorkingMemoryEntryCache>(new WorkingMemoryEntryCache(budget));
+      }
+      else {
+	println("ignoring --read-cache: %s", key->second.c_str());
+      }
+    }
+  }
+
+
   void WorkingMemoryReaderComponent::startInternal() {
     WorkingMemoryAttachedComponent::startInternal();
     debug("WorkingMemoryReaderComponent::startInternal()");
 
+    if(m_dispatchThreads > 0) {
+      m_dispatchPool = boost::shared_ptr<ChangeDispatchPool>(new ChangeDispatchPool(this, m_dispatchThreads, m_dispatchOrdering));
+      m_dispatchPool->start();
+    }
+
     if(m_pWMChangeThread) {
       m_pWMChangeThreadControl = m_pWMChangeThread->start();
     }
@@ -439,10 +831,32 @@ namespace cast {
 
   void WorkingMemoryReaderComponent::stopInternal() {
     
+    if(m_dispatchPool) {
+      //the component is locked while it stops, and a dispatch thread
+      //may be waiting for the lock, so let it in to see the pool has
+      //stopped. This is done first as the change thread may be
+      //waiting for the dispatch threads
+      unlockComponent();
+      m_dispatchPool->stop();
+      lockComponent();
+    }
+
     if(m_pWMChangeThread) {
       m_pWMChangeThread->stop();
       debug("joining change thread");
       m_pWMChangeThreadControl.join();
+      debug("change queue high-water mark: %d", getChangeQueueHighWaterMark());
+      if(getDroppedChangeCount() > 0) {
+	log("dropped %lu change events from a full queue", getDroppedChangeCount());
+      }
+      if(m_coalescing) {
+	debug("coalesced change events: %lu", getCoalescedChangeCount());
+      }
+    }
+
+    if(m_entryCache) {
+      debug("read cache hits: %lu, misses: %lu", getReadCacheHits(), 
+	    getReadCacheMisses());
     }
 
     {//done in a block so lock is released asap for subclass
@@ -472,10 +886,54 @@ namespace cast {
   void 
   WorkingMemoryReaderComponent::receiveChangeEvent(const cdl::WorkingMemoryChange& _wmc, 
 						   const Ice::Current & _ctx) {
+    //as early as possible, so reads do not return the old entry
+    if(m_entryCache && _wmc.operation != cdl::GET) {
+      m_entryCache->invalidate(_wmc.address);
+    }
+    noteVersion(_wmc.address, _wmc.version);
+
     if(isRunning() && m_bReceivingChanges) {
       //prefer to use change objects
       if(m_pChangeObjects) {
-	m_pWMChangeThread->queueChange(_wmc);      
+	if(TypeHierarchyCache::isCompact(_wmc)) {
+	  cdl::WorkingMemoryChange wmc(_wmc);
+	  m_typeHierarchies.expand(wmc, m_workingMemory);
+	  m_pWMChangeThread->queueChange(wmc);      
+	}
+	else {
+	  m_pWMChangeThread->queueChange(_wmc);      
+	}
+      }
+    }
+    
+  }
+
+  
+  void 
+  WorkingMemoryReaderComponent::receiveChangeEvents(const cdl::WorkingMemoryChangeSeq& _wmcs, 
+						    const Ice::Current & _ctx) {
+    for(cdl::WorkingMemoryChangeSeq::const_iterator i = _wmcs.begin();
+	i < _wmcs.end(); ++i) {
+      if(m_entryCache && i->operation != cdl::GET) {
+	m_entryCache->invalidate(i->address);
+      }
+      noteVersion(i->address, i->version);
+    }
+
+    if(isRunning() && m_bReceivingChanges) {
+      if(m_pChangeObjects) {
+	if(find_if(_wmcs.begin(), _wmcs.end(), 
+		   &TypeHierarchyCache::isCompact) != _wmcs.end()) {
+	  cdl::WorkingMemoryChangeSeq wmcs(_wmcs);
+	  for(cdl::WorkingMemoryChangeSeq::iterator i = wmcs.begin();
+	      i < wmcs.end(); ++i) {
+	    m_typeHierarchies.expand(*i, m_workingMemory);
+	  }
+	  m_pWMChangeThread->queueChanges(wmcs);      
+	}
+	else {
+	  m_pWMChangeThread->queueChanges(_wmcs);      
+	}
       }
     }
     
@@ -487,6 +945,9 @@ namespace cast {
 
   void WorkingMemoryReaderComponent::receiveNoChanges() {
     m_bReceivingChanges = false;
+    if(m_entryCache) {
+      m_entryCache->clear();
+    }
   }
 
   void WorkingMemoryReaderComponent::receiveChanges() {
@@ -499,7 +960,8 @@ namespace cast {
   void 
   WorkingMemoryReaderComponent::addChangeFilter(const WorkingMemoryChangeFilter & _filter, 
 						WorkingMemoryChangeReceiver * _pReceiver,
-						const int & _priority) {
+						const int & _priority,
+						const ChangeReceiverQueueing & _queueing) {
 
 
      assert(_pReceiver != NULL);
@@ -532,6 +994,11 @@ namespace cast {
     }
 
 
+    if(_queueing == COALESCE_OVERWRITES) {
+      _pReceiver->coalesceOverwrites();
+      m_coalescing = true;
+    }
+
     m_pChangeObjects->put(filter,_pReceiver,_priority);
     //cout<<"new filter length: "<<m_pChangeObjects->size()<<endl;  
 
@@ -550,6 +1017,7 @@ namespace cast {
       _pReceiver->deleteOnRemoval();
     }
 
+    IceUtil::Mutex::Lock lock(m_receiversToRemoveAccess);
     m_receiversToRemove.push_back(_pReceiver);
   }
 
@@ -568,6 +1036,11 @@ namespace cast {
       m_pChangeObjects->remove(receiver, removed);
       ///logf("filters to remove: %d", removed.size());
 
+      //entries may no longer be covered by the remaining filters
+      if(m_entryCache && !removed.empty()) {
+	m_entryCache->clear();
+      }
+
 
       for(vector<WorkingMemoryChangeFilter>::iterator i = removed.begin();
 	  i < removed.end(); ++i) {
@@ -639,8 +1112,242 @@ namespace cast {
 		if (m_workingMemory->ice_isCollocationOptimized()) {
       m_copyOnRead = true;
 		}    
+
+    //a collocated oneway call would run in this thread, and may
+    //then wait on a working memory which is waiting on this component
+    m_workingMemoryOneway = interfaces::WorkingMemoryPrx::uncheckedCast(m_workingMemory->ice_oneway()->ice_collocationOptimized(false));
+  }
+
+
+  void
+  WorkingMemoryReaderComponent::reportChangeProgress(const unsigned long & _processed,
+						     const unsigned long & _dropped,
+						     bool _overflowing) {
+    if(!m_workingMemoryOneway) {
+      return;
+    }
+    try {
+      m_workingMemoryOneway->reportReaderProgress(getComponentID(), _processed, 
+						  _dropped, _overflowing);
+    }
+    catch(const Ice::Exception & e) {
+      debug("unable to report change progress: %s", e.what());
+    }
+  }
+  
+  cdl::WorkingMemoryEntryPtr
+  WorkingMemoryReaderComponent::readBaseMemoryEntry(const std::string & _id, 
+                                                    const std::string & _subarch,
+                                                    bool _copy,
+                                                    bool _readOnly) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+    assert(!_id.empty());
+    assert(m_workingMemory);
+
+    cdl::WorkingMemoryEntryPtr entry;
+    if(m_entryCache && m_bReceivingChanges) {
+      cdl::WorkingMemoryAddress wma(makeWorkingMemoryAddress(_id, _subarch));
+      entry = m_entryCache->get(wma);
+      //locking sends no change, so only working memory knows if the
+      //entry is locked against reading. If it is, read it from there
+      //so the read waits for the lock as an uncached one would
+      if(entry && !readAllowed(m_workingMemory->getPermissions(_id, _subarch))) {
+	entry = 0;
+      }
+      if(!entry) {
+	unsigned long generation(m_entryCache->getGeneration());
+	entry = m_workingMemory->getWorkingMemoryEntry(_id, _subarch, getComponentID());
+	if(isCacheable(entry, _subarch)) {
+	  cdl::ByteSeq bytes;
+	  marshalEntry(getCommunicator(), entry->entry, bytes);
+	  m_entryCache->put(wma, entry, bytes.size(), generation);
+	}
+      }
+      //the cached entry is shared, so callers may not change it
+      _copy = _copy || !_readOnly;
+    }
+    else {
+      entry = m_workingMemory->getWorkingMemoryEntry(_id, _subarch, getComponentID());
+    }
+    
+    //if copy required on read
+    if(_copy) {
+      entry = new cdl::WorkingMemoryEntry(entry->id,entry->type,entry->version, entry->entry->ice_clone());
+    }
+    
+    updateVersion(entry->id, entry->version);
+    noteVersion(makeWorkingMemoryAddress(entry->id, _subarch), entry->version);
+    logGet(_id, _subarch, entry->type, entry->version);
+    return entry;
+  }
+
+  cdl::WorkingMemoryEntryPtr
+  WorkingMemoryReaderComponent::readChangeEntry(const cdl::WorkingMemoryChange & _wmc,
+                                                bool _copy,
+                                                bool _readOnly) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+    cdl::WorkingMemoryEntryPtr entry(_wmc.entry);
+    
+    //not sent with the change, so ask for it
+    if(!entry) {
+      return readBaseMemoryEntry(_wmc.address.id, _wmc.address.subarchitecture, 
+                                 _copy, _readOnly);
+    }
+    
+    //if copy required on read
+    if(_copy) {
+      entry = new cdl::WorkingMemoryEntry(entry->id,entry->type,entry->version, entry->entry->ice_clone());
+    }
+    
+    updateVersion(entry->id, entry->version);
+    noteVersion(_wmc.address, entry->version);
+    logGet(entry->id, _wmc.address.subarchitecture, entry->type, entry->version);
+    return entry;
+  }
+
+  void
+  WorkingMemoryReaderComponent::readBaseMemoryEntries(const std::string & _type,
+                                                      cdl::WorkingMemoryEntrySeq & _entries,
+                                                      const std::string & _subarch,
+                                                      const unsigned int _count,
+                                                      bool _copy) 
+    throw (UnknownSubarchitectureException) {
+    assert(!_subarch.empty());//subarch must not be empty
+    
+    m_workingMemory->getWorkingMemoryEntries(_type,_subarch,_count,getComponentID(), _entries);
+    
+    for (unsigned int i = 0; i < _entries.size(); ++i) {
+      //if copy required on read
+      if(_copy) {
+        _entries[i] = new cdl::WorkingMemoryEntry(_entries[i]->id,_entries[i]->type,_entries[i]->version, _entries[i]->entry->ice_clone());
+      }
+      updateVersion(_entries[i]->id, _entries[i]->version);
+      noteVersion(makeWorkingMemoryAddress(_entries[i]->id, _subarch), _entries[i]->version);
+      logGet(_entries[i]->id, _subarch, _entries[i]->type, _entries[i]->version);
+    }
+  }
+
+  bool
+  WorkingMemoryReaderComponent::isCacheable(const cdl::WorkingMemoryEntryPtr & _entry,
+                                            const std::string & _subarch) const {
+    if(!m_pChangeObjects) {
+      return false;
+    }
+    
+    //with no source, filters on a source will not match
+    cdl::WorkingMemoryChange wmc;
+    wmc.operation = cdl::OVERWRITE;
+    wmc.address = makeWorkingMemoryAddress(_entry->id, _subarch);
+    wmc.type = _entry->type;
+    wmc.superTypes = SymbolTable::hierarchy(_entry->entry).ids;
+    wmc.typeHierarchy = 0;
+    if(!m_pChangeObjects->allowsChange(wmc)) {
+      return false;
+    }
+    wmc.operation = cdl::DELETE;
+    return m_pChangeObjects->allowsChange(wmc);
   }
   
+  void
+  WorkingMemoryReaderComponent::entryWritten(const std::string & _id, 
+                                             const std::string & _subarch) {
+    if(m_entryCache) {
+      m_entryCache->invalidate(makeWorkingMemoryAddress(_id, _subarch));
+    }
+    if(isVersioned(_id)) {
+      noteVersion(makeWorkingMemoryAddress(_id, _subarch), getStoredVersionNumber(_id));
+    }
+  }
+
+  bool
+  WorkingMemoryReaderComponent::findLatestVersion(const std::string & _id, 
+                                                  const std::string & _subarch,
+                                                  int & _version) {
+    IceUtil::Mutex::Lock lock(m_trackedVersionsAccess);
+    TrackedVersionMap::const_iterator i = 
+      m_trackedVersions.find(makeWorkingMemoryAddress(_id, _subarch));
+    if(i == m_trackedVersions.end() || !i->second.established 
+       || i->second.version < 0) {
+      return false;
+    }
+    _version = i->second.version;
+    return true;
+  }
+
+  void
+  WorkingMemoryReaderComponent::noteVersion(const cdl::WorkingMemoryAddress & _wma, 
+                                            const int & _version) {
+    IceUtil::Mutex::Lock lock(m_trackedVersionsAccess);
+    TrackedVersionMap::iterator i = m_trackedVersions.find(_wma);
+    if(i != m_trackedVersions.end() && _version > i->second.version) {
+      i->second.version = _version;
+    }
+  }
+
+  void
+  WorkingMemoryReaderComponent::trackLatestVersion(const std::string & _id, 
+                                                   const std::string & _subarch)
+    throw (UnknownSubarchitectureException) {
+    assert(!_id.empty());
+    assert(!_subarch.empty());
+    assert(m_workingMemory);
+
+    cdl::WorkingMemoryAddress wma(makeWorkingMemoryAddress(_id, _subarch));
+    cdl::WorkingMemoryChangeFilter filter(createAddressFilter(wma));
+    if(_subarch == getSubarchitectureID()) {
+      filter.restriction = cdl::LOCALSA;
+    }
+    filter.origin = getComponentID();
+
+    {
+      IceUtil::Mutex::Lock lock(m_trackedVersionsAccess);
+      if(m_trackedVersions.find(wma) != m_trackedVersions.end()) {
+	return;
+      }
+      TrackedVersion & tracked(m_trackedVersions[wma]);
+      tracked.filter = filter;
+      tracked.version = -1;
+      tracked.established = false;
+    }
+
+    m_workingMemory->registerComponentFilter(filter, ChangeReceiverPriority(MEDIUM));
+
+    //changes from now on will arrive, so one read gives the rest
+    int version = -1;
+    try {
+      version = WorkingMemoryAttachedComponent::getVersionNumber(_id, _subarch);
+    }
+    catch(const DoesNotExistOnWMException &) {
+      //never existed, so versions will come with the first add
+    }
+
+    IceUtil::Mutex::Lock lock(m_trackedVersionsAccess);
+    TrackedVersionMap::iterator i = m_trackedVersions.find(wma);
+    if(i != m_trackedVersions.end()) {
+      if(version > i->second.version) {
+	i->second.version = version;
+      }
+      i->second.established = true;
+    }
+  }
+
+  void
+  WorkingMemoryReaderComponent::stopTrackingLatestVersion(const std::string & _id, 
+                                                          const std::string & _subarch) {
+    cdl::WorkingMemoryChangeFilter filter;
+    {
+      IceUtil::Mutex::Lock lock(m_trackedVersionsAccess);
+      TrackedVersionMap::iterator i = 
+	m_trackedVersions.find(makeWorkingMemoryAddress(_id, _subarch));
+      if(i == m_trackedVersions.end()) {
+	return;
+      }
+      filter = i->second.filter;
+      m_trackedVersions.erase(i);
+    }
+    m_workingMemory->removeComponentFilter(filter);
+  }
+
   bool
   WorkingMemoryReaderComponent::resetReadCollocationOptimisation() {
     m_copyOnRead = false;
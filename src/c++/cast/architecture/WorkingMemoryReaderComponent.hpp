@@ -27,13 +27,19 @@
 #include <cast/architecture/WorkingMemoryWriterComponent.hpp>
 #include <cast/architecture/WorkingMemoryChangeReceiver.hpp>
 #include <cast/architecture/WorkingMemoryChangeFilterMap.hpp>
+#include <cast/architecture/WorkingMemoryChangeQueue.hpp>
+#include <cast/architecture/ChangeDispatchPool.hpp>
+#include <cast/architecture/TypeHierarchyCache.hpp>
+#include <cast/architecture/WorkingMemoryEntryCache.hpp>
 #include <cast/core/CASTData.hpp>
 
 
 #include <list>
+#include <map>
 #include <vector>
 #include <boost/shared_ptr.hpp>
 #include <IceUtil/Thread.h> 
+#include <IceUtil/Time.h>
 
 
 
@@ -46,6 +52,18 @@ namespace cast {
   };
   
   
+  /**
+   * How the change events waiting for a receiver are queued.
+   */
+  enum ChangeReceiverQueueing {
+    ///every change event is passed to the receiver
+    QUEUE_ALL,
+    ///an overwrite is skipped if a later overwrite of the same entry
+    ///is waiting for the receiver, adds and deletes are always passed on
+    COALESCE_OVERWRITES
+  };
+  
+  
   //fwd declarations
   class WorkingMemoryReaderComponent;
   
@@ -59,6 +77,22 @@ namespace cast {
   public IceUtil::Thread {
     
   public:
+
+    /**
+     * What happens to a change that arrives when the queue is full.
+     */
+    enum OverflowPolicy {
+      ///wait for the component to make space. The wait is in the
+      ///Ice thread taking the change, never the working memory's
+      ///notifier, which sends without collocation and without holding
+      ///its routing lock
+      BLOCK,
+      ///drop the oldest queued change to make space
+      DROP_OLDEST,
+      ///replace the last queued overwrite of an entry with a newer
+      ///overwrite of it from the same source, otherwise wait
+      COALESCE
+    };
     
     /**
      * Contruct a new change thread, using _pWMRP as the component to write
@@ -82,21 +116,93 @@ namespace cast {
     void stop();
     
     /**
-     * Add a list of working memory change structs to the queue qaiting
-     * to be passed into the WorkingMemoryReaderComponent. The change
-     * structs are passed into the * component in the order they appear in
-     * the input list.
+     * Add a working memory change struct to the queue waiting to be
+     * passed into the WorkingMemoryReaderComponent. This does not lock
+     * unless the queue is full, in which case it waits for space.
      *
-     * @param _pChangeList A pointer to a sequence of
-     * WorkingMemoryChange structs.
+     * @param _change The change to queue.
      */
     void queueChange(const cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Add a sequence of changes to the queue, preserving their order,
+     * and wake the thread once.
+     *
+     * @param _changes The changes in the order they occurred.
+     */
+    void queueChanges(const cdl::WorkingMemoryChangeSeq & _changes);
+
+    /**
+     * Set the number of changes that can be queued. Must be called
+     * before the thread is started.
+     */
+    void setQueueCapacity(const unsigned int & _capacity) {
+      m_changeQueue.setCapacity(_capacity);
+    }
+
+    /**
+     * Must be called before the thread is started.
+     */
+    void setOverflowPolicy(const OverflowPolicy & _policy) {
+      m_overflowPolicy = _policy;
+    }
+
+    /**
+     * Set how often the number of changes processed is reported to
+     * the working memory. A full queue is reported at once, then no
+     * more often than this. If zero nothing is reported. Must be
+     * called before the thread is started.
+     */
+    void setProgressInterval(const IceUtil::Time & _interval) {
+      m_progressInterval = _interval;
+    }
+
+    /**
+     * The number of changes taken from the queue.
+     */
+    unsigned long getProcessedCount() const {
+      return m_processedChanges;
+    }
+
+    /**
+     * The number of changes dropped because the queue was full.
+     */
+    unsigned long getDroppedCount() const {
+      return m_droppedChanges;
+    }
+
+    /**
+     * The number of changes currently queued.
+     */
+    unsigned int getQueueDepth() const {
+      return m_changeQueue.depth();
+    }
+
+    /**
+     * The largest number of changes that have been queued at once.
+     */
+    unsigned int getQueueHighWaterMark() const {
+      return m_changeQueue.highWaterMark();
+    }
+    
+    
+    /**
+     * The number of overwrite events skipped by receivers using
+     * COALESCE_OVERWRITES.
+     */
+    unsigned long getCoalescedCount() const {
+      return m_coalescedChanges;
+    }
     
     
     /**
-     * Makes the choice to use event objects or method calls.
+     * Forward a change to the receivers whose filters match it.
+     *
+     * @param _newer A later overwrite of the same entry which is also
+     * waiting, or NULL.
      */
-    bool forwardToSubclass(std::list<cdl::WorkingMemoryChange> & _wmcl);
+    bool forwardToSubclass(const cdl::WorkingMemoryChange & _wmc,
+			   const cdl::WorkingMemoryChange * _newer = NULL);
     
   public:
     
@@ -121,6 +227,13 @@ namespace cast {
      * are discarded.  This locks the semaphore whilst writing.
      */
     void runDiscard();
+
+    /**
+     * Match changes against the filters and give them to the
+     * component's ChangeDispatchPool to forward. Changes are always
+     * queued in this mode.
+     */
+    void runDispatch();
     
     
   private:
@@ -132,21 +245,143 @@ namespace cast {
     inline void removeChangeFilters() const;
     
     /**
-     * The list of change structs ready to be written to the component.
+     * Add to the queue, waiting for space if it is full and the
+     * overflow policy does not allow a change to be dropped.
+     *
+     * @return false if the thread was stopped while waiting.
      */
-    std::list<cdl::WorkingMemoryChange>  m_changeList;
+    bool pushChange(const cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Add to the queue or drop a change as the overflow policy allows.
+     *
+     * @return false if the queue is full and the caller must wait.
+     */
+    bool tryPushChange(const cdl::WorkingMemoryChange & _change);
+
+    /**
+     * tryPushChange for the COALESCE policy.
+     */
+    bool tryPushCoalescing(const cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Take the change at the front of the queue.
+     */
+    bool popChange(cdl::WorkingMemoryChange & _change);
+
+    /**
+     * Called by a sender which found the queue full.
+     */
+    void overflowed();
+
+    /**
+     * Count changes taken from the queue, reporting to the working
+     * memory if due. Must not be called with the component locked.
+     */
+    void changesProcessed(const unsigned int & _count);
+
+    /**
+     * Whether there is progress the working memory has not been told
+     * about.
+     */
+    bool isProgressUnreported() const;
+
+    void reportProgress();
+
+    /**
+     * Wait until there is a change in the queue or the thread is
+     * stopped.
+     */
+    void waitForChanges();
+
+    /**
+     * Take up to the current queue depth of changes from the queue
+     * into m_pending.
+     *
+     * @return The number of changes taken.
+     */
+    unsigned int popPending();
+
+    /**
+     * Fill m_newer with the index of the next overwrite of the same
+     * entry for each overwrite in m_pending, if the component has
+     * coalescing receivers.
+     *
+     * @return false if there are no coalescing receivers, in which
+     * case m_newer is not filled.
+     */
+    bool findNewerOverwrites(const unsigned int & _count);
+
+    /**
+     * Take the coalescing receivers which also match _newer out of
+     * _receivers.
+     */
+    void removeCoalesced(std::vector<WorkingMemoryChangeReceiver *> & _receivers,
+			 const cdl::WorkingMemoryChange * _newer);
+
+    /**
+     * The change structs ready to be written to the component.
+     */
+    WorkingMemoryChangeQueue m_changeQueue;
+
+    ///The change being forwarded, reused to avoid allocation
+    cdl::WorkingMemoryChange m_change;
+
+    ///Changes taken from the queue to forward, reused to avoid allocation
+    std::vector<cdl::WorkingMemoryChange> m_pending;
+
+    ///For each change in m_pending, the index of the next overwrite of the same entry, or -1
+    std::vector<int> m_newer;
+
+    ///temp used to store the receivers of a newer overwrite
+    std::vector<WorkingMemoryChangeReceiver *> m_newerReceivers;
+
+    ///Overwrites skipped by coalescing receivers
+    volatile unsigned long m_coalescedChanges;
+
+    OverflowPolicy m_overflowPolicy;
+
+    ///Changes taken from the queue, only written by this thread
+    volatile unsigned long m_processedChanges;
+
+    ///Changes dropped by senders because the queue was full
+    volatile unsigned long m_droppedChanges;
+
+    ///Set by senders when the queue is full, cleared when reported
+    volatile unsigned int m_overflowing;
+
+    ///What was last reported to the working memory
+    unsigned long m_reportedProcessed;
+    unsigned long m_reportedDropped;
+    bool m_reportedOverflow;
+    IceUtil::Time m_lastReport;
+    IceUtil::Time m_progressInterval;
+
+    typedef std::pair<cdl::WorkingMemoryAddress, std::string> QueuedOverwrite;
+
+    /**
+     * For COALESCE, the address and source of overwrites which are
+     * queued with no other change of the same entry after them, and
+     * their queue positions. An overwrite may be missing if its entry
+     * was overwritten again after it was taken from the queue, but
+     * never present if it is not queued. Queue pushes and pops are
+     * done under m_queuedOverwritesAccess for this policy.
+     */
+    std::map<QueuedOverwrite, unsigned long> m_queuedOverwrites;
+    IceUtil::Mutex m_queuedOverwritesAccess;
+
+    ///Signalled when changes are queued
+    EventCount m_changesQueued;
+
+    ///Signalled when changes are taken from a full queue
+    EventCount m_spaceFreed;
     
-    ///Controls access to m_changeList
-    IceUtil::Mutex m_queueAccess;
     ///Whether the thread should do anthing
-    bool m_bRun;
+    volatile bool m_bRun;
     
     ///The component that this object writes change events into.
     WorkingMemoryReaderComponent * m_pWMRP;
     
-    
-    IceUtil::Monitor<IceUtil::Mutex> m_changeMonitor;
-    
     //temp used for comparisons
     cdl::WorkingMemoryChangeFilter m_tmpFilter;
     
@@ -177,6 +412,9 @@ namespace cast {
     
     //temp vector to store receivers scheduled for removal
     std::vector<const WorkingMemoryChangeReceiver *> m_receiversToRemove;
+
+    ///Controls access to m_receiversToRemove, which receivers may add to concurrently
+    IceUtil::Mutex m_receiversToRemoveAccess;
     
     
     bool m_bReceivingChanges;
@@ -198,6 +436,78 @@ namespace cast {
      */
     IceUtil::Handle<WorkingMemoryChangeThread> m_pWMChangeThread;    
     IceUtil::ThreadControl m_pWMChangeThreadControl;
+
+    /**
+     * Threads used to call receivers if --dispatch-threads is
+     * set. Null otherwise, when receivers are called by
+     * m_pWMChangeThread.
+     */
+    boost::shared_ptr<ChangeDispatchPool> m_dispatchPool;
+    unsigned int m_dispatchThreads;
+    ChangeDispatchPool::Ordering m_dispatchOrdering;
+
+    ///Whether any receiver has been added with COALESCE_OVERWRITES
+    bool m_coalescing;
+
+    ///Oneway proxy to the working memory, used to report change progress
+    interfaces::WorkingMemoryPrx m_workingMemoryOneway;
+
+    ///Super types for changes which only carry a type hierarchy id
+    TypeHierarchyCache m_typeHierarchies;
+
+    /**
+     * Entries read from working memory if --read-cache is set, null
+     * otherwise.
+     */
+    boost::shared_ptr<WorkingMemoryEntryCache> m_entryCache;
+
+    /**
+     * Whether an entry may be kept in m_entryCache. This is only the
+     * case if this component's filters let through every overwrite
+     * and delete of the entry, as those changes are what keep the
+     * cache up to date.
+     */
+    bool isCacheable(const cdl::WorkingMemoryEntryPtr & _entry,
+		     const std::string & _subarch) const;
+
+    /**
+     * An entry whose version is tracked. The version is the highest
+     * seen in changes or reads, which is never ahead of working memory
+     * as versions only increase.
+     */
+    struct TrackedVersion {
+      ///the filter which subscribes to changes to the entry
+      cdl::WorkingMemoryChangeFilter filter;
+      ///-1 until a version is seen
+      int version;
+      ///whether the subscription is in place and the version set from it
+      bool established;
+    };
+
+    typedef std::map<cdl::WorkingMemoryAddress, TrackedVersion> TrackedVersionMap;
+
+    TrackedVersionMap m_trackedVersions;
+    IceUtil::Mutex m_trackedVersionsAccess;
+
+    /**
+     * Raise the version of a tracked entry to _version, if it is
+     * tracked and lower.
+     */
+    void noteVersion(const cdl::WorkingMemoryAddress & _wma, const int & _version);
+
+    /**
+     * Tell the working memory how many of the changes it sent have
+     * been processed or dropped, so it can work out the lag.
+     */
+    void reportChangeProgress(const unsigned long & _processed,
+			      const unsigned long & _dropped,
+			      bool _overflowing);
+
+    /**
+     * Call a receiver, aborting the component if it throws.
+     */
+    void forwardToReceiver(WorkingMemoryChangeReceiver * _receiver, 
+			   const cdl::WorkingMemoryChange & _wmc);
     
     
     /**
@@ -223,6 +533,44 @@ namespace cast {
      */
     bool m_copyOnRead;
     
+    /**
+     * Read an entry from working memory, copying the data only if
+     * _copy is true, and record its version. If the read cache is on
+     * the entry may come from there instead, in which case it is
+     * copied unless _readOnly is true.
+     */
+    cdl::WorkingMemoryEntryPtr
+    readBaseMemoryEntry(const std::string & _id, 
+                        const std::string & _subarch,
+                        bool _copy,
+                        bool _readOnly = false) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
+    
+    /**
+     * Get the entry an ADD or OVERWRITE change refers to, using the
+     * one carried by the change if there is one and reading it from
+     * working memory otherwise. The data is copied only if _copy is
+     * true, and the version is recorded. _readOnly is as for
+     * readBaseMemoryEntry.
+     */
+    cdl::WorkingMemoryEntryPtr
+    readChangeEntry(const cdl::WorkingMemoryChange & _wmc,
+                    bool _copy,
+                    bool _readOnly = false) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException);
+    
+    /**
+     * Read all entries of a type from working memory, copying the
+     * data only if _copy is true, and record their versions.
+     */
+    void
+    readBaseMemoryEntries(const std::string & _type,
+                          cdl::WorkingMemoryEntrySeq & _entries,
+                          const std::string & _subarch,
+                          const unsigned int _count,
+                          bool _copy) 
+    throw (UnknownSubarchitectureException);
+    
     /**
      * Log the get to the logger defined to received gets. The logger must be
      * TRACE enabled to receive events.
@@ -273,6 +621,23 @@ namespace cast {
      */
     void turnOffReadCollocationOptimisation();
     
+    /**
+     * Drops the entry from the read cache, and notes the version this
+     * component wrote if the entry's version is tracked.
+     */
+    virtual 
+    void entryWritten(const std::string & _id, 
+                      const std::string & _subarch);
+    
+    /**
+     * Gives the version of an entry if it is tracked, see
+     * trackLatestVersion.
+     */
+    virtual 
+    bool findLatestVersion(const std::string & _id, 
+                           const std::string & _subarch,
+                           int & _version);
+    
   public:
     
     /**
@@ -296,9 +661,39 @@ namespace cast {
     virtual void startInternal();
     
     virtual void stopInternal();
+
+    /**
+     * Reads --change-queue-size, the number of change events that can
+     * wait to be forwarded before the senders are held up, and
+     * --dispatch-threads and --dispatch-order, which set up a
+     * ChangeDispatchPool to call receivers. --dispatch-order is
+     * "address" (the default) or "receiver".
+     *
+     * --change-queue-overflow is what to do when the queue is full:
+     * "block" (the default), "drop-oldest" or "coalesce" (see
+     * WorkingMemoryChangeThread::OverflowPolicy).
+     * --progress-interval is how often in milliseconds the changes
+     * processed are reported to the working memory, 0 for never,
+     * default 1000.
+     *
+     * --read-cache is the number of marshalled bytes of entries to
+     * keep after reading them, so that entries which have not changed
+     * since are not fetched from working memory again. Off by default.
+     * An entry is only kept if this component's filters receive all
+     * overwrites and deletes of it. A cached read still asks working
+     * memory for the entry's permissions, and reads the entry from
+     * working memory if it is locked against reading, so it saves
+     * moving the entry but not the round trip. A cached read can be
+     * behind working memory for as long as an overwrite takes to
+     * arrive as a change.
+     */
+    virtual 
+    void 
+    configureInternal(const std::map<std::string,std::string> & _config);
     
     ///Friend declaration for change thread.
     friend class WorkingMemoryChangeThread;
+    friend class ChangeDispatchPool;
     
     
   public:
@@ -314,6 +709,36 @@ namespace cast {
     void removeChangeFilter(const WorkingMemoryChangeReceiver * _receiver, 
                             const cdl::ReceiverDeleteCondition & _condition = cdl::DONOTDELETERECEIVER);
     
+    /**
+     * Keep track of the version an entry has on working memory, so
+     * that haveLatestVersion and checkConsistency can compare
+     * versions without asking working memory. This subscribes to all
+     * changes to the entry. The version known here can be behind
+     * working memory for as long as a change takes to arrive.
+     * 
+     * @param _id
+     * @param _subarch
+     */
+    void trackLatestVersion(const std::string & _id, 
+                            const std::string & _subarch)
+    throw (UnknownSubarchitectureException);
+    
+    void trackLatestVersion(const cdl::WorkingMemoryAddress & _wma)
+    throw (UnknownSubarchitectureException) {
+      trackLatestVersion(_wma.id, _wma.subarchitecture);
+    }
+    
+    /**
+     * Stop tracking the version of an entry and remove the
+     * subscription made by trackLatestVersion.
+     */
+    void stopTrackingLatestVersion(const std::string & _id, 
+                                   const std::string & _subarch);
+    
+    void stopTrackingLatestVersion(const cdl::WorkingMemoryAddress & _wma) {
+      stopTrackingLatestVersion(_wma.id, _wma.subarchitecture);
+    }
+    
     /**
      * Set filters to receive no changes at all.
      */
@@ -341,6 +766,52 @@ namespace cast {
      */
     void setReceiveXarchChangeNotifications(bool _receiveXarchChangeNotifications);
     
+    /**
+     * The number of change events waiting to be forwarded to receivers.
+     */
+    unsigned int getChangeQueueDepth() const {
+      return m_pWMChangeThread->getQueueDepth();
+    }
+
+    /**
+     * The largest number of change events that have been waiting to be
+     * forwarded to receivers at once.
+     */
+    unsigned int getChangeQueueHighWaterMark() const {
+      return m_pWMChangeThread->getQueueHighWaterMark();
+    }
+
+    /**
+     * The number of overwrite events skipped by receivers added with
+     * COALESCE_OVERWRITES.
+     */
+    unsigned long getCoalescedChangeCount() const {
+      return m_pWMChangeThread->getCoalescedCount();
+    }
+
+    /**
+     * The number of change events dropped because the queue was full.
+     */
+    unsigned long getDroppedChangeCount() const {
+      return m_pWMChangeThread->getDroppedCount();
+    }
+
+    /**
+     * The number of reads answered from the read cache. Always 0 if
+     * --read-cache is not set.
+     */
+    unsigned long getReadCacheHits() const {
+      return m_entryCache ? m_entryCache->getHits() : 0;
+    }
+
+    /**
+     * The number of reads which had to go to working memory while the
+     * read cache was on.
+     */
+    unsigned long getReadCacheMisses() const {
+      return m_entryCache ? m_entryCache->getMisses() : 0;
+    }
+
     int getFilterCount() const {
       if(m_pChangeObjects) {
         return m_pChangeObjects->size();
@@ -400,18 +871,7 @@ namespace cast {
     getBaseMemoryEntry(const std::string & _id, 
                        const std::string & _subarch) 
     throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
-      assert(!_id.empty());
-      assert(m_workingMemory);
-      cdl::WorkingMemoryEntryPtr entry(m_workingMemory->getWorkingMemoryEntry(_id, _subarch, getComponentID()));
-      
-      //if copy required on read
-      if(m_copyOnRead) {
-        entry = new cdl::WorkingMemoryEntry(entry->id,entry->type,entry->version, entry->entry->ice_clone());
-      }
-      
-      updateVersion(entry->id, entry->version);
-      logGet(_id, _subarch, entry->type, entry->version);
-      return entry;
+      return readBaseMemoryEntry(_id, _subarch, m_copyOnRead);
     }
     
     
@@ -462,6 +922,39 @@ namespace cast {
     throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
       return CASTData<T>(getBaseMemoryEntry(_id,_subarch));
     }
+
+    /**
+     * Get a read-only snapshot of the entry with the given id. Unlike
+     * getMemoryEntry this never copies the data, so when working
+     * memory is collocated the returned handle shares the object that
+     * is stored on working memory. Use mutableCopy on the result if
+     * you need to change it.
+     * 
+     * @param _id
+     *            The id for the entry in working memory.
+     * @return The requested entry.
+     */
+    template <class T>
+    ReadOnlyHandle<T>
+    getMemoryEntrySnapshot(const std::string & _id) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return getMemoryEntrySnapshot<T>(_id,getSubarchitectureID());
+    }
+    
+    template <class T>
+    ReadOnlyHandle<T>
+    getMemoryEntrySnapshot(const cdl::WorkingMemoryAddress & _wma) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return getMemoryEntrySnapshot<T>(_wma.id, _wma.subarchitecture);
+    }
+    
+    template <class T>
+    ReadOnlyHandle<T>
+    getMemoryEntrySnapshot(const std::string & _id, 
+                           const std::string & _subarch) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return ReadOnlyHandle<T>(IceInternal::Handle<T>::dynamicCast(readBaseMemoryEntry(_id,_subarch,false,true)->entry));
+    }
     
     
     
@@ -526,26 +1019,7 @@ namespace cast {
                          const std::string & _subarch,
                          const unsigned int _count = 0) 
     throw(UnknownSubarchitectureException) {
-      assert(!_subarch.empty());//subarch must not be empty
-      const std::string & type(typeName<T>());
-      
-      m_workingMemory->getWorkingMemoryEntries(type,_subarch,_count,getComponentID(), _entries);
-      
-      //TODO merge next two loops (oh, and test this)
-      
-      //if copy required on read
-      if(m_copyOnRead) {
-        for (unsigned int i = 0; i < _entries.size(); ++i) {
-          _entries[i] = new cdl::WorkingMemoryEntry(_entries[i]->id,_entries[i]->type,_entries[i]->version, _entries[i]->entry->ice_clone());
-        }        
-      }
-      
-      for(cdl::WorkingMemoryEntrySeq::const_iterator i = _entries.begin();
-          i < _entries.end(); ++i) {
-                
-        updateVersion((*i)->id, (*i)->version);
-        logGet((*i)->id, _subarch, (*i)->type, (*i)->version);
-      }      
+      readBaseMemoryEntries(typeName<T>(), _entries, _subarch, _count, m_copyOnRead);
     }
     
     template <class T>
@@ -574,6 +1048,127 @@ namespace cast {
       }      
     }
     
+    /**
+     * Get the entry a change refers to. If the change carries a patch
+     * against _baseVersion (see cdl::PATCHPAYLOAD), the entry is
+     * rebuilt locally from _base. Otherwise it is read from working
+     * memory.
+     * 
+     * @param _wmc
+     *            An OVERWRITE change.
+     * @param _base
+     *            The entry as this component last read it.
+     * @param _baseVersion
+     *            The version _base was read at.
+     * @return The entry with its version.
+     *
+     * @throws ConsistencyException
+     *             if the patch is against _baseVersion but was not
+     *             computed from _base.
+     */
+    template <class T>
+    CASTData<T>
+    getPatchedMemoryEntry(const cdl::WorkingMemoryChange & _wmc,
+                          const ReadOnlyHandle<T> & _base,
+                          const int _baseVersion)
+    throw (DoesNotExistOnWMException, ConsistencyException, UnknownSubarchitectureException) {
+      if(_wmc.patch && _base && _wmc.patch->baseVersion == _baseVersion) {
+        cdl::ByteSeq bytes;
+        marshalEntry(getCommunicator(), _base.shared(), bytes);
+        if(!isPatchBase(_wmc.patch, bytes)) {
+          throw(ConsistencyException(exceptionMessage(__HERE__,
+                                                      "Base given for %s:%s is not the entry at version %d",
+                                                      _wmc.address.id.c_str(),
+                                                      _wmc.address.subarchitecture.c_str(),
+                                                      _baseVersion),
+                                     _wmc.address));
+        }
+        try {
+          applyPatch(_wmc.patch, bytes);
+          IceInternal::Handle<T> data(IceInternal::Handle<T>::dynamicCast(unmarshalEntry(getCommunicator(), bytes)));
+          if(data) {
+            updateVersion(_wmc.address.id, _baseVersion + 1);
+            return CASTData<T>(_wmc.address.id, _baseVersion + 1, data);
+          }
+        }
+        catch(const Ice::Exception & e) {
+          debug("unable to apply patch for %s: %s", _wmc.address.id.c_str(), e.what());
+        }
+      }
+      //no usable patch, so read the whole entry
+      return getMemoryEntryWithData<T>(_wmc.address);
+    }
+    
+    /**
+     * Get the entry an ADD or OVERWRITE change refers to. If the
+     * change carries the entry (see cdl::ENTRYPAYLOAD) no call is
+     * made to working memory, otherwise the entry is read as with
+     * getMemoryEntry(_wmc.address). A carried entry is the one
+     * written by the change, so it may have been overwritten since.
+     * 
+     * @param _wmc
+     *            An ADD or OVERWRITE change.
+     * @return The entry written by the change, or a later one.
+     */
+    template <class T>
+    IceInternal::Handle<T>
+    getMemoryEntry(const cdl::WorkingMemoryChange & _wmc) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return IceInternal::Handle<T>::dynamicCast(readChangeEntry(_wmc,m_copyOnRead)->entry);
+    }
+    
+    template <class T>
+    CASTData<T>
+    getMemoryEntryWithData(const cdl::WorkingMemoryChange & _wmc) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return CASTData<T>(readChangeEntry(_wmc,m_copyOnRead));
+    }
+    
+    /**
+     * As getMemoryEntry(_wmc), but never copies the data.
+     */
+    template <class T>
+    ReadOnlyHandle<T>
+    getMemoryEntrySnapshot(const cdl::WorkingMemoryChange & _wmc) 
+    throw (DoesNotExistOnWMException, UnknownSubarchitectureException) {
+      return ReadOnlyHandle<T>(IceInternal::Handle<T>::dynamicCast(readChangeEntry(_wmc,false,true)->entry));
+    }
+    
+    /**
+     * Get read-only snapshots of entries of the given type. As with
+     * getMemoryEntrySnapshot, the data is never copied.
+     * 
+     * @param _entries
+     *            The vector to add the snapshots to.
+     * @param _subarch
+     *            The subarchitecture to read from.
+     * @param _count
+     *            The maximum number of entries to return, 0 for all.
+     */
+    template <class T>
+    void
+    getMemoryEntrySnapshots(std::vector< ReadOnlyHandle<T> > & _entries,
+                            const unsigned int _count = 0) {
+      getMemoryEntrySnapshots<T>(_entries,getSubarchitectureID(), _count);
+    }
+    
+    template <class T>
+    void
+    getMemoryEntrySnapshots(std::vector< ReadOnlyHandle<T> > & _entries,
+                            const std::string & _subarch,
+                            const unsigned int _count = 0) 
+    throw (UnknownSubarchitectureException) {
+      assert(!_subarch.empty());//subarch must not be empty
+      
+      cdl::WorkingMemoryEntrySeq entries;
+      readBaseMemoryEntries(typeName<T>(),entries,_subarch,_count,false);
+      
+      for(cdl::WorkingMemoryEntrySeq::const_iterator i = entries.begin();
+          i < entries.end(); ++i) {
+        _entries.push_back(ReadOnlyHandle<T>(IceInternal::Handle<T>::dynamicCast((*i)->entry)));
+      }      
+    }
+    
     template <class T>
     void
     getMemoryEntriesWithData(std::vector< CASTData<T> > & _entries,
@@ -683,14 +1278,22 @@ namespace cast {
      * @param _filter The filter to match for the receiver
      * @param _receiver
      *            The receiver object
+     * @param _queueing Use COALESCE_OVERWRITES to skip overwrites
+     *            which are already out of date when the receiver
+     *            would get them. This applies to the receiver, so to
+     *            all of its filters.
      */
     void addChangeFilter(const cdl::WorkingMemoryChangeFilter & _filter,  
                          WorkingMemoryChangeReceiver * _pReceiver,
-                         const int & _priority = ChangeReceiverPriority(MEDIUM));
+                         const int & _priority = ChangeReceiverPriority(MEDIUM),
+                         const ChangeReceiverQueueing & _queueing = QUEUE_ALL);
     
     
     void receiveChangeEvent(const cdl::WorkingMemoryChange& wmc, 
                             const Ice::Current & _ctx);
+
+    void receiveChangeEvents(const cdl::WorkingMemoryChangeSeq& _wmcs, 
+                             const Ice::Current & _ctx);
     
     /**
      * This method sleeps until workingMemoryChanged has returned after
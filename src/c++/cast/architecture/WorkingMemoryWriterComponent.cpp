@@ -28,7 +28,8 @@ using namespace std;
 namespace cast {
 
   WorkingMemoryWriterComponent::WorkingMemoryWriterComponent() 
-    : m_dataCount(0) {
+    : m_dataCount(0),
+      m_copyOnWrite(false) {
   }
 
 
@@ -186,6 +187,73 @@ namespace cast {
     m_workingMemory->deleteFromWorkingMemory(_id,_subarch,getComponentID());
 
     logDelete(_id, _subarch);
+    entryWritten(_id, _subarch);
+  }
+
+  
+  cdl::WorkingMemoryBatchResultSeq
+  WorkingMemoryWriterComponent::addToWorkingMemoryBatch(const std::string & _subarch,
+							const cdl::WorkingMemoryBatchItemSeq & _items)
+    throw (UnknownSubarchitectureException) {
+    
+    assert(!_subarch.empty());//subarch must not be empty
+
+    cdl::WorkingMemoryBatchResultSeq results = 
+      m_workingMemory->addToWorkingMemoryBatch(_subarch, getComponentID(), _items);
+    assert(results.size() == _items.size());
+
+    for(size_t i = 0; i < _items.size(); ++i) {
+      if(results[i].outcome == cdl::BATCHWRITTEN) {
+	//the wm reports the version, so there is no need to ask for
+	//it when re-adding as addToWorkingMemory does
+	storeVersionNumber(_items[i].id, results[i].version);
+	logAdd(_items[i].id, _subarch, _items[i].type, results[i].version);
+      }
+    }
+    return results;
+  }
+
+
+  cdl::WorkingMemoryBatchResultSeq
+  WorkingMemoryWriterComponent::overwriteWorkingMemoryBatch(const std::string & _subarch,
+							    const cdl::WorkingMemoryBatchItemSeq & _items)
+    throw (UnknownSubarchitectureException) {
+    
+    assert(!_subarch.empty());//subarch must not be empty
+
+    cdl::WorkingMemoryBatchResultSeq results = 
+      m_workingMemory->overwriteWorkingMemoryBatch(_subarch, getComponentID(), _items);
+    assert(results.size() == _items.size());
+
+    for(size_t i = 0; i < _items.size(); ++i) {
+      if(results[i].outcome == cdl::BATCHWRITTEN) {
+	storeVersionNumber(_items[i].id, results[i].version);
+	logOverwrite(_items[i].id, _subarch, _items[i].type, results[i].version);
+	entryWritten(_items[i].id, _subarch);
+      }
+    }
+    return results;
+  }
+
+
+  cdl::WorkingMemoryBatchResultSeq
+  WorkingMemoryWriterComponent::deleteFromWorkingMemoryBatch(const std::string & _subarch,
+							     const std::vector<std::string> & _ids)
+    throw (UnknownSubarchitectureException) {
+    
+    assert(!_subarch.empty());//subarch must not be empty
+
+    cdl::WorkingMemoryBatchResultSeq results = 
+      m_workingMemory->deleteFromWorkingMemoryBatch(_subarch, getComponentID(), _ids);
+    assert(results.size() == _ids.size());
+
+    for(size_t i = 0; i < _ids.size(); ++i) {
+      if(results[i].outcome == cdl::BATCHWRITTEN) {
+	logDelete(_ids[i], _subarch);
+	entryWritten(_ids[i], _subarch);
+      }
+    }
+    return results;
   }
 
   
@@ -25,6 +25,8 @@
 
 #include <cast/core/ComponentLogger.hpp>
 #include <cast/architecture/WorkingMemoryAttachedComponent.hpp>
+#include <cast/core/ReadOnlyHandle.hpp>
+#include <cast/core/EntryPatch.hpp>
 
 namespace cast {
   
@@ -126,6 +128,17 @@ namespace cast {
      */
     void turnOffWriteCollocationOptimisation();
     
+    /**
+     * Called after this component has overwritten or deleted an
+     * entry, so anything held about the old entry can be dropped.
+     * 
+     * @param _id
+     * @param _subarch
+     */
+    virtual 
+    void entryWritten(const std::string & _id, 
+                      const std::string & _subarch) {}
+    
   public:
     
     /**
@@ -243,6 +256,62 @@ namespace cast {
                            const std::string &_subarch,
                            IceInternal::Handle<T>  _data) 
     throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) { 
+      overwriteWorkingMemoryInternal(_id,_subarch,_data,m_copyOnWrite);
+    }
+    
+    /**
+     * Overwrite data object in working memory with a frozen
+     * object. The object is never copied, so if working memory is
+     * collocated it will store (and share with readers) the object
+     * itself. See ReadOnlyHandle.
+     *
+     * @param _id
+     *            The id the data will be stored with
+     * @param _subarchitectureID
+     *            The subarchitecture to write to.
+     * @param _data
+     *            The data itself
+     * 
+     * @throws DoesNotExistOnWMException
+     *             if the given id does not exist to be overwritten.
+     * @throws ConsistencyException
+     *             if this component does not have the most recent version of
+     *             the data at the given id.
+     */
+    template <class T>
+    void 
+    overwriteWorkingMemory(const std::string &_id, 
+                           const std::string &_subarch,
+                           const ReadOnlyHandle<T> & _data) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) { 
+      overwriteWorkingMemoryInternal(_id,_subarch,_data.shared(),false);
+    }
+    
+    template <class T>
+    void 
+    overwriteWorkingMemory(const std::string &_id, 
+                           const ReadOnlyHandle<T> & _data) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException) {
+      overwriteWorkingMemory(_id,getSubarchitectureID(),_data);
+    }  
+    
+    template <class T>
+    void 
+    overwriteWorkingMemory(const cdl::WorkingMemoryAddress & _wma, 
+                           const ReadOnlyHandle<T> & _data) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) {
+      overwriteWorkingMemory(_wma.id,_wma.subarchitecture,_data);
+    }  
+    
+  protected:
+    
+    template <class T>
+    void 
+    overwriteWorkingMemoryInternal(const std::string &_id, 
+                                   const std::string &_subarch,
+                                   IceInternal::Handle<T>  _data,
+                                   bool _copy) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) { 
       
       assert(!_id.empty());//id must not be empty
       assert(!_subarch.empty());//subarch must not be empty
@@ -294,7 +363,7 @@ namespace cast {
       
       //logMemoryOverwrite(_id,_subarch,type);
       
-      if(m_copyOnWrite) {
+      if(_copy) {
         m_workingMemory->overwriteWorkingMemory(_id,_subarch, type, getComponentID(), _data->ice_clone());
       }
       else {
@@ -306,8 +375,175 @@ namespace cast {
       increaseStoredVersion(_id);
       
       logOverwrite(_id, _subarch, type, getStoredVersionNumber(_id));      
+      entryWritten(_id, _subarch);
     }
     
+  public:
+    
+    
+    /**
+     * Overwrite an entry by sending only the difference between the
+     * version this component holds and the new data. This is for large
+     * entries of which only a small part changes. If the patch would
+     * not be much smaller than the entry, a normal overwrite is done
+     * instead.
+     *
+     * @param _id
+     *            The id of the entry.
+     * @param _subarch
+     *            The subarchitecture to write to.
+     * @param _base
+     *            The entry as this component last read or wrote it.
+     * @param _baseVersion
+     *            The version _base was read or written at.
+     * @param _data
+     *            The new entry.
+     * 
+     * @throws DoesNotExistOnWMException
+     *             if the given id does not exist to be overwritten.
+     * @throws ConsistencyException
+     *             if the entry on working memory is no longer at
+     *             _baseVersion, or is not _base.
+     */
+    template <class T>
+    void 
+    patchWorkingMemory(const std::string &_id, 
+                       const std::string &_subarch,
+                       const ReadOnlyHandle<T> & _base,
+                       const int _baseVersion,
+                       IceInternal::Handle<T>  _data) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) { 
+      
+      assert(!_id.empty());//id must not be empty
+      assert(!_subarch.empty());//subarch must not be empty
+      assert(_base);//base must not be null
+      assert(_data);//data must not be null
+      
+      if (!holdsOverwriteLock(_id, _subarch) && !isOverwritable(_id, _subarch)) {
+        throw PermissionException(exceptionMessage(__HERE__,
+                                                   "Overwrite not allowed on locked item: %s:%s",
+                                                   _id.c_str(), _subarch.c_str()),
+                                  makeWorkingMemoryAddress(_subarch,_id));
+      }
+      
+      cdl::ByteSeq base;
+      cdl::ByteSeq updated;
+      marshalEntry(getCommunicator(), _base.shared(), base);
+      marshalEntry(getCommunicator(), _data, updated);
+      
+      //working memory checks the version and base, so no consistency
+      //check here
+      cdl::WorkingMemoryPatchPtr patch(createPatch(base, updated, _baseVersion));
+      
+      if(patchSize(patch) * 2 > updated.size()) {
+        overwriteWorkingMemory(_id, _subarch, _data);
+        return;
+      }
+      
+      const std::string & type(typeName<T>());
+      m_workingMemory->patchWorkingMemory(_id, _subarch, type, getComponentID(), patch);
+      
+      storeVersionNumber(_id, _baseVersion + 1);
+      
+      logOverwrite(_id, _subarch, type, getStoredVersionNumber(_id));      
+      entryWritten(_id, _subarch);
+    }
+    
+    template <class T>
+    void 
+    patchWorkingMemory(const cdl::WorkingMemoryAddress & _wma, 
+                       const ReadOnlyHandle<T> & _base,
+                       const int _baseVersion,
+                       IceInternal::Handle<T>  _data) 
+    throw (DoesNotExistOnWMException, ConsistencyException, PermissionException, UnknownSubarchitectureException) {
+      patchWorkingMemory(_wma.id,_wma.subarchitecture,_base,_baseVersion,_data);
+    }
+
+
+    /**
+     * Overwrite an entry only if it is still at the given version,
+     * without taking a lock. Working memory checks the version and
+     * writes under one lock, so this is for optimistic writers which
+     * retry on conflict, e.g.
+     *
+     * <pre>
+     * CASTData<Thing> read(getMemoryEntryWithData<Thing>(id));
+     * int version = read.getVersion();
+     * ThingPtr thing = read.getData();
+     * do {
+     *   thing->count++;
+     * } while(!overwriteIfVersion(id, subarch, version, thing));
+     * </pre>
+     *
+     * @param _id
+     *            The id of the entry.
+     * @param _subarch
+     *            The subarchitecture to write to.
+     * @param _version
+     *            The version _data was derived from. Set to the new
+     *            version on success, else to the current version.
+     * @param _data
+     *            The new entry. If there is a conflict it is replaced
+     *            with a copy of the current entry, which the caller is
+     *            free to change.
+     * @return true if the entry was written.
+     *
+     * @throws DoesNotExistOnWMException
+     *             if the given id does not exist to be overwritten.
+     * @throws PermissionException
+     *             if the entry is locked by another component.
+     */
+    template <class T>
+    bool
+    overwriteIfVersion(const std::string &_id,
+                       const std::string &_subarch,
+                       int & _version,
+                       IceInternal::Handle<T> & _data)
+    throw (DoesNotExistOnWMException, PermissionException, UnknownSubarchitectureException) {
+
+      assert(!_id.empty());//id must not be empty
+      assert(!_subarch.empty());//subarch must not be empty
+      assert(_data);//data must not be null
+
+      const std::string & type(typeName<T>());
+
+      Ice::Int version;
+      cdl::WorkingMemoryEntryPtr current;
+      if(m_copyOnWrite) {
+        current = m_workingMemory->overwriteIfVersion(_id, _subarch, type, getComponentID(),
+                                                      _version, _data->ice_clone(), version);
+      }
+      else {
+        current = m_workingMemory->overwriteIfVersion(_id, _subarch, type, getComponentID(),
+                                                      _version, _data, version);
+      }
+
+      //either way we now know the entry at this version
+      _version = version;
+      storeVersionNumber(_id, _version);
+
+      if(current) {
+        //the entry may be the one stored on a collocated working memory
+        _data = IceInternal::Handle<T>::dynamicCast(current->entry->ice_clone());
+        debug("overwrite of %s:%s lost to version %d",
+              _id.c_str(), _subarch.c_str(), _version);
+        return false;
+      }
+
+      logOverwrite(_id, _subarch, type, _version);
+      entryWritten(_id, _subarch);
+      return true;
+    }
+
+    template <class T>
+    bool
+    overwriteIfVersion(const cdl::WorkingMemoryAddress & _wma,
+                       int & _version,
+                       IceInternal::Handle<T> & _data)
+    throw (DoesNotExistOnWMException, PermissionException, UnknownSubarchitectureException) {
+      return overwriteIfVersion(_wma.id,_wma.subarchitecture,_version,_data);
+    }
+
     
     /**
      * Delete data from working memory with given id.
@@ -441,6 +677,53 @@ namespace cast {
                             const std::string &_subarch,
                             IceInternal::Handle<T>  _data) 
     throw (AlreadyExistsOnWMException, UnknownSubarchitectureException) { 
+      addToWorkingMemoryInternal(_id,_subarch,_data,m_copyOnWrite);
+    }
+    
+    /**
+     * Add a frozen object to working memory. The object is never
+     * copied, so if working memory is collocated it will store (and
+     * share with readers) the object itself. See ReadOnlyHandle.
+     * 
+     * @param _id
+     *            The id the data will be stored with.
+     * @param _subarchitectureID
+     *            The subarchitecture to write to.
+     * @param _data
+     *            The data itself, frozen with freeze().
+     * @throws AlreadyExistsOnWMException
+     *             If an entry exists at the given id.
+     */
+    template <class T>
+    void addToWorkingMemory(const std::string &_id, 
+                            const std::string &_subarch,
+                            const ReadOnlyHandle<T> & _data) 
+    throw (AlreadyExistsOnWMException, UnknownSubarchitectureException) { 
+      addToWorkingMemoryInternal(_id,_subarch,_data.shared(),false);
+    }
+    
+    template <class T>
+    void addToWorkingMemory(const std::string &_id, 
+                            const ReadOnlyHandle<T> & _data) 
+    throw (AlreadyExistsOnWMException) { 
+      addToWorkingMemory(_id,getSubarchitectureID(),_data);
+    }
+    
+    template <class T>
+    void addToWorkingMemory(const cdl::WorkingMemoryAddress & _wma, 
+                            const ReadOnlyHandle<T> & _data) 
+    throw (AlreadyExistsOnWMException, UnknownSubarchitectureException) { 
+      addToWorkingMemory(_wma.id,_wma.subarchitecture,_data);
+    }
+    
+  protected:
+    
+    template <class T>
+    void addToWorkingMemoryInternal(const std::string &_id, 
+                                    const std::string &_subarch,
+                                    IceInternal::Handle<T>  _data,
+                                    bool _copy) 
+    throw (AlreadyExistsOnWMException, UnknownSubarchitectureException) { 
       
       assert(!_id.empty());//id must not be empty
       assert(!_subarch.empty());//subarch must not be empty
@@ -471,7 +754,7 @@ namespace cast {
         storeVersionNumber(_id, versionWhichWillEndUpOnWM);
       }
       
-      if(m_copyOnWrite) {
+      if(_copy) {
         m_workingMemory->addToWorkingMemory(_id,_subarch,type,getComponentID(),_data->ice_clone()); 
       }
       else {
@@ -483,6 +766,125 @@ namespace cast {
       
     }
     
+  public:
+    
+    
+    /**
+     * Add an entry to a batch to be written with
+     * addToWorkingMemoryBatch or overwriteWorkingMemoryBatch.
+     * 
+     * @param _items
+     *            The batch to add to.
+     * @param _id
+     *            The id the data will be stored with.
+     * @param _data
+     *            The data itself. Must be a ref-counted pointer to an instance of an Ice class.
+     */
+    template <class T>
+    void addToBatch(cdl::WorkingMemoryBatchItemSeq & _items,
+                    const std::string &_id, 
+                    IceInternal::Handle<T>  _data) { 
+      
+      assert(!_id.empty());//id must not be empty
+      assert(_data);//data must not be null
+      
+      cdl::WorkingMemoryBatchItem item;
+      item.id = _id;
+      item.type = typeName<T>();
+      if(m_copyOnWrite) {
+        item.entry = _data->ice_clone();
+      }
+      else {
+        item.entry = _data;
+      }
+      _items.push_back(item);
+    }
+    
+    /**
+     * Add a frozen entry to a batch. The object is never copied.
+     */
+    template <class T>
+    void addToBatch(cdl::WorkingMemoryBatchItemSeq & _items,
+                    const std::string &_id, 
+                    const ReadOnlyHandle<T> & _data) { 
+      
+      assert(!_id.empty());//id must not be empty
+      assert(_data);//data must not be null
+      
+      cdl::WorkingMemoryBatchItem item;
+      item.id = _id;
+      item.type = typeName<T>();
+      item.entry = _data.shared();
+      _items.push_back(item);
+    }
+    
+    /**
+     * Add a batch of new entries to working memory in a single
+     * call. All entries are added under one working memory lock and
+     * their change events are sent together.
+     * 
+     * @param _subarch
+     *            The subarchitecture to write to.
+     * @param _items
+     *            The entries to add, built with addToBatch.
+     * @return The result for each item, in the same order as
+     *         _items. Items which already exist are reported as
+     *         BATCHALREADYEXISTS rather than thrown, and items with
+     *         a null entry as BATCHNOENTRY.
+     */
+    cdl::WorkingMemoryBatchResultSeq
+    addToWorkingMemoryBatch(const std::string & _subarch,
+                            const cdl::WorkingMemoryBatchItemSeq & _items)
+    throw (UnknownSubarchitectureException);
+    
+    cdl::WorkingMemoryBatchResultSeq
+    addToWorkingMemoryBatch(const cdl::WorkingMemoryBatchItemSeq & _items) { 
+      return addToWorkingMemoryBatch(getSubarchitectureID(), _items);
+    }
+    
+    /**
+     * Overwrite a batch of entries in a single call. Unlike
+     * overwriteWorkingMemory this does not check the consistency of
+     * each entry with a separate call, the overwrites are applied in
+     * the order given. Entries locked by another component are
+     * reported as BATCHLOCKED, missing entries as BATCHDOESNOTEXIST
+     * and items with a null entry as BATCHNOENTRY.
+     * 
+     * @param _subarch
+     *            The subarchitecture to write to.
+     * @param _items
+     *            The entries to overwrite, built with addToBatch.
+     * @return The result for each item, in the same order as _items.
+     */
+    cdl::WorkingMemoryBatchResultSeq
+    overwriteWorkingMemoryBatch(const std::string & _subarch,
+                                const cdl::WorkingMemoryBatchItemSeq & _items)
+    throw (UnknownSubarchitectureException);
+    
+    cdl::WorkingMemoryBatchResultSeq
+    overwriteWorkingMemoryBatch(const cdl::WorkingMemoryBatchItemSeq & _items) { 
+      return overwriteWorkingMemoryBatch(getSubarchitectureID(), _items);
+    }
+    
+    /**
+     * Delete a batch of entries in a single call.
+     * 
+     * @param _subarch
+     *            The subarchitecture to delete from.
+     * @param _ids
+     *            The ids of the entries to delete.
+     * @return The result for each id, in the same order as _ids.
+     */
+    cdl::WorkingMemoryBatchResultSeq
+    deleteFromWorkingMemoryBatch(const std::string & _subarch,
+                                 const std::vector<std::string> & _ids)
+    throw (UnknownSubarchitectureException);
+    
+    cdl::WorkingMemoryBatchResultSeq
+    deleteFromWorkingMemoryBatch(const std::vector<std::string> & _ids) { 
+      return deleteFromWorkingMemoryBatch(getSubarchitectureID(), _ids);
+    }
+    
     
     /**
      * Generate a new unique id for a working memory entry.
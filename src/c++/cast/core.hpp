@@ -34,6 +34,8 @@
 #include <cast/core/CASTWorkingMemory.hpp> 
 #include <cast/core/CASTWMPermissionsMap.hpp>
 #include <cast/core/CASTData.hpp>
+#include <cast/core/ReadOnlyHandle.hpp>
+#include <cast/core/EntryPatch.hpp>
 #include <cast/core/CASTWorkingMemoryInterface.hpp>
 #include <cast/core/StringMap.hpp> 
 #include <cast/core/CASTTimer.hpp>
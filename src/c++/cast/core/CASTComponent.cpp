@@ -114,6 +114,7 @@ namespace cast {
     m_startColourEscape(END_COLOUR_ESCAPE),
     m_startCalled(false),
     m_configureCalled(false),
+    m_useLocalClock(false),
     m_bLogOutput(false),
     m_bDebugOutput(false),
     m_logLevel(),
@@ -520,6 +521,30 @@ namespace cast {
       }   
     }
 
+    i = _config.find(cdl::LOCALCLOCKKEY);
+
+    if(i != _config.end()) {
+      string clockValue = i->second;
+      if(clockValue == "true") {
+	m_useLocalClock = true;
+      }
+      else if(clockValue == "false") {
+	m_useLocalClock = false;
+      }
+      else {
+	//otherwise the value is the resync interval in milliseconds
+	char * end;
+	long millis = strtol(clockValue.c_str(), &end, 10);
+	if(clockValue.empty() || *end != '\0' || millis < 0) {
+	  error(string("config err, unknown value for local clock: ") + clockValue); 
+	}
+	else {
+	  m_useLocalClock = true;
+	  m_localClock.setResyncInterval(millis);
+	}
+      }   
+    }
+
     i = _config.find(cdl::COMPONENTNUMBERKEY);
 
     assert(i != _config.end());
@@ -26,6 +26,7 @@
 #include <cast/slice/CDL.hpp>
 #include <cast/core/CASTUtils.hpp>
 #include <cast/core/ComponentLogger.hpp>
+#include <cast/core/LocalCASTClock.hpp>
 
 #include <cstdarg>
 #include <string>
@@ -117,6 +118,12 @@ namespace cast {
 		
     ///proxy for cast time server
     interfaces::TimeServerPrx m_timeServer;
+
+    ///whether getCASTTime uses m_localClock rather than calling m_timeServer
+    bool m_useLocalClock;
+
+    ///local time source, synced from m_timeServer
+    mutable LocalCASTClock m_localClock;
 		
     
     cast::CASTComponentPtr m_componentPtr;
@@ -205,6 +212,7 @@ namespace cast {
     setTimeServer(const cast::interfaces::TimeServerPrx & _ts, 
 		  const ::Ice::Current & _ctx) {
       m_timeServer = _ts;
+      m_localClock.setTimeServer(_ts);
     }
 		
     void
@@ -382,9 +390,14 @@ namespace cast {
 
     /**
      * Get the current CAST time. This is a monotomic timer that starts at 0 on startup.
+     * If the component is configured with --local-clock this is computed locally
+     * rather than by calling the time server.
      */
     cdl::CASTTime getCASTTime() const {
       assert(m_timeServer);
+      if(m_useLocalClock) {
+	return m_localClock.getCASTTime();
+      }
       return m_timeServer->getCASTTime();
     }
         
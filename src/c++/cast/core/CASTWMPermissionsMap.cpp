@@ -4,81 +4,304 @@
 #include "Logging.hpp"
 
 #include <iostream>
+#include <sstream>
+#include <set>
+#include <cerrno>
+#include <ctime>
+#include <sys/time.h>
+
 using namespace std;
 
 namespace cast {
+
+  namespace {
+
+    ///monotonic time in microseconds, for measuring intervals
+    long long nowMicros() {
+      timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      return static_cast<long long>(now.tv_sec) * 1000000LL + now.tv_nsec / 1000;
+    }
+
+    unsigned int bucket(const long long & _micros) {
+      unsigned int bucket = 0;
+      for(long long t = _micros; t > 0 && bucket < CASTWMPermissionsMap::LockStatistics::BUCKETS - 1; t >>= 1) {
+        ++bucket;
+      }
+      return bucket;
+    }
+
+  }
+
+  const unsigned int CASTWMPermissionsMap::STRIPE_COUNT;
+  const unsigned int CASTWMPermissionsMap::LockStatistics::BUCKETS;
+
+
+  CASTWMPermissionsMap::LockStatistics::LockStatistics() :
+    timeouts(0) {
+    for(unsigned int i = 0; i < BUCKETS; ++i) {
+      holdTimes[i] = 0;
+      waitTimes[i] = 0;
+    }
+  }
+
   
-  CASTWMPermissionsMap::CASTWMPermissionsMap() {
-    pthread_mutexattr_t attr;
-    // note: errors here are very unlikely, so we just do a "weaker" overall
-    // checking
-    int err =  pthread_mutexattr_init(&attr);
-    if(err != 0) {
-      throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
+  CASTWMPermissionsMap::CASTWMPermissionsMap() :
+    m_lockedCount(0),
+    m_ordering(FIFO),
+    m_cycles(0) {
+
+    for(unsigned int i = 0; i < STRIPE_COUNT; ++i) {
+      int err = pthread_mutex_init(&(m_stripes[i].m_access), NULL);
+      if(err != 0) {
+        throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
+      }
+      err = pthread_cond_init(&(m_stripes[i].m_unlocked), NULL);
+      if(err != 0) {
+        throw CASTException(exceptionMessage(__HERE__, "failed to create condition: %s", strerror(err)));
+      }
     }
-    
-#ifdef __LINUX__    
-    //nah: this doesn't work, and isn't necessary, on macs for some reason
-    err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-    if(err != 0) {
-      throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
+
+    int err = pthread_mutex_init(&m_statisticsAccess, NULL);
+    if(err == 0) {
+      err = pthread_mutex_init(&m_graphAccess, NULL);
     }
-#endif
-    
-    //     err = pthread_mutexattr_settype(&attr,
-    // 				    PTHREAD_MUTEX_RECURSIVE);
-    //     if(err != 0) {
-    //       throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
-    //     }
-    
-    //init mutex in map
-    err = pthread_mutex_init(&m_access, &attr);
     if(err != 0) {
       throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
     }
     
   }
+
+
+  CASTWMPermissionsMap::~CASTWMPermissionsMap() {
+    for(unsigned int i = 0; i < STRIPE_COUNT; ++i) {
+      //any threads have gone by now, but callbacks may be left
+      for(PermissionsMap::iterator j = m_stripes[i].m_permissionsMap.begin();
+          j != m_stripes[i].m_permissionsMap.end(); ++j) {
+        for(list<Waiter *>::iterator w = j->second.m_queue.begin();
+            w != j->second.m_queue.end(); ++w) {
+          if((*w)->m_callback) {
+            delete *w;
+          }
+        }
+      }
+      pthread_cond_destroy(&(m_stripes[i].m_unlocked));
+      pthread_mutex_destroy(&(m_stripes[i].m_access));
+    }
+    pthread_mutex_destroy(&m_statisticsAccess);
+    pthread_mutex_destroy(&m_graphAccess);
+  }
+
+
+  CASTWMPermissionsMap::Stripe & 
+  CASTWMPermissionsMap::stripe(const std::string & _id) const {
+    //FNV-1a
+    unsigned long hash = 2166136261UL;
+    for(string::const_iterator i = _id.begin(); i < _id.end(); ++i) {
+      hash ^= static_cast<unsigned char>(*i);
+      hash *= 16777619UL;
+    }
+    return m_stripes[hash % STRIPE_COUNT];
+  }
+
+
+  void CASTWMPermissionsMap::acquire(PermissionsStruct & _entry,
+                                     const std::string & _component,
+                                     const cdl::WorkingMemoryPermissions & _permissions) {
+    assert(_entry.m_lockCount == 0);
+    _entry.m_permissions = _permissions;
+    _entry.m_owner = _component;
+    _entry.m_lockCount = 1;
+    _entry.m_lockedAt = nowMicros();
+    __sync_fetch_and_add(&m_lockedCount, 1u);
+  }
+
+
+  void CASTWMPermissionsMap::release(Stripe & _stripe, 
+                                     const std::string & _id,
+                                     PermissionsStruct & _entry,
+                                     CallbackList & _granted) {
+    assert(_entry.m_lockCount > 0);
+
+    long long now = nowMicros();
+    {
+      LockStatistics & stats(statistics(_entry));
+      lockMutex(&m_statisticsAccess);
+      ++stats.holdTimes[bucket(now - _entry.m_lockedAt)];
+      unlockMutex(&m_statisticsAccess);
+    }
+
+    if(_entry.m_queue.empty()) {
+      _entry.m_permissions = cdl::UNLOCKED;
+      _entry.m_owner = "";
+      _entry.m_lockCount = 0;
+      __sync_fetch_and_sub(&m_lockedCount, 1u);
+      return;
+    }
+
+    //hand straight over so nobody can barge in ahead of the queue
+    Waiter * next = _entry.m_queue.front();
+    _entry.m_queue.pop_front();
+    _entry.m_permissions = next->m_permissions;
+    _entry.m_owner = next->m_component;
+    _entry.m_lockCount = 1;
+    _entry.m_lockedAt = now;
+
+    recordWait(_entry, now - next->m_waitStart, false);
+    endWait(next->m_component, _id, 
+            _entry.m_queue.empty() ? string() : _entry.m_owner);
+
+    if(next->m_callback) {
+      _granted.push_back(next->m_callback);
+      delete next;
+    }
+    else {
+      next->m_granted = true;
+      //waiters for entries in the stripe share the condition
+      pthread_cond_broadcast(&_stripe.m_unlocked);
+    }
+  }
+
+
+  void CASTWMPermissionsMap::enqueue(PermissionsStruct & _entry, Waiter & _waiter) {
+    if(m_ordering == PRIORITY) {
+      for(list<Waiter *>::iterator i = _entry.m_queue.begin();
+          i != _entry.m_queue.end(); ++i) {
+        if((*i)->m_priority < _waiter.m_priority) {
+          _entry.m_queue.insert(i, &_waiter);
+          return;
+        }
+      }
+    }
+    _entry.m_queue.push_back(&_waiter);
+  }
+
+
+  void CASTWMPermissionsMap::startWait(const std::string & _component,
+                                       const std::string & _id,
+                                       const std::string & _owner) {
+    lockMutex(&m_graphAccess);
+
+    m_waitedForOwners[_id] = _owner;
+    m_waitsFor.insert(make_pair(_component, _id));
+
+    //follow who the owner is waiting for, looking for the waiter
+    vector<pair<string, string> > path;
+    set<string> visited;
+    path.push_back(make_pair(_owner, _id));
+    bool cycle = false;
+
+    while(!path.empty() && !cycle) {
+      const string owner(path.back().first);
+      if(owner == _component) {
+        cycle = true;
+        break;
+      }
+      if(!visited.insert(owner).second) {
+        path.pop_back();
+        continue;
+      }
+      //only the first entry is followed from each component, which
+      //finds any cycle as long as components wait for one entry at a
+      //time
+      multimap<string, string>::const_iterator waiting = m_waitsFor.find(owner);
+      if(waiting == m_waitsFor.end()) {
+        path.pop_back();
+        continue;
+      }
+      StringMap<string>::map::const_iterator next = m_waitedForOwners.find(waiting->second);
+      if(next == m_waitedForOwners.end()) {
+        path.pop_back();
+        continue;
+      }
+      path.push_back(make_pair(next->second, waiting->second));
+    }
+
+    if(cycle) {
+      ++m_cycles;
+      ostringstream outStream;
+      outStream<<_component;
+      for(vector<pair<string, string> >::const_iterator i = path.begin();
+          i < path.end(); ++i) {
+        outStream<<" waits for "<<i->first<<" on "<<i->second<<",";
+      }
+      log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("CASTWMPermissionsMap"));
+      LOG4CXX_WARN(logger, "Lock wait cycle: " << outStream.str());
+    }
+
+    unlockMutex(&m_graphAccess);
+  }
+
+
+  void CASTWMPermissionsMap::endWait(const std::string & _component,
+                                     const std::string & _id,
+                                     const std::string & _owner) {
+    lockMutex(&m_graphAccess);
+
+    typedef multimap<string, string>::iterator WaitIterator;
+    pair<WaitIterator, WaitIterator> range(m_waitsFor.equal_range(_component));
+    for(WaitIterator i = range.first; i != range.second; ++i) {
+      if(i->second == _id) {
+        m_waitsFor.erase(i);
+        break;
+      }
+    }
+
+    if(_owner.empty()) {
+      m_waitedForOwners.erase(_id);
+    }
+    else {
+      m_waitedForOwners[_id] = _owner;
+    }
+
+    unlockMutex(&m_graphAccess);
+  }
+
+
+  CASTWMPermissionsMap::LockStatistics & 
+  CASTWMPermissionsMap::statistics(PermissionsStruct & _entry) {
+    if(_entry.m_statistics == NULL) {
+      lockMutex(&m_statisticsAccess);
+      //map nodes don't move, so the pointer stays valid
+      _entry.m_statistics = &m_statistics[_entry.m_type];
+      unlockMutex(&m_statisticsAccess);
+    }
+    return *_entry.m_statistics;
+  }
+
+
+  void CASTWMPermissionsMap::recordWait(PermissionsStruct & _entry, 
+                                        const long long & _waited, 
+                                        bool _timedOut) {
+    LockStatistics & stats(statistics(_entry));
+    lockMutex(&m_statisticsAccess);
+    ++stats.waitTimes[bucket(_waited)];
+    if(_timedOut) {
+      ++stats.timeouts;
+    }
+    unlockMutex(&m_statisticsAccess);
+  }
+
   
   /**
    * Add an entry to the map. The entry is unlocked by default.
    * 
    * @param _id
    */
-  void CASTWMPermissionsMap::add(const std::string & _id) throw (CASTException) {
-    
-    lockMap();
-    assert (m_permissionsMap.find(_id) == m_permissionsMap.end());
-    
-    m_permissionsMap[_id].m_permissions = cdl::UNLOCKED;
-    m_permissionsMap[_id].m_owner = "";
-    m_permissionsMap[_id].m_lockCount = 0;
-    m_permissionsMap[_id].m_scheduledForDeletion = false;
-    
-    pthread_mutexattr_t attr;
-    // note: errors here are very unlikely, so we just do a "weaker" overall
-    // checking
-    int err =  pthread_mutexattr_init(&attr);
-    if(err != 0) {
-      throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
-    }
-    
-#ifdef __LINUX__    
-    //nah: this doesn't work, and isn't necessary, on macs for some reason
-    err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
-    if(err != 0) {
-      unlockMap();
-      throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
-    }
-#endif
-    
-    //init mutex in map
-    err = pthread_mutex_init(&(m_permissionsMap[_id].m_mutex), &attr);
-    if(err != 0) {
-      unlockMap();
-      throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
-    }
-    
-    unlockMap();
+  void CASTWMPermissionsMap::add(const std::string & _id,
+                                 const std::string & _type) throw (CASTException) {
+    
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    assert (s.m_permissionsMap.find(_id) == s.m_permissionsMap.end());
+    
+    PermissionsStruct & entry(s.m_permissionsMap[_id]);
+    entry.m_permissions = cdl::UNLOCKED;
+    entry.m_owner = "";
+    entry.m_lockCount = 0;
+    entry.m_type = _type;
+    entry.m_statistics = NULL;
+    entry.m_lockedAt = 0;
   }
   
   /**
@@ -91,59 +314,155 @@ namespace cast {
   void CASTWMPermissionsMap::lock(const std::string & _id, 
                                   const std::string & _component,
                                   const cdl::WorkingMemoryPermissions & _permissions) throw(CASTException) {
+    timedLock(_id, _component, _permissions, -1);
+  }
+
+
+  CASTWMPermissionsMap::LockResult
+  CASTWMPermissionsMap::timedLock(const std::string & _id, 
+                                  const std::string & _component,
+                                  const cdl::WorkingMemoryPermissions & _permissions,
+                                  const long & _timeoutMillis,
+                                  const int & _priority) throw(CASTException) {
     
-    lockMap();
-    pthread_mutex_t * mutex = NULL;
-    //use a block to double-check we don't touch that iterator
-    //post-lock
-    {
-      //if this is an invalid entry, return;
-      if(!live(_id)) {
-        unlockMap();
-        return;
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+
+    PermissionsMap::iterator i = s.m_permissionsMap.find(_id);
+
+    //if this is an invalid entry, return
+    if(i == s.m_permissionsMap.end()) {
+      return REMOVED;
+    }
+
+    PermissionsStruct & entry(i->second);
+
+    if(entry.m_lockCount == 0) {
+      assert(entry.m_queue.empty());
+      acquire(entry, _component, _permissions);
+      recordWait(entry, 0, false);
+      return LOCKED;
+    }
+
+    //if this lock is already owned by the locking component
+    if(entry.m_owner == _component) {
+      assert(_permissions == entry.m_permissions);
+      entry.m_lockCount++;
+      cout<<"CASTWMPermissionsMap::lock recursive lock: "<<_id<<" "<<_component<<endl;
+      return LOCKED;
+    }
+
+    if(_timeoutMillis == 0) {
+      recordWait(entry, 0, true);
+      return TIMED_OUT;
+    }
+
+    timespec deadline;
+    if(_timeoutMillis > 0) {
+      timeval now;
+      gettimeofday(&now, NULL);
+      long long nanos = (now.tv_usec + (_timeoutMillis % 1000) * 1000LL) * 1000LL;
+      deadline.tv_sec = now.tv_sec + _timeoutMillis / 1000 + nanos / 1000000000LL;
+      deadline.tv_nsec = nanos % 1000000000LL;
+    }
+
+    Waiter waiter(_component, _permissions, _priority, nowMicros());
+    enqueue(entry, waiter);
+    startWait(_component, _id, entry.m_owner);
+
+    //entry must not be used after waiting, as it may have been removed
+    while(!waiter.m_granted && !waiter.m_removed) {
+      int err;
+      if(_timeoutMillis > 0) {
+        err = pthread_cond_timedwait(&s.m_unlocked, &s.m_access, &deadline);
       }
-      
-      PermissionsMap::iterator i = m_permissionsMap.find(_id);
-      
-      assert (i != m_permissionsMap.end());    
-      
-      //if this lock is already owned by the locking component
-      if(i->second.m_owner == _component) {
-        assert(_permissions == i->second.m_permissions);
-        assert(i->second.m_lockCount > 0);
-        i->second.m_lockCount++;
-        cout<<"CASTWMPermissionsMap::lock recursive lock: "<<_id<<" "<<_component<<endl;
-        unlockMap();
-        return;
+      else {
+        err = pthread_cond_wait(&s.m_unlocked, &s.m_access);
       }
-      
-      mutex = (&(i->second.m_mutex));
-      
-    }
-    unlockMap();
-    
-    //block until mutex is locked
-    lockMutex(mutex);      
-    
-    
-    lockMap();    
-    {
-      //if this is now invalid entry, return;
-      if(!live(_id)) {
-        cout<<"CASTWMPermissionsMap::unlocking dead mutex: "<<_id<<" "<<_component<<endl;
-        assert(mutex != NULL);
-        unlockMutex(mutex);
+
+      if(err == ETIMEDOUT && !waiter.m_granted && !waiter.m_removed) {
+        //still queued, so the entry is still there
+        PermissionsStruct & waited(s.m_permissionsMap.find(_id)->second);
+        waited.m_queue.remove(&waiter);
+        endWait(_component, _id, waited.m_queue.empty() ? string() : waited.m_owner);
+        recordWait(waited, nowMicros() - waiter.m_waitStart, true);
+        return TIMED_OUT;
       }
-      else {      
-        PermissionsMap::iterator i = m_permissionsMap.find(_id);
-        i->second.m_permissions = _permissions;
-        i->second.m_owner = _component;
-        i->second.m_lockCount = 1;
-        i->second.m_scheduledForDeletion = false;
+      else if(err != 0 && err != ETIMEDOUT) {
+        throw CASTException(exceptionMessage(__HERE__, "failed condition wait: %s", strerror(err)));
       }
     }
-    unlockMap();
-    
+
+    if(waiter.m_removed) {
+      cout<<"CASTWMPermissionsMap::lock entry removed while waiting: "<<_id<<" "<<_component<<endl;
+      return REMOVED;
+    }
+
+    return LOCKED;
+  }
+
+
+  CASTWMPermissionsMap::LockResult
+  CASTWMPermissionsMap::lockAsync(const std::string & _id, 
+                                  const std::string & _component,
+                                  const cdl::WorkingMemoryPermissions & _permissions,
+                                  const LockCallbackPtr & _callback,
+                                  const int & _priority) throw(CASTException) {
+    assert(_callback);
+
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+
+    PermissionsMap::iterator i = s.m_permissionsMap.find(_id);
+    if(i == s.m_permissionsMap.end()) {
+      return REMOVED;
+    }
+
+    PermissionsStruct & entry(i->second);
+
+    if(entry.m_lockCount == 0) {
+      assert(entry.m_queue.empty());
+      acquire(entry, _component, _permissions);
+      recordWait(entry, 0, false);
+      return LOCKED;
+    }
+
+    if(entry.m_owner == _component) {
+      assert(_permissions == entry.m_permissions);
+      entry.m_lockCount++;
+      return LOCKED;
+    }
+
+    enqueue(entry, *(new Waiter(_component, _permissions, _priority, 
+                                nowMicros(), _callback)));
+    startWait(_component, _id, entry.m_owner);
+    return QUEUED;
+  }
+
+
+  bool CASTWMPermissionsMap::cancelWait(const std::string & _id,
+                                        const LockCallbackPtr & _callback) {
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+
+    PermissionsMap::iterator i = s.m_permissionsMap.find(_id);
+    if(i == s.m_permissionsMap.end()) {
+      return false;
+    }
+
+    PermissionsStruct & entry(i->second);
+    for(list<Waiter *>::iterator w = entry.m_queue.begin();
+        w != entry.m_queue.end(); ++w) {
+      if((*w)->m_callback == _callback) {
+        Waiter * waiter = *w;
+        entry.m_queue.erase(w);
+        endWait(waiter->m_component, _id, entry.m_queue.empty() ? string() : entry.m_owner);
+        recordWait(entry, nowMicros() - waiter->m_waitStart, true);
+        delete waiter;
+        return true;
+      }
+    }
+    return false;
   }
   
   /**
@@ -155,32 +474,35 @@ namespace cast {
                                     const std::string & _component) 
   throw (CASTException) {
     
-    lockMap();
-    PermissionsMap::iterator i = m_permissionsMap.find(_id);    
-    if (i == m_permissionsMap.end()) {
-      //      cout<<"CASTWMPermissionsMap::unlock leaving deleted item: "<<_id<<" "<<_component<<endl;
-    }
-    else if(i->second.m_lockCount == 0) {
-      cout<<"CASTWMPermissionsMap::unlock leaving unlocked item: "<<_id<<" "<<_component<<endl;
-    }
-    else if(i->second.m_lockCount > 1) {
-      assert (i->second.m_owner ==_component);      
-      cout<<"CASTWMPermissionsMap::unlock reduce recursive lock: "<<_id<<" "<<_component<<endl;
-      i->second.m_lockCount--;
-    }
-    else {
+    CallbackList granted;
+    {
+      Stripe & s(stripe(_id));
+      StripeLock lock(s);
+
+      PermissionsMap::iterator i = s.m_permissionsMap.find(_id);    
+      if (i == s.m_permissionsMap.end()) {
+        //      cout<<"CASTWMPermissionsMap::unlock leaving deleted item: "<<_id<<" "<<_component<<endl;
+      }
+      else if(i->second.m_lockCount == 0) {
+        cout<<"CASTWMPermissionsMap::unlock leaving unlocked item: "<<_id<<" "<<_component<<endl;
+      }
+      else if(i->second.m_lockCount > 1) {
+        assert (i->second.m_owner ==_component);      
+        cout<<"CASTWMPermissionsMap::unlock reduce recursive lock: "<<_id<<" "<<_component<<endl;
+        i->second.m_lockCount--;
+      }
+      else {
       
-      if (!deleteAllowed(i->second.m_permissions)) {
-        assert (i->second.m_owner ==_component);            
+        if (!deleteAllowed(i->second.m_permissions)) {
+          assert (i->second.m_owner ==_component);            
+        }
+        release(s, _id, i->second, granted);
       }
-      i->second.m_permissions = cdl::UNLOCKED;
-      i->second.m_owner = "";
-      i->second.m_lockCount = 0;
-      unlockMutex(&(i->second.m_mutex));
     }
-    unlockMap();
-    
-    
+
+    for(CallbackList::iterator i = granted.begin(); i < granted.end(); ++i) {
+      (*i)->locked();
+    }
   }
   
   
@@ -196,40 +518,31 @@ namespace cast {
                                      const cdl::WorkingMemoryPermissions & _permissions)
   throw(CASTException) {
     
-    lockMap();
-    bool ret = false;
-    PermissionsMap::iterator i = m_permissionsMap.find(_id);    
-    //non existant or scheduled for deletion, disallow
-    if (i == m_permissionsMap.end() || i->second.m_scheduledForDeletion) {
-      ret = false;
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+
+    PermissionsMap::iterator i = s.m_permissionsMap.find(_id);    
+    //non existant, disallow
+    if (i == s.m_permissionsMap.end()) {
+      return false;
     }
     //if already locked by someone else, say not
     else if (i->second.m_lockCount > 0 && i->second.m_owner != _component) {
-      ret = false;
+      return false;
+    }
+    //if we already actually hold the lock
+    else if(i->second.m_lockCount > 0) {
+      assert(i->second.m_permissions == _permissions);
+      i->second.m_lockCount++;
+      cout<<"CASTWMPermissionsMap::tryLock recursive lock: "<<_id<<" "<<_component<<endl;
     }
-    //else we know that locking is fine here
+    //otherwise setup the details and lock away
     else {
-      //if we already actually hold the lock
-      if(i->second.m_lockCount > 0) {
-        assert(i->second.m_permissions == _permissions);
-        i->second.m_lockCount++;
-        cout<<"CASTWMPermissionsMap::tryLock recursive lock: "<<_id<<" "<<_component<<endl;
-      }
-      //otherwise setup the details and lock away
-      else {
-        cout<<"CASTWMPermissionsMap::tryLock normal lock: "<<_id<<" "<<_component<<endl;
-        lockMutex(&(i->second.m_mutex));
-        i->second.m_permissions = _permissions;
-        i->second.m_owner = _component;
-        i->second.m_lockCount = 1;
-        i->second.m_scheduledForDeletion = false;
-      }
-      ret = true;      
+      cout<<"CASTWMPermissionsMap::tryLock normal lock: "<<_id<<" "<<_component<<endl;
+      acquire(i->second, _component, _permissions);
     }
-    
-    unlockMap();
-    return ret;
-    
+
+    return true;
   }
   
   /**
@@ -238,16 +551,16 @@ namespace cast {
    * @param _id
    * @return
    */
-  bool CASTWMPermissionsMap::isLocked(const std::string & _id)  {
-    lockMap();
-    PermissionsMap::iterator i = m_permissionsMap.find(_id);    
-    bool ret = false;
-    //if in the map, it's locked if lock count > 0
-    if(i != m_permissionsMap.end()) {
-      ret = i->second.m_lockCount > 0;
+  bool CASTWMPermissionsMap::isLocked(const std::string & _id) const {
+    if(!anyLocked()) {
+      return false;
     }
-    unlockMap();
-    return ret;
+
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    PermissionsMap::const_iterator i = s.m_permissionsMap.find(_id);    
+    //if in the map, it's locked if lock count > 0
+    return i != s.m_permissionsMap.end() && i->second.m_lockCount > 0;
   }
   
   /**
@@ -259,30 +572,17 @@ namespace cast {
   bool CASTWMPermissionsMap::isLockHolder(const std::string & _id, 
                                           const std::string & _component) const {
     
-    lockMap();
-    PermissionsMap::const_iterator i = m_permissionsMap.find(_id);    
-    bool ret = false;
-    if(i != m_permissionsMap.end()) {
-      ret = (_component == i->second.m_owner);
-    }
-    unlockMap();
-    return ret;
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    PermissionsMap::const_iterator i = s.m_permissionsMap.find(_id);    
+    return i != s.m_permissionsMap.end() && _component == i->second.m_owner;
   }
   
   bool CASTWMPermissionsMap::contains(const std::string & _id) const {
     
-    lockMap();
-    PermissionsMap::const_iterator i = m_permissionsMap.find(_id);    
-    //default false
-    bool ret = false;
-    //if it's still in the map then only return true if not scheduled
-    //for deletion
-    if(i != m_permissionsMap.end()) {
-      ret = !(i->second.m_scheduledForDeletion);
-    }    
-    unlockMap();
-    
-    return ret;
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    return s.m_permissionsMap.find(_id) != s.m_permissionsMap.end();
   }
   
   /**
@@ -293,67 +593,86 @@ namespace cast {
    */
   cdl::WorkingMemoryPermissions CASTWMPermissionsMap::getPermissions(const std::string & _id) const {
     
-    lockMap();
-    PermissionsMap::const_iterator i = m_permissionsMap.find(_id);       
-    if(i == m_permissionsMap.end() || i->second.m_scheduledForDeletion) {
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    PermissionsMap::const_iterator i = s.m_permissionsMap.find(_id);       
+    if(i == s.m_permissionsMap.end()) {
       cout<<"CASTWMPermissionsMap::getPermissions: returning on missing entry"<<_id<<endl;
-      unlockMap();
       return cdl::DOESNOTEXIST;
     }
     
-    const cdl::WorkingMemoryPermissions & perms(i->second.m_permissions);
-    
-    unlockMap();
-    
-    return perms;
+    return i->second.m_permissions;
   }
   
   void CASTWMPermissionsMap::remove(const std::string & _id) {
     
-    lockMap();    
+    CallbackList removed;
+    {
+      Stripe & s(stripe(_id));
+      StripeLock lock(s);
     
-    PermissionsMap::iterator i = m_permissionsMap.find(_id);       
-    if(i == m_permissionsMap.end()) {
-      cout<<"CASTWMPermissionsMap::remove: returning on missing entry"<<_id<<endl;
-      unlockMap();
-      return;
-    }
-    //if it's not locked, then no problem
-    else if(i->second.m_lockCount == 0) {
-      m_permissionsMap.erase(i);
-      unlockMap();
-      return;
-    }
-    //if it is locked, then schedule it for deletion
-    else {
-       log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("CASTWMPermissionsMap"));
-		LOG4CXX_WARN(logger, "Deleting WM entry " << _id << " which has "
-			<< i->second.m_lockCount << " remaining lock(s)");
+      PermissionsMap::iterator i = s.m_permissionsMap.find(_id);       
+      if(i == s.m_permissionsMap.end()) {
+        cout<<"CASTWMPermissionsMap::remove: returning on missing entry"<<_id<<endl;
+        return;
+      }
 
+      PermissionsStruct & entry(i->second);
 
-  	  i->second.m_scheduledForDeletion = true;
-	  i->second.m_lockCount = 0;		
-      unlockMutex(&(i->second.m_mutex));
-    
-	
+      if(entry.m_lockCount > 0) {
+        log4cxx::LoggerPtr logger(log4cxx::Logger::getLogger("CASTWMPermissionsMap"));
+        LOG4CXX_WARN(logger, "Deleting WM entry " << _id << " which has "
+                     << entry.m_lockCount << " remaining lock(s)");
+        __sync_fetch_and_sub(&m_lockedCount, 1u);
+      }
+
+      //anyone waiting finds the entry gone
+      if(!entry.m_queue.empty()) {
+        for(list<Waiter *>::iterator w = entry.m_queue.begin();
+            w != entry.m_queue.end(); ++w) {
+          endWait((*w)->m_component, _id, string());
+          if((*w)->m_callback) {
+            removed.push_back((*w)->m_callback);
+            delete *w;
+          }
+          else {
+            (*w)->m_removed = true;
+          }
+        }
+        pthread_cond_broadcast(&s.m_unlocked);
+      }
 
-      //once we hget here the map is locked and the lock count is 0, so
-      //we're good to go again
-      m_permissionsMap.erase(i);
-      unlockMap();       
-	}
+      s.m_permissionsMap.erase(i);
+    }
+
+    for(CallbackList::iterator i = removed.begin(); i < removed.end(); ++i) {
+      (*i)->removed();
+    }
   }
   
-  const std::string & CASTWMPermissionsMap::getLockHolder(const std::string & _id) const {
-    
-    lockMap();
-    PermissionsMap::const_iterator i = m_permissionsMap.find(_id);           
-    assert (i != m_permissionsMap.end());    
-    const std::string & holder(i->second.m_owner);    
-    unlockMap();
+  std::string CASTWMPermissionsMap::getLockHolder(const std::string & _id) const {
     
-    return holder;
+    Stripe & s(stripe(_id));
+    StripeLock lock(s);
+    PermissionsMap::const_iterator i = s.m_permissionsMap.find(_id);           
+    assert (i != s.m_permissionsMap.end());    
+    return i->second.m_owner;
+  }
+
+
+  void CASTWMPermissionsMap::getStatistics(LockStatisticsMap & _statistics) const {
+    lockMutex(&m_statisticsAccess);
+    _statistics = m_statistics;
+    unlockMutex(&m_statisticsAccess);
+  }
+
+
+  unsigned long CASTWMPermissionsMap::getCycleCount() const {
+    lockMutex(&m_graphAccess);
+    unsigned long cycles = m_cycles;
+    unlockMutex(&m_graphAccess);
+    return cycles;
   }
   
   
-} 
+}
@@ -26,30 +26,165 @@
 #include <cast/core/StringMap.hpp>
 #include <cast/core/CASTUtils.hpp>
 
+#include <IceUtil/Handle.h>
+#include <IceUtil/Shared.h>
+
 #include <cassert>
+#include <list>
+#include <map>
+#include <vector>
+#include <pthread.h>
  
 namespace cast {
  
+  /**
+   * Lock state of working memory entries. Entries are spread over a
+   * fixed set of stripes, each with its own mutex, so operations on
+   * different entries rarely contend. Threads waiting for a lock wait
+   * on their stripe's condition variable, so an entry which is never
+   * locked costs only its map slot.
+   *
+   * Each locked entry keeps its waiters in a queue, and an unlock
+   * hands the lock straight to the waiter at the front. Waiters are
+   * queued in arrival order or by priority. A waiter is either a
+   * thread blocked in timedLock, or a callback queued by lockAsync
+   * which holds no thread while it waits. Components waiting on
+   * each other are tracked, and a cycle is logged as a warning when
+   * a wait would complete it.
+   */
   class CASTWMPermissionsMap {
 
+  public:
+
+    enum WaitOrdering {
+      ///waiters get the lock in the order they asked for it
+      FIFO,
+      ///waiters with a higher priority go first, otherwise FIFO
+      PRIORITY
+    };
+
+    enum LockResult {
+      LOCKED,
+      TIMED_OUT,
+      ///the entry does not exist, or was removed while waiting
+      REMOVED,
+      ///lockAsync queued the callback
+      QUEUED
+    };
+
+    /**
+     * Told the outcome of a wait queued by lockAsync. Exactly one of
+     * the methods is called, never with the map locked, and from the
+     * thread which unlocked or removed the entry.
+     */
+    class LockCallback : public virtual IceUtil::Shared {
+    public:
+      virtual ~LockCallback() {}
+      ///the caller now holds the lock
+      virtual void locked() = 0;
+      ///the entry was removed while waiting
+      virtual void removed() = 0;
+    };
+
+    typedef IceUtil::Handle<LockCallback> LockCallbackPtr;
+
+    /**
+     * Lock hold and wait times for a type of entry, in microseconds.
+     * Bucket 0 counts times under 1, and bucket i > 0 counts times
+     * in [2^(i-1), 2^i). The last bucket also counts anything longer.
+     */
+    struct LockStatistics {
+      static const unsigned int BUCKETS = 32;
+      LockStatistics();
+      unsigned long holdTimes[BUCKETS];
+      unsigned long waitTimes[BUCKETS];
+      unsigned long timeouts;
+    };
+
+    typedef std::map<std::string, LockStatistics> LockStatisticsMap;
+
   private:
+
+    /**
+     * A thread waiting in timedLock, which lives on that thread's
+     * stack, or a callback from lockAsync, which lives on the heap
+     * and is deleted by the map when its wait ends.
+     */
+    struct Waiter {
+      Waiter(const std::string & _component,
+	     const cdl::WorkingMemoryPermissions & _permissions,
+	     const int & _priority,
+	     const long long & _waitStart,
+	     const LockCallbackPtr & _callback = 0) :
+	m_component(_component),
+	m_permissions(_permissions),
+	m_priority(_priority),
+	m_waitStart(_waitStart),
+	m_callback(_callback),
+	m_granted(false),
+	m_removed(false) {}
+      std::string m_component;
+      cdl::WorkingMemoryPermissions m_permissions;
+      int m_priority;
+      ///when the wait started, in microseconds
+      long long m_waitStart;
+      ///null for a thread
+      LockCallbackPtr m_callback;
+      ///set when the lock has been handed to this waiter
+      bool m_granted;
+      ///set if the entry is removed while waiting
+      bool m_removed;
+    };
     
     struct PermissionsStruct {
       cdl::WorkingMemoryPermissions m_permissions;
-      pthread_mutex_t m_mutex;
       std::string m_owner;
       unsigned int m_lockCount;
-      bool m_scheduledForDeletion;
+      ///type of the entry, for statistics
+      std::string m_type;
+      ///found when the entry is first locked
+      LockStatistics * m_statistics;
+      ///when the current lock was taken, in microseconds
+      long long m_lockedAt;
+      ///waiting for this entry, next in line first
+      std::list<Waiter *> m_queue;
     };
 
     typedef StringMap<PermissionsStruct>::map PermissionsMap;
 
-    PermissionsMap m_permissionsMap;
+    struct Stripe {
+      PermissionsMap m_permissionsMap;
+      pthread_mutex_t m_access;
+      ///signalled when a waited-for entry in this stripe is unlocked or removed
+      pthread_cond_t m_unlocked;
+    };
+
+    static const unsigned int STRIPE_COUNT = 64;
+
+    mutable Stripe m_stripes[STRIPE_COUNT];
+
+    ///number of entries with a lock count > 0
+    volatile unsigned int m_lockedCount;
 
-    mutable pthread_mutex_t m_access;
+    WaitOrdering m_ordering;
 
+    ///statistics by entry type, protected by m_statisticsAccess
+    LockStatisticsMap m_statistics;
+    mutable pthread_mutex_t m_statisticsAccess;
 
-    void lockMutex(pthread_mutex_t * _mutex) const {
+    //who waits for whom, only for entries with waiters. Protected by
+    //m_graphAccess, which is only ever taken with a stripe locked.
+
+    ///current owner of each entry with waiters
+    StringMap<std::string>::map m_waitedForOwners;
+    ///component to the ids of entries it is waiting for
+    std::multimap<std::string, std::string> m_waitsFor;
+    unsigned long m_cycles;
+    mutable pthread_mutex_t m_graphAccess;
+
+    Stripe & stripe(const std::string & _id) const;
+
+    static void lockMutex(pthread_mutex_t * _mutex) {
       assert(_mutex != NULL);
       int err = pthread_mutex_lock(_mutex);
       if(err != 0) {
@@ -59,7 +194,7 @@ namespace cast {
       }
     }
 
-    void unlockMutex(pthread_mutex_t * _mutex) const {
+    static void unlockMutex(pthread_mutex_t * _mutex) {
       assert(_mutex != NULL);
       int err = pthread_mutex_unlock(_mutex);       
       if(err != 0) {
@@ -69,40 +204,90 @@ namespace cast {
       }      
     }
 
-  
-    void lockMap() const {
-      lockMutex(&m_access);
-    }
-    
-    void unlockMap() const {
-      unlockMutex(&m_access);
-    }
-
-    bool live(const std::string & _id) const {
-      PermissionsMap::const_iterator i = m_permissionsMap.find(_id);
-      if(i != m_permissionsMap.end()) {
-	return !(i->second.m_scheduledForDeletion);
+    /**
+     * Locks a stripe for the lifetime of the object.
+     */
+    class StripeLock {
+    public:
+      StripeLock(Stripe & _stripe) : 
+	m_stripe(_stripe) {
+	lockMutex(&m_stripe.m_access);
       }
-      else {
-	return false;
+      ~StripeLock() {
+	unlockMutex(&m_stripe.m_access);
       }
-    }
+    private:
+      Stripe & m_stripe;
+    };
+
+    /**
+     * Take the lock on an entry which is not locked.
+     */
+    void acquire(PermissionsStruct & _entry,
+		 const std::string & _component,
+		 const cdl::WorkingMemoryPermissions & _permissions);
+
+    typedef std::vector<LockCallbackPtr> CallbackList;
+
+    /**
+     * Clear the lock on an entry, handing it to the next waiter if
+     * there is one. If the next waiter is a callback, it is added to
+     * _granted to be called once the stripe is unlocked.
+     */
+    void release(Stripe & _stripe, 
+		 const std::string & _id,
+		 PermissionsStruct & _entry,
+		 CallbackList & _granted);
+
+    void enqueue(PermissionsStruct & _entry, Waiter & _waiter);
+
+    /**
+     * Record that _component is waiting for _id, held by _owner, and
+     * report it if this completes a cycle.
+     */
+    void startWait(const std::string & _component,
+		   const std::string & _id,
+		   const std::string & _owner);
+
+    /**
+     * Record that _component is no longer waiting for _id. _owner is
+     * the entry's owner if other components are still waiting for
+     * it, or empty.
+     */
+    void endWait(const std::string & _component,
+		 const std::string & _id,
+		 const std::string & _owner);
+
+    LockStatistics & statistics(PermissionsStruct & _entry);
+
+    void recordWait(PermissionsStruct & _entry, const long long & _waited, bool _timedOut);
 
   public: 
     
     CASTWMPermissionsMap();
-    ~CASTWMPermissionsMap() {unlockMap();};
+    ~CASTWMPermissionsMap();
 
 
     /**
      * Add an entry to the map. The entry is unlocked by default.
      * 
      * @param _id
+     * @param _type The type of the entry, used to group statistics.
+     */
+    void add(const std::string & _id, 
+	     const std::string & _type = "") throw (CASTException);
+
+    /**
+     * Set how waiters are ordered. Only waits which start after this
+     * is called are affected.
      */
-    void add(const std::string & _id) throw (CASTException);
+    void setWaitOrdering(const WaitOrdering & _ordering) {
+      m_ordering = _ordering;
+    }
     /**
      * Acquires the lock for the entry given by the id. Blocks until the lock is
-     * available.
+     * available. Returns without locking if the entry does not exist
+     * or is removed while waiting.
      * 
      * @param _id
      * @throws InterruptedException
@@ -110,6 +295,42 @@ namespace cast {
     void lock(const std::string & _id, 
 	      const std::string & _component,
 	      const cdl::WorkingMemoryPermissions & _permissions) throw(CASTException);
+
+    /**
+     * Acquires the lock for the entry given by the id, waiting for at
+     * most _timeoutMillis, or for ever if it is negative.
+     * 
+     * @param _priority Used if the wait ordering is PRIORITY.
+     */
+    LockResult timedLock(const std::string & _id, 
+			 const std::string & _component,
+			 const cdl::WorkingMemoryPermissions & _permissions,
+			 const long & _timeoutMillis,
+			 const int & _priority = 0) throw(CASTException);
+
+    /**
+     * Acquires the lock for the entry given by the id if it is
+     * available, and otherwise queues _callback to be told when it
+     * is. No thread is held while waiting.
+     * 
+     * @return LOCKED or REMOVED if the outcome is known at once, in
+     * which case _callback is not called, or QUEUED.
+     */
+    LockResult lockAsync(const std::string & _id, 
+			 const std::string & _component,
+			 const cdl::WorkingMemoryPermissions & _permissions,
+			 const LockCallbackPtr & _callback,
+			 const int & _priority = 0) throw(CASTException);
+
+    /**
+     * Stop a wait queued by lockAsync, counting it as a timeout.
+     *
+     * @return true if the wait was stopped, so the callback will not
+     * be called, or false if it has already been decided.
+     */
+    bool cancelWait(const std::string & _id,
+		    const LockCallbackPtr & _callback);
+
     /**
      * Release the lock for the entry given by the id.
      * 
@@ -154,7 +375,15 @@ namespace cast {
      * @param _id
      * @return
      */
-    bool isLocked(const std::string & _id);
+    bool isLocked(const std::string & _id) const;
+
+    /**
+     * Whether any entry is locked. This does not lock, so checks
+     * which would find nothing locked can be skipped cheaply.
+     */
+    bool anyLocked() const {
+      return m_lockedCount != 0;
+    }
 
     /**
      * Checks whether the given entry is locked.
@@ -177,7 +406,18 @@ namespace cast {
 
     void remove(const std::string & _id);
 
-    const std::string & getLockHolder(const std::string & _id) const;
+    std::string getLockHolder(const std::string & _id) const;
+
+    /**
+     * Copy the lock statistics for each type of entry that has been
+     * locked.
+     */
+    void getStatistics(LockStatisticsMap & _statistics) const;
+
+    /**
+     * The number of wait-for cycles detected.
+     */
+    unsigned long getCycleCount() const;
 
   
   };
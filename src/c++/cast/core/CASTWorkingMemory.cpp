@@ -29,9 +29,8 @@ using namespace cast::cdl;
 
 namespace cast {
 
-    CASTWorkingMemory::CASTWorkingMemory() {
-
-#ifdef SYNC_MEMORY_ACCESS
+  CASTWorkingMemory::CASTWorkingMemory(SyncStrategy _sync) :
+    m_syncStrategy(_sync) {
 
     pthread_mutexattr_t attr;
     // note: errors here are very unlikely, so we just do a "weaker" overall
@@ -60,8 +59,6 @@ namespace cast {
       throw CASTException(exceptionMessage(__HERE__, "failed to create mutex: %s", strerror(err)));
     }
 
-#endif
-
   }
 
 
@@ -73,23 +70,75 @@ namespace cast {
   }
 
 
+  bool CASTWorkingMemory::parseSyncStrategy(const string & _name, 
+					    SyncStrategy & _sync) {
+    if(_name == "none") {
+      _sync = SYNC_NONE;
+    }
+    else if(_name == "exclusive") {
+      _sync = SYNC_EXCLUSIVE;
+    }
+    else if(_name == "shared") {
+      _sync = SYNC_SHARED;
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+
   void CASTWorkingMemory::lock()  throw (CASTException) {
-#ifdef SYNC_MEMORY_ACCESS
-    //lock mutex for wait
-    int err = pthread_mutex_lock(&m_sync);
-    if(err != 0) {
-      throw CASTException(exceptionMessage(__HERE__, "failed mutex lock: %s", strerror(err)));
+    switch(m_syncStrategy) {
+    case SYNC_EXCLUSIVE: {
+      //lock mutex for wait
+      int err = pthread_mutex_lock(&m_sync);
+      if(err != 0) {
+	throw CASTException(exceptionMessage(__HERE__, "failed mutex lock: %s", strerror(err)));
+      }
+      break;
+    }
+    case SYNC_SHARED:
+      m_sharedSync.lock();
+      break;
+    case SYNC_NONE:
+      break;
     }
-#endif
   }
 
   void CASTWorkingMemory::unlock()  throw (CASTException) {
-#ifdef SYNC_MEMORY_ACCESS
-    int err = pthread_mutex_unlock(&m_sync); 
-    if(err != 0) {
-      throw CASTException(exceptionMessage(__HERE__, "failed mutex unlock: %s", strerror(err)));
+    switch(m_syncStrategy) {
+    case SYNC_EXCLUSIVE: {
+      int err = pthread_mutex_unlock(&m_sync); 
+      if(err != 0) {
+	throw CASTException(exceptionMessage(__HERE__, "failed mutex unlock: %s", strerror(err)));
+      }
+      break;
+    }
+    case SYNC_SHARED:
+      m_sharedSync.unlock();
+      break;
+    case SYNC_NONE:
+      break;
+    }
+  }
+
+  void CASTWorkingMemory::lockShared()  throw (CASTException) {
+    if(m_syncStrategy == SYNC_SHARED) {
+      m_sharedSync.lock_shared();
+    }
+    else {
+      lock();
+    }
+  }
+
+  void CASTWorkingMemory::unlockShared()  throw (CASTException) {
+    if(m_syncStrategy == SYNC_SHARED) {
+      m_sharedSync.unlock_shared();
+    }
+    else {
+      unlock();
     }
-#endif
   }
 
   /**
@@ -108,6 +157,18 @@ namespace cast {
 
   bool CASTWorkingMemory::add(const string & _id, 
 			      WorkingMemoryEntryPtr _pData) {
+    return addEntry(_id, _pData, NULL);
+  }
+
+  bool CASTWorkingMemory::add(const string & _id, 
+			      WorkingMemoryEntryPtr _pData,
+			      const vector<string> & _superTypes) {
+    return addEntry(_id, _pData, &_superTypes);
+  }
+
+  bool CASTWorkingMemory::addEntry(const string & _id, 
+				   WorkingMemoryEntryPtr _pData,
+				   const vector<string> * _superTypes) {
   
     assert(_pData->version == 0);
 
@@ -125,10 +186,13 @@ namespace cast {
     if(i == m_storage.end()) {
     
       //store the data
-      m_storage[_id] = _pData;
+      WMStoredEntry & stored(m_storage[_id]);
+      stored.entry = _pData;
     
       //store the key in addition order
       m_ids.push_front(_id);
+      stored.recency = m_ids.begin();
+      index(_id, _pData->type, _superTypes, stored);
 
       //     cout<<endl;
       //     cout<<"CASTWorkingMemory data ptr: count: "<<_pData.use_count()<<endl;
@@ -140,7 +204,7 @@ namespace cast {
       if(j != m_lastVersions.end()) {
 
 	//if stored before, new version is last version + 1
-	m_storage[_id]->version = (j->second + 1);
+	stored.entry->version = (j->second + 1);
 
 	//cout<<"updated stored version from last version: "<<getOverwriteCount(_id)<<endl;
 	//erase last version from map
@@ -170,6 +234,18 @@ namespace cast {
    */
   bool CASTWorkingMemory::overwrite(const string &  _id, 
 				    WorkingMemoryEntryPtr _pData) {
+    return overwriteEntry(_id, _pData, NULL);
+  }
+
+  bool CASTWorkingMemory::overwrite(const string &  _id, 
+				    WorkingMemoryEntryPtr _pData,
+				    const vector<string> & _superTypes) {
+    return overwriteEntry(_id, _pData, &_superTypes);
+  }
+
+  bool CASTWorkingMemory::overwriteEntry(const string &  _id, 
+					 WorkingMemoryEntryPtr _pData,
+					 const vector<string> * _superTypes) {
 
     lock();
 
@@ -180,14 +256,22 @@ namespace cast {
     //if the id exists
     if(i != m_storage.end()) {
     
+      WMStoredEntry & stored(i->second);
+
       //increment overwrite version
-      _pData->version = i->second->version + 1;
+      _pData->version = stored.entry->version + 1;
+
+      if(_superTypes || stored.entry->type != _pData->type) {
+	//reindex, keeping the previous super types if none were given
+	unindex(stored, _superTypes != NULL);
+	index(_id, _pData->type, _superTypes, stored);
+      }
+
       //store the data in the same place in the map
-      i->second = _pData; 
+      stored.entry = _pData; 
 
-      //move key to front of list
-      m_ids.remove(_id);
-      m_ids.push_front(_id);
+      //move key to front of lists
+      touch(stored);
 
       overwritten = true;
       //    cout<<"data overwritten"<<endl;
@@ -217,14 +301,15 @@ namespace cast {
     //if the id exists
     if(i != m_storage.end()) {
 
-      pItem = i->second;
+      pItem = i->second.entry;
     
+      //remove key 
+      m_ids.erase(i->second.recency);
+      unindex(i->second, true);
+
       //and remove from storage
       m_storage.erase(i);
 
-      //remove key 
-      m_ids.remove(_id);
-
       //store last version
       m_lastVersions[_id] = pItem->version;      
     }
@@ -244,7 +329,7 @@ namespace cast {
   WorkingMemoryEntryPtr
   CASTWorkingMemory::get(const string &  _id) {
 
-    lock();
+    lockShared();
 
     //check whether the id exists
     WMItemMap::iterator i = m_storage.find(_id);
@@ -252,11 +337,11 @@ namespace cast {
     
     //if the id exists
     if(i != m_storage.end()) {
-      item = i->second;
+      item = i->second.entry;
     }
 
     //cerr<<"entry not in wm: "<<_id<<endl;
-    unlock();
+    unlockShared();
     
     return item;
 
@@ -265,21 +350,21 @@ namespace cast {
 
   bool CASTWorkingMemory::contains(const string &  _id) {
 
-    lock();
+    lockShared();
     //cout<<"contains: "<<_id<<endl;
     //check whether the id exists
     WMItemMap::iterator i = m_storage.find(_id);
     //cout<<"contains: "<<(i != m_storage.end())<<endl;
     bool contains = (i != m_storage.end());
 
-    unlock();
+    unlockShared();
 
     return contains;
   }
 
   bool CASTWorkingMemory::hasContained(const string &  _id) {    
  
-    lock();
+    lockShared();
 
     bool hasContained = false;
 
@@ -294,7 +379,7 @@ namespace cast {
       hasContained = (i != m_lastVersions.end());
     }
 
-    unlock();
+    unlockShared();
 
     return hasContained;
 
@@ -306,15 +391,15 @@ namespace cast {
    */
   int CASTWorkingMemory::getOverwriteCount(const string &  _id) {
 
-    lock();
+    lockShared();
 
     int count = -1; //TODO smarter default?
 
     //check whether the id exists
     WMItemMap::iterator i = m_storage.find(_id);
     if(i != m_storage.end()) {
-      //cout<<"stored version: "<<_id<<" "<<i->second->version<<endl;
-      count =  i->second->version;
+      //cout<<"stored version: "<<_id<<" "<<i->second.entry->version<<endl;
+      count =  i->second.entry->version;
     }
     else {
       VersionMap::const_iterator j = m_lastVersions.find(_id);
@@ -325,7 +410,7 @@ namespace cast {
     }
 
     //cout<<"never version: "<<_id<<" "<<-1<<endl;
-    unlock();
+    unlockShared();
 
     //TODO make smarter?
     return count;
@@ -346,48 +431,33 @@ namespace cast {
   CASTWorkingMemory::getIDsByType(const string & _type,
 				  const int & _count,
 				  vector<string> &_ids) {
+    lockShared();  
+    getIndexed(m_typeIndex, _type, _count, _ids);
+    unlockShared();
+  }
 
-    lock();  
-
-    int total; 
-
-    if (_count == 0) {
-      total = m_storage.size();
-    }
-    else {
-      total = _count;
-    }
-
-    int count = 0;
-
-    for(StringList::iterator i = m_ids.begin();
-	i != m_ids.end();
-	i++) {
-
-      WMItemMap::iterator j = m_storage.find(*i);
-
-      if(j != m_storage.end()) {
-	if(j->second->type == _type) {
-	  _ids.push_back(*i);
-	  count++;
-	}
-
-	//will always be at least 1
-	if(count == total) {
-	  break;
-	}
-      }
-      else {
-	assert(false);
-      }
-    }
-
-    unlock();
 
+  /**
+   * Gets the n most recent ids of entries which have the given type
+   * anywhere in their type hierarchy.
+   * 
+   * @param _type
+   *            The type to check.
+   * @param _count
+   *            The number of ids to return. If 0 all matching items
+   *            are return.
+   * @return All matching items.
+   */
+  void
+  CASTWorkingMemory::getIDsBySuperType(const string & _type,
+				       const int & _count,
+				       vector<string> &_ids) {
+    lockShared();  
+    getIndexed(m_superTypeIndex, _type, _count, _ids);
+    unlockShared();
   }
 
 
-
   /**
    * Get all working memory entries with given type.
    * 
@@ -419,43 +489,134 @@ namespace cast {
 			       const int & _count,
 			       vector< WorkingMemoryEntryPtr > & _items)  {
 
-    lock();
+    lockShared();
 
-    int total; 
+    vector<string> ids;
+    getIndexed(m_typeIndex, _type, _count, ids);
 
-    if (_count == 0) {
-      total = m_storage.size();
-    }
-    else {
-      total = _count;
+    for(vector<string>::const_iterator i = ids.begin();
+	i < ids.end(); ++i) {
+      WMItemMap::iterator j = m_storage.find(*i);
+      assert(j != m_storage.end());
+      _items.push_back(j->second.entry);
     }
 
-    int count = 0;
+    unlockShared();
+  }
 
-    for(StringList::iterator i = m_ids.begin();
-	i != m_ids.end();
-	i++) {
 
+  /**
+   * Get a collection of memory items which have the given type
+   * anywhere in their type hierarchy.
+   * 
+   * @param _type
+   *            The type to check.
+   * @param _count
+   *            The number of entries to return. If 0 all matching
+   *            entries are returned.
+   * @return A collection of matching entries.
+   */
+  void
+  CASTWorkingMemory::getBySuperType(const string & _type, 
+				    const int & _count,
+				    vector< WorkingMemoryEntryPtr > & _items)  {
+
+    lockShared();
+
+    vector<string> ids;
+    getIndexed(m_superTypeIndex, _type, _count, ids);
+
+    for(vector<string>::const_iterator i = ids.begin();
+	i < ids.end(); ++i) {
       WMItemMap::iterator j = m_storage.find(*i);
+      assert(j != m_storage.end());
+      _items.push_back(j->second.entry);
+    }
 
-      if(j != m_storage.end()) {
+    unlockShared();
+  }
 
-	if(j->second->type == _type) {
-	  _items.push_back(j->second);
-	  //cout<<"returning id: "<<*i<<endl;
-	  count++;
-	}
 
-	//will always be at least 1
-	if(count == total) {
-	  break;
-	}
+  void 
+  CASTWorkingMemory::index(const string & _id, 
+			   const string & _type,
+			   const vector<string> * _superTypes,
+			   WMStoredEntry & _stored) {
+
+    StringList & typeIDs(m_typeIndex[_type]);
+    typeIDs.push_front(_id);
+    _stored.type = ListPosition(&typeIDs, typeIDs.begin());
+
+    if(_superTypes) {
+      _stored.superTypes.reserve(_superTypes->size());
+      for(vector<string>::const_iterator i = _superTypes->begin();
+	  i < _superTypes->end(); ++i) {
+	StringList & superTypeIDs(m_superTypeIndex[*i]);
+	superTypeIDs.push_front(_id);
+	_stored.superTypes.push_back(ListPosition(&superTypeIDs, 
+						  superTypeIDs.begin()));
       }
-      else {
-	assert(false);
+    }
+  }
+
+
+  void 
+  CASTWorkingMemory::unindex(WMStoredEntry & _stored, 
+			     bool _superTypes) {
+
+    //empty lists are left in the indexes as the number of types is
+    //small, and this keeps the stored list pointers valid
+    _stored.type.first->erase(_stored.type.second);
+
+    if(_superTypes) {
+      for(vector<ListPosition>::iterator i = _stored.superTypes.begin();
+	  i < _stored.superTypes.end(); ++i) {
+	i->first->erase(i->second);
+      }
+      _stored.superTypes.clear();
+    }
+  }
+
+
+  void 
+  CASTWorkingMemory::touch(WMStoredEntry & _stored) {
+
+    //splice does not invalidate the stored iterators
+    m_ids.splice(m_ids.begin(), m_ids, _stored.recency);
+
+    StringList * typeIDs = _stored.type.first;
+    typeIDs->splice(typeIDs->begin(), *typeIDs, _stored.type.second);
+
+    for(vector<ListPosition>::iterator i = _stored.superTypes.begin();
+	i < _stored.superTypes.end(); ++i) {
+      i->first->splice(i->first->begin(), *(i->first), i->second);
+    }
+  }
+
+
+  void 
+  CASTWorkingMemory::getIndexed(const TypeIndex & _index,
+				const string & _type,
+				const int & _count,
+				vector<string> &_ids) const {
+
+    TypeIndex::const_iterator i = _index.find(_type);
+    if(i == _index.end()) {
+      return;
+    }
+
+    //list::size may be linear, so count down from _count instead
+    const StringList & ids = i->second;
+    int remaining = _count;
+    
+    for(StringList::const_iterator j = ids.begin();
+	j != ids.end();
+	++j) {
+      _ids.push_back(*j);
+      if(--remaining == 0) {
+	break;
       }
     }
-    unlock();
   }
 
 
@@ -23,10 +23,6 @@
 #ifndef CAST_CAST_WORKING_MEMORY_H_
 #define CAST_CAST_WORKING_MEMORY_H_
 
-//for testing purposed... comment out to remove sync access to wm
-#define SYNC_MEMORY_ACCESS
-
-
 #include <cast/core/CASTWorkingMemoryInterface.hpp>
 
 #include <cast/core/StringMap.hpp>
@@ -35,22 +31,86 @@
 #include <map> 
 #include <list>
 
+#include <boost/thread/shared_mutex.hpp>
+
 
 namespace cast {
 
-  typedef StringMap<cdl::WorkingMemoryEntryPtr >::map WMItemMap;
   typedef StringMap<int>::map VersionMap;
   typedef std::list < std::string > StringList;
+  typedef StringMap<StringList>::map TypeIndex;
+
+  /**
+   * A position of an id in one of the recency ordered lists. Elements
+   * of the unordered maps are never moved, so the list pointer stays
+   * valid as long as the list is in its index.
+   */
+  typedef std::pair<StringList *, StringList::iterator> ListPosition;
+
+  /**
+   * An entry in working memory plus the positions of its id in the
+   * recency list and type indexes. This allows moving the id to the
+   * front of, or removing it from, these lists in constant time.
+   */
+  struct WMStoredEntry {
+    cdl::WorkingMemoryEntryPtr entry;
+    StringList::iterator recency;
+    ListPosition type;
+    std::vector<ListPosition> superTypes;
+  };
+
+  typedef StringMap<WMStoredEntry>::map WMItemMap;
 
   class CASTWorkingMemory: public CASTWorkingMemoryInterface {
 
   public:
 
+    /**
+     * How access to the memory is synchronised.
+     */
+    enum SyncStrategy {
+      /**
+       * No synchronisation, for when the caller already serialises
+       * writes against all other access.
+       */
+      SYNC_NONE,
+      /**
+       * A single process-shared mutex around every operation. The
+       * default.
+       */
+      SYNC_EXCLUSIVE,
+      /**
+       * A reader/writer lock, so gets, type queries and existence
+       * checks can run in parallel.
+       */
+      SYNC_SHARED
+    };
 
     /**
      * Default constructor.
      */
-    CASTWorkingMemory();
+    CASTWorkingMemory(SyncStrategy _sync = SYNC_EXCLUSIVE);
+
+    /**
+     * Change the synchronisation strategy. Must not be called while
+     * any other thread is accessing the memory.
+     */
+    void setSyncStrategy(SyncStrategy _sync) {
+      m_syncStrategy = _sync;
+    }
+
+    SyncStrategy getSyncStrategy() const {
+      return m_syncStrategy;
+    }
+
+    /**
+     * Parse a strategy from its configuration name: "none",
+     * "exclusive" or "shared".
+     *
+     * @return true if the name was recognised.
+     */
+    static bool parseSyncStrategy(const std::string & _name, 
+				  SyncStrategy & _sync);
 
     /**
      * Empty virtual destructor.
@@ -95,6 +155,25 @@ namespace cast {
     virtual bool add(const std::string & _id, 
 		     cdl::WorkingMemoryEntryPtr _pData);
 
+    /**
+     * Adds item to working memory with given id and also indexes it
+     * under all of the given super types so that it can be retreived
+     * with getBySuperType.
+     * 
+     * @param _id
+     *            The id of the entry.
+     * @param _pData
+     *            The data and type info. 
+     * @param _superTypes
+     *            The Slice type hierarchy of the entry, as returned by
+     *            ice_ids().
+     * @return Returns true if the item is added (i.e. not a duplicate
+     *         id)
+     */
+    virtual bool add(const std::string & _id, 
+		     cdl::WorkingMemoryEntryPtr _pData,
+		     const std::vector<std::string> & _superTypes);
+
     /**
      * Overwrites item with given id. Does not do anything if id does
      * not exist.
@@ -108,6 +187,23 @@ namespace cast {
     virtual bool overwrite(const std::string &  _id, 
 			   cdl::WorkingMemoryEntryPtr _pData);
 
+    /**
+     * Overwrites item with given id and reindexes it under the given
+     * super types. Does not do anything if id does not exist.
+     * 
+     * @param _id
+     *            The id of the entry.
+     * @param _pEntry
+     *            The data and type info.
+     * @param _superTypes
+     *            The Slice type hierarchy of the entry, as returned by
+     *            ice_ids().
+     * @return Returns true if the id exists for overwriting
+     */
+    virtual bool overwrite(const std::string &  _id, 
+			   cdl::WorkingMemoryEntryPtr _pData,
+			   const std::vector<std::string> & _superTypes);
+
     /**
      * Removes the item with the given id.
      * 
@@ -159,6 +255,37 @@ namespace cast {
 			      const int & _count,
 			      std::vector<std::string> &_ids);
 
+    /**
+     * Gets the n most recent ids of entries which have the given type
+     * anywhere in their type hierarchy. Only entries which were
+     * stored with their super types are considered.
+     * 
+     * @param _type
+     *            The type to check.
+     * @param _count
+     *            The number of ids to return. If 0 all matching items
+     *            are return.
+     * @return All matching items.
+     */
+    virtual void getIDsBySuperType(const std::string & _type,
+				   const int & _count,
+				   std::vector<std::string> &_ids);
+
+    /**
+     * Get a collection of memory items which have the given type
+     * anywhere in their type hierarchy.
+     * 
+     * @param _type
+     *            The type to check.
+     * @param _count
+     *            The number of entries to return. If 0 all matching
+     *            entries are returned.
+     * @return A collection of matching entries.
+     */
+    virtual void getBySuperType(const std::string & _type, 
+				const int & _count,
+				std::vector< cdl::WorkingMemoryEntryPtr > & _items);
+
     virtual int size() {return m_storage.size();}
 
     virtual void debug();
@@ -167,19 +294,71 @@ namespace cast {
 
     //need a hash_map for quick lookups
     WMItemMap m_storage;
-    //and a vector to maintain orderings
+    //and a list to maintain orderings, positions are kept in m_storage
     StringList m_ids;
     //a map containing the last version numbers of removed items
     VersionMap m_lastVersions;
+    //ids of entries by type, in the same order as m_ids
+    TypeIndex m_typeIndex;
+    //ids of entries by each of their super types, in the same order as m_ids
+    TypeIndex m_superTypeIndex;
+
 
+    SyncStrategy m_syncStrategy;
 
-#ifdef SYNC_MEMORY_ACCESS
     pthread_mutex_t m_sync;	   
-#endif
+    boost::shared_mutex m_sharedSync;
 
+    /**
+     * Lock for a modifying operation.
+     */
     void lock() throw (CASTException);
     void unlock() throw (CASTException);
 
+    /**
+     * Lock for a read only operation.
+     */
+    void lockShared() throw (CASTException);
+    void unlockShared() throw (CASTException);
+
+    bool addEntry(const std::string & _id, 
+		  cdl::WorkingMemoryEntryPtr _pData,
+		  const std::vector<std::string> * _superTypes);
+
+    bool overwriteEntry(const std::string & _id, 
+			cdl::WorkingMemoryEntryPtr _pData,
+			const std::vector<std::string> * _superTypes);
+
+    /**
+     * Adds the id to the front of the type index and, if given, the
+     * super type indexes. Must be called with the lock held.
+     */
+    void index(const std::string & _id, 
+	       const std::string & _type,
+	       const std::vector<std::string> * _superTypes,
+	       WMStoredEntry & _stored);
+
+    /**
+     * Removes the id from the type index and, if _superTypes is true,
+     * from the super type indexes. Must be called with the lock held.
+     */
+    void unindex(WMStoredEntry & _stored, bool _superTypes);
+
+    /**
+     * Moves the id to the front of all the lists it is stored in. Must
+     * be called with the lock held.
+     */
+    void touch(WMStoredEntry & _stored);
+
+    /**
+     * Copies up to _count ids from the front of the indexed list for
+     * _type. Must be called with the lock held.
+     */
+    void getIndexed(const TypeIndex & _index,
+		    const std::string & _type,
+		    const int & _count,
+		    std::vector<std::string> &_ids) const;
+
   };
 
 } // namespace cast
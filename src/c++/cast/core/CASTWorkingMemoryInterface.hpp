@@ -145,6 +145,21 @@ namespace cast {
 			      const int & _count,
 			      std::vector<std::string> &_ids) = 0;
 
+    /**
+     * Gets the n most recent ids of entries which have the given type
+     * anywhere in their type hierarchy.
+     * 
+     * @param _type
+     *            The type to check.
+     * @param _count
+     *            The number of ids to return. If 0 all matching items
+     *            are return.
+     * @return All matching items.
+     */
+    virtual void getIDsBySuperType(const std::string & _type,
+				   const int & _count,
+				   std::vector<std::string> &_ids) = 0;
+
     virtual int size() = 0;
 
   };
@@ -0,0 +1,179 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "EntryPatch.hpp"
+
+#include <cast/core/CASTUtils.hpp>
+
+#include <Ice/Stream.h>
+
+using namespace std;
+
+namespace cast {
+
+  namespace {
+
+    /**
+     * Keeps the object read from a stream.
+     */
+    class EntryReader : public Ice::ReadObjectCallback {
+    public:
+      virtual void invoke(const Ice::ObjectPtr & _object) {
+	m_entry = _object;
+      }
+      Ice::ObjectPtr m_entry;
+    };
+
+    typedef IceUtil::Handle<EntryReader> EntryReaderPtr;
+
+  }
+
+  void 
+  marshalEntry(const Ice::CommunicatorPtr & _communicator,
+	       const Ice::ObjectPtr & _entry,
+	       cdl::ByteSeq & _bytes) {
+    Ice::OutputStreamPtr out(Ice::createOutputStream(_communicator));
+    out->writeObject(_entry);
+    out->writePendingObjects();
+    out->finished(_bytes);
+  }
+
+  Ice::ObjectPtr 
+  unmarshalEntry(const Ice::CommunicatorPtr & _communicator,
+		 const cdl::ByteSeq & _bytes) {
+    Ice::InputStreamPtr in(Ice::createInputStream(_communicator, _bytes));
+    EntryReaderPtr reader(new EntryReader());
+    in->readObject(reader);
+    in->readPendingObjects();
+    return reader->m_entry;
+  }
+
+  Ice::Int
+  entryHash(const cdl::ByteSeq & _bytes) {
+    unsigned int hash = 2166136261u;
+    for(cdl::ByteSeq::const_iterator i = _bytes.begin(); i < _bytes.end(); ++i) {
+      hash ^= static_cast<unsigned char>(*i);
+      hash *= 16777619u;
+    }
+    return static_cast<Ice::Int>(hash);
+  }
+
+  bool
+  isPatchBase(const cdl::WorkingMemoryPatchPtr & _patch,
+	      const cdl::ByteSeq & _bytes) {
+    return static_cast<size_t>(_patch->baseLength) == _bytes.size()
+      && _patch->baseHash == entryHash(_bytes);
+  }
+
+  cdl::WorkingMemoryPatchPtr
+  createPatch(const cdl::ByteSeq & _base,
+	      const cdl::ByteSeq & _updated,
+	      const int _baseVersion) {
+
+    cdl::WorkingMemoryPatchPtr patch(new cdl::WorkingMemoryPatch());
+    patch->baseVersion = _baseVersion;
+    patch->baseLength = static_cast<Ice::Int>(_base.size());
+    patch->baseHash = entryHash(_base);
+    patch->length = static_cast<Ice::Int>(_updated.size());
+
+    size_t common = min(_base.size(), _updated.size());
+    size_t i = 0;
+
+    while(true) {
+
+      //skip unchanged bytes
+      while(i < common && _base[i] == _updated[i]) {
+	++i;
+      }
+      if(i >= _updated.size()) {
+	break;
+      }
+
+      //a segment ends at a run of PATCH_MERGE_GAP unchanged bytes
+      size_t start = i;
+      size_t end = i;
+      size_t same = 0;
+      while(i < _updated.size() && same < PATCH_MERGE_GAP) {
+	if(i < common && _base[i] == _updated[i]) {
+	  ++same;
+	}
+	else {
+	  same = 0;
+	  end = i + 1;
+	}
+	++i;
+      }
+
+      cdl::WorkingMemoryPatchSegment segment;
+      segment.offset = static_cast<Ice::Int>(start);
+      segment.data.assign(_updated.begin() + start, _updated.begin() + end);
+      patch->segments.push_back(segment);
+
+      i = end;
+    }
+
+    return patch;
+  }
+
+  size_t
+  patchSize(const cdl::WorkingMemoryPatchPtr & _patch) {
+    size_t size = 0;
+    for(cdl::WorkingMemoryPatchSegmentSeq::const_iterator i = _patch->segments.begin();
+	i < _patch->segments.end(); ++i) {
+      size += i->data.size();
+    }
+    return size;
+  }
+
+  void
+  applyPatch(const cdl::WorkingMemoryPatchPtr & _patch,
+	     cdl::ByteSeq & _bytes)
+    throw (CASTException) {
+
+    if(_patch->length < 0) {
+      throw CASTException(exceptionMessage(__HERE__, "invalid patch length: %d", 
+					   _patch->length));
+    }
+
+    if(!isPatchBase(_patch, _bytes)) {
+      throw CASTException(exceptionMessage(__HERE__, 
+					   "patch is against %d bytes with hash %d, not %d bytes with hash %d", 
+					   _patch->baseLength, _patch->baseHash,
+					   static_cast<int>(_bytes.size()), entryHash(_bytes)));
+    }
+
+    size_t length = static_cast<size_t>(_patch->length);
+    _bytes.resize(length);
+
+    for(cdl::WorkingMemoryPatchSegmentSeq::const_iterator i = _patch->segments.begin();
+	i < _patch->segments.end(); ++i) {
+      if(i->offset < 0 || 
+	 static_cast<size_t>(i->offset) + i->data.size() > length) {
+	throw CASTException(exceptionMessage(__HERE__, 
+					     "patch segment at %d of %d bytes does not fit entry of %d bytes", 
+					     i->offset, static_cast<int>(i->data.size()), _patch->length));
+      }
+      copy(i->data.begin(), i->data.end(), _bytes.begin() + i->offset);
+    }
+  }
+
+} //namespace cast
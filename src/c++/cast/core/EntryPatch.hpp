@@ -0,0 +1,113 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_ENTRY_PATCH_HPP_
+#define CAST_ENTRY_PATCH_HPP_
+
+#include <cast/slice/CDL.hpp>
+
+#include <Ice/Ice.h>
+
+namespace cast {
+
+  /**
+   * Functions for building and applying working memory patches.
+   *
+   * A patch is computed over the Ice stream encoding of an entry. It
+   * therefore works for any Slice class. It is only small when the
+   * encoding mostly stays in place. A new value in a fixed size field
+   * gives a tiny patch. A string or sequence that changes length moves
+   * everything after it, and the patch then holds all of those bytes.
+   */
+
+  /**
+   * Segments separated by fewer unchanged bytes than this are merged,
+   * as a segment costs about this much to marshal.
+   */
+  const unsigned int PATCH_MERGE_GAP = 8;
+
+  /**
+   * Write an entry in the Ice stream encoding.
+   */
+  void 
+  marshalEntry(const Ice::CommunicatorPtr & _communicator,
+	       const Ice::ObjectPtr & _entry,
+	       cdl::ByteSeq & _bytes);
+
+  /**
+   * Read an entry written by marshalEntry. The type of the entry must
+   * be known to this process.
+   */
+  Ice::ObjectPtr 
+  unmarshalEntry(const Ice::CommunicatorPtr & _communicator,
+		 const cdl::ByteSeq & _bytes);
+
+  /**
+   * A 32 bit FNV-1a hash of a marshalled entry. Patches carry the
+   * hash of the bytes they were computed against, so one applied to
+   * different bytes of the same length is caught. The Java
+   * EntryPatch.entryHash gives the same value.
+   */
+  Ice::Int
+  entryHash(const cdl::ByteSeq & _bytes);
+
+  /**
+   * Whether _bytes are the marshalled entry a patch was computed
+   * against.
+   */
+  bool
+  isPatchBase(const cdl::WorkingMemoryPatchPtr & _patch,
+	      const cdl::ByteSeq & _bytes);
+
+  /**
+   * Compute the patch that turns _base into _updated.
+   *
+   * @param _base The marshalled entry at _baseVersion.
+   * @param _updated The marshalled new entry.
+   * @param _baseVersion The version _base was read or written at.
+   */
+  cdl::WorkingMemoryPatchPtr
+  createPatch(const cdl::ByteSeq & _base,
+	      const cdl::ByteSeq & _updated,
+	      const int _baseVersion);
+
+  /**
+   * The number of entry bytes carried by a patch.
+   */
+  size_t
+  patchSize(const cdl::WorkingMemoryPatchPtr & _patch);
+
+  /**
+   * Apply a patch in place to the marshalled entry it was computed
+   * against.
+   *
+   * @throws CASTException if the patch was computed against
+   * different bytes or does not fit the entry.
+   */
+  void
+  applyPatch(const cdl::WorkingMemoryPatchPtr & _patch,
+	     cdl::ByteSeq & _bytes)
+    throw (CASTException);
+
+} //namespace cast
+
+#endif
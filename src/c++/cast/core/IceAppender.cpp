@@ -14,6 +14,8 @@
 #include "cast/core/CASTUtils.hpp"
 #include "cast/core/ComponentLogger.hpp"
 
+#include <algorithm>
+
 
 using namespace log4cxx;
 using namespace log4cxx::helpers;
@@ -32,13 +34,110 @@ namespace cast {
       
       IceAppender::IceAppender() : 
       m_logHost(),
-      m_logPort(cast::cdl::LOGGINGPORT) {
+      m_logPort(cast::cdl::LOGGINGPORT),
+      m_queueSize(1024),
+      m_batchSize(64),
+      m_overflow(BLOCK),
+      m_closing(false),
+      m_droppedEvents(0),
+      m_batchesSent(0) {
         LogLog::setInternalDebugging(true);
       }
       
       IceAppender::~IceAppender() {
         finalize();
       }
+
+      void IceAppender::close() {
+        {
+          IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_queueMonitor);
+          if(m_closing) {
+            return;
+          }
+          m_closing = true;
+          m_queueMonitor.notifyAll();
+        }
+
+        if(m_sendThread) {
+          m_sendThreadControl.join();
+          m_sendThread = 0;
+        }
+
+        if(m_droppedEvents > 0) {
+          std::ostringstream dropped;
+          dropped << "IceAppender dropped " << m_droppedEvents << " events because the queue was full";
+          LogLog::warn(LOG4CXX_STR(dropped.str()));
+        }
+      }
+
+      unsigned long IceAppender::getDroppedEvents() const {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_queueMonitor);
+        return m_droppedEvents;
+      }
+
+      unsigned long IceAppender::getBatchesSent() const {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_queueMonitor);
+        return m_batchesSent;
+      }
+
+      void IceAppender::queueEvent(const cast::cdl::SerialisedLogEvent & _event) {
+        IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_queueMonitor);
+
+        if(m_queue.size() >= m_queueSize) {
+          switch(m_overflow) {
+          case BLOCK:
+            while(m_queue.size() >= m_queueSize && !m_closing) {
+              m_queueMonitor.wait();
+            }
+            break;
+          case DROP_OLDEST:
+            m_queue.pop_front();
+            ++m_droppedEvents;
+            break;
+          case DROP_NEWEST:
+            ++m_droppedEvents;
+            return;
+          }
+        }
+
+        //the send thread only waits when the queue is empty
+        bool wasEmpty = m_queue.empty();
+        m_queue.push_back(_event);
+        if(wasEmpty) {
+          m_queueMonitor.notifyAll();
+        }
+      }
+
+      void IceAppender::sendQueuedEvents() {
+        cast::cdl::SerialisedLogEventSeq batch;
+        while(true) {
+          {
+            IceUtil::Monitor<IceUtil::Mutex>::Lock lock(m_queueMonitor);
+            while(m_queue.empty() && !m_closing) {
+              m_queueMonitor.wait();
+            }
+
+            //on close, keep going until everything queued has been sent
+            if(m_queue.empty()) {
+              return;
+            }
+
+            size_t count = std::min(m_batchSize, m_queue.size());
+            batch.assign(m_queue.begin(), m_queue.begin() + count);
+            m_queue.erase(m_queue.begin(), m_queue.begin() + count);
+            ++m_batchesSent;
+
+            //wake any loggers blocked on a full queue
+            m_queueMonitor.notifyAll();
+          }
+
+          try {
+            m_logServer->logSerialisedEvents(batch);
+          } catch(std::exception& e) {
+            LogLog::warn(LOG4CXX_STR("Problem dispatching serialised log events: "), e);
+          }
+        }
+      }
       
       void IceAppender::append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool) {
         
@@ -60,20 +159,23 @@ namespace cast {
           event->write(*oos, pool);
           oos->flush(pool);
           
+          //the server call is made on the send thread
+          cast::cdl::SerialisedLogEvent serialised;
+          serialised.event = os->toByteArray();
+
           CASTLoggingEventPtr castEvent = event;
           if (castEvent) {
             const LogAdditions & additions(castEvent->getAdditions());
-            m_logServer->logSerialisedEventWithAdditions(os->toByteArray(), additions.getComponentID(), additions.getSubarchitectureID(), additions.getColourStart());
-          } else {       
-            m_logServer->logSerialisedEvent(os->toByteArray());
-          }                  
+            serialised.id = additions.getComponentID();
+            serialised.saID = additions.getSubarchitectureID();
+            serialised.colourStart = additions.getColourStart();
+          }
+
+          queueEvent(serialised);
         } catch(std::exception& e) {
-          LogLog::warn(LOG4CXX_STR("Problem dispatching serialised log event: "), e);
+          LogLog::warn(LOG4CXX_STR("Problem serialising log event: "), e);
         }
         
-        
-        
-        
       }
       
       void IceAppender::setOption(const LogString& option, const LogString& value) {
@@ -86,6 +188,29 @@ namespace cast {
           LogLog::debug(LOG4CXX_STR("setPort: " + value));
           
         }
+        else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("QUEUESIZE"), LOG4CXX_STR("queuesize"))) {
+          setQueueSize(OptionConverter::toInt(value, static_cast<int>(m_queueSize)));
+          LogLog::debug(LOG4CXX_STR("setQueueSize: " + value));
+        }
+        else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("BATCHSIZE"), LOG4CXX_STR("batchsize"))) {
+          setBatchSize(OptionConverter::toInt(value, static_cast<int>(m_batchSize)));
+          LogLog::debug(LOG4CXX_STR("setBatchSize: " + value));
+        }
+        else if (StringHelper::equalsIgnoreCase(option, LOG4CXX_STR("OVERFLOW"), LOG4CXX_STR("overflow"))) {
+          if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("BLOCK"), LOG4CXX_STR("block"))) {
+            setOverflowPolicy(BLOCK);
+          }
+          else if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("DROPOLDEST"), LOG4CXX_STR("dropoldest"))) {
+            setOverflowPolicy(DROP_OLDEST);
+          }
+          else if (StringHelper::equalsIgnoreCase(value, LOG4CXX_STR("DROPNEWEST"), LOG4CXX_STR("dropnewest"))) {
+            setOverflowPolicy(DROP_NEWEST);
+          }
+          else {
+            LogLog::warn(LOG4CXX_STR("Unknown overflow policy: " + value));
+          }
+          LogLog::debug(LOG4CXX_STR("setOverflowPolicy: " + value));
+        }
         else {
           AppenderSkeleton::setOption(option, value);
         }
@@ -93,6 +218,11 @@ namespace cast {
       
       void IceAppender::activateOptions(log4cxx::helpers::Pool& _pool) {
        	m_logServer = getLoggingServer(m_logHost, m_logPort);        
+
+        if(!m_sendThread) {
+          m_sendThread = new SendThread(*this);
+          m_sendThreadControl = m_sendThread->start();
+        }
       }
       
       LoggingServerPrx 
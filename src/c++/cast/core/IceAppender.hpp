@@ -6,14 +6,37 @@
 #include <log4cxx/helpers/loglog.h>
 #include <cast/slice/CDL.hpp>
 
+#include <IceUtil/Thread.h>
+#include <IceUtil/Monitor.h>
+#include <IceUtil/Mutex.h>
+
+#include <deque>
+
 namespace cast {
   namespace core {
     namespace logging {
       using namespace log4cxx;
       
+      /**
+       * Appender which sends events to a LoggingServer. Events are
+       * serialised on the logging thread and queued, and a background
+       * thread sends them to the server in batches. Options are Host,
+       * Port, QueueSize (default 1024 events), BatchSize (default 64
+       * events) and Overflow, which says what to do when the queue is
+       * full: Block (the default) waits for space, DropOldest discards
+       * the oldest queued event and DropNewest discards the new one.
+       */
       class LOG4CXX_EXPORT IceAppender  : public log4cxx::AppenderSkeleton 
       {
       public:
+
+        enum OverflowPolicy {
+          BLOCK,
+          DROP_OLDEST,
+          DROP_NEWEST
+        };
+
+
         DECLARE_LOG4CXX_OBJECT(IceAppender)
         BEGIN_LOG4CXX_CAST_MAP()
         LOG4CXX_CAST_ENTRY(IceAppender)
@@ -41,16 +64,77 @@ namespace cast {
         void setPort(const int & _port) {
           m_logPort = _port;
         }
+
+        void setQueueSize(const int & _queueSize) {
+          m_queueSize = _queueSize > 0 ? _queueSize : 1;
+        }
+
+        void setBatchSize(const int & _batchSize) {
+          m_batchSize = _batchSize > 0 ? _batchSize : 1;
+        }
+
+        void setOverflowPolicy(const OverflowPolicy & _overflow) {
+          m_overflow = _overflow;
+        }
+
+        /**
+         * The number of events discarded because the queue was full.
+         */
+        unsigned long getDroppedEvents() const;
+
+        /**
+         * The number of batches sent to the server.
+         */
+        unsigned long getBatchesSent() const;
+
+        /**
+         * Stop the send thread after sending everything that has been
+         * queued.
+         */
+        virtual void close();
         
       protected:
         void append(const spi::LoggingEventPtr& event, log4cxx::helpers::Pool& pool);
-        virtual void close() {}
         
       private:
+
+        /**
+         * Thread which takes batches from the queue and sends them.
+         */
+        class SendThread : public IceUtil::Thread {
+        public:
+          SendThread(IceAppender & _appender) : 
+            m_appender(_appender) {}
+          virtual void run() {
+            m_appender.sendQueuedEvents();
+          }
+        private:
+          IceAppender & m_appender;
+        };
+
+        friend class SendThread;
+
+        void queueEvent(const cast::cdl::SerialisedLogEvent & _event);
+
+        void sendQueuedEvents();
         
         std::string m_logHost;
         int m_logPort;
         cast::interfaces::LoggingServerPrx m_logServer;
+
+        size_t m_queueSize;
+        size_t m_batchSize;
+        OverflowPolicy m_overflow;
+
+        std::deque<cast::cdl::SerialisedLogEvent> m_queue;
+        mutable IceUtil::Monitor<IceUtil::Mutex> m_queueMonitor;
+        bool m_closing;
+
+        IceUtil::ThreadPtr m_sendThread;
+        IceUtil::ThreadControl m_sendThreadControl;
+
+        unsigned long m_droppedEvents;
+        unsigned long m_batchesSent;
         
         cast::interfaces::LoggingServerPrx 
         getLoggingServer(const std::string & _logHost, const int & _logPort);
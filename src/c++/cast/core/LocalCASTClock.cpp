@@ -0,0 +1,98 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "LocalCASTClock.hpp"
+
+namespace cast {
+
+  const long LocalCASTClock::DEFAULT_RESYNC_MILLIS;
+
+  LocalCASTClock::LocalCASTClock() :
+    m_offset(0),
+    m_syncError(0),
+    m_lastTime(0),
+    m_synced(false),
+    m_resyncInterval(IceUtil::Time::milliSeconds(DEFAULT_RESYNC_MILLIS)) {
+  }
+
+
+  void 
+  LocalCASTClock::setTimeServer(const interfaces::TimeServerPrx & _timeServer) {
+    IceUtil::Mutex::Lock lock(m_access);
+    m_timeServer = _timeServer;
+    m_synced = false;
+  }
+
+
+  void 
+  LocalCASTClock::setResyncInterval(long _millis) {
+    IceUtil::Mutex::Lock lock(m_access);
+    m_resyncInterval = IceUtil::Time::milliSeconds(_millis);
+  }
+
+
+  void 
+  LocalCASTClock::sync(const IceUtil::Time & _now) {
+    assert(m_timeServer);
+
+    cdl::CASTTime serverTime(m_timeServer->getCASTTime());
+    IceUtil::Time after(IceUtil::Time::now(IceUtil::Time::Monotonic));
+
+    Ice::Long server = static_cast<Ice::Long>(serverTime.s) * 1000000 + serverTime.us;
+    //assume the server read its clock half way through the call
+    Ice::Long midpoint = (_now.toMicroSeconds() + after.toMicroSeconds()) / 2;
+
+    m_offset = server - midpoint;
+    m_syncError = (after - _now).toMicroSeconds();
+    m_lastSync = after;
+    m_synced = true;
+  }
+
+
+  cdl::CASTTime 
+  LocalCASTClock::getCASTTime() {
+    IceUtil::Mutex::Lock lock(m_access);
+
+    IceUtil::Time now(IceUtil::Time::now(IceUtil::Time::Monotonic));
+
+    if(!m_synced || 
+       (m_resyncInterval > IceUtil::Time() && now - m_lastSync >= m_resyncInterval)) {
+      sync(now);
+      now = m_lastSync;
+    }
+
+    Ice::Long time = now.toMicroSeconds() + m_offset;
+
+    //a resync may move the offset back by up to the sync error, which
+    //should not make time go backwards. Bigger steps are a server reset.
+    if(time < m_lastTime && m_lastTime - time <= m_syncError) {
+      time = m_lastTime;
+    }
+    m_lastTime = time;
+
+    cdl::CASTTime castTime;
+    castTime.s = time / 1000000;
+    castTime.us = time % 1000000;
+    return castTime;
+  }
+
+} //namespace cast
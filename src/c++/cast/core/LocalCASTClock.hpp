@@ -0,0 +1,108 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_LOCAL_CAST_CLOCK_H_
+#define CAST_LOCAL_CAST_CLOCK_H_
+
+#include <cast/slice/CDL.hpp>
+
+#include <IceUtil/IceUtil.h>
+
+namespace cast {
+
+  /**
+   * Computes CAST time locally from the monotonic clock, using an
+   * offset taken from the time server, so getting the time does not
+   * need a call to the time server. The offset is measured at the
+   * midpoint of a getCASTTime call on the server and is re-measured
+   * every resync interval, which also picks up a reset of the server.
+   *
+   * @author nah
+   */
+  class LocalCASTClock {
+
+  public:
+
+    /**
+     * Resync interval used if none is given, in milliseconds.
+     */
+    static const long DEFAULT_RESYNC_MILLIS = 10000;
+
+    LocalCASTClock();
+
+    /**
+     * Set the time server to sync with. Invalidates the current offset.
+     */
+    void setTimeServer(const interfaces::TimeServerPrx & _timeServer);
+
+    /**
+     * Set how often to re-measure the offset. If 0 the offset is only
+     * measured once.
+     */
+    void setResyncInterval(long _millis);
+
+    /**
+     * Get the current CAST time, syncing with the time server first if
+     * the offset is missing or out of date. 
+     */
+    cdl::CASTTime getCASTTime();
+
+    /**
+     * The round trip time of the last sync in microseconds, which
+     * bounds the error in the offset.
+     */
+    Ice::Long getSyncError() const {
+      return m_syncError;
+    }
+
+  private:
+
+    /**
+     * Measure the offset from the time server. Must be called with
+     * m_access held.
+     */
+    void sync(const IceUtil::Time & _now);
+
+    interfaces::TimeServerPrx m_timeServer;
+
+    ///CAST time minus monotonic time, in microseconds
+    Ice::Long m_offset;
+
+    ///round trip time of the last sync, in microseconds
+    Ice::Long m_syncError;
+
+    ///the last CAST time returned, in microseconds
+    Ice::Long m_lastTime;
+
+    bool m_synced;
+
+    IceUtil::Time m_lastSync;
+
+    IceUtil::Time m_resyncInterval;
+
+    IceUtil::Mutex m_access;
+
+  };
+
+} //namespace cast
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2009 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_READ_ONLY_HANDLE_HPP_
+#define CAST_READ_ONLY_HANDLE_HPP_
+
+#include <Ice/Handle.h>
+
+namespace cast {
+
+  /**
+   * A shared, read-only reference to an object that is (or will be)
+   * stored on working memory. Working memory never modifies an object
+   * after it has been stored (an overwrite replaces it), so when the
+   * working memory is collocated with a component the same instance
+   * can be shared between the memory and any number of readers
+   * without copying, as long as nobody writes to it. This class
+   * enforces the reading half of that contract by only exposing const
+   * access. Use mutableCopy to get something that can be changed and
+   * written back.
+   */
+  template <class T>
+  class ReadOnlyHandle {
+
+  public:
+
+    ReadOnlyHandle() {}
+
+    /**
+     * Wrap an existing handle. The caller promises not to modify the
+     * object through _data (or any other handle to it) from now on.
+     *
+     * @param _data The object to share.
+     */
+    explicit
+    ReadOnlyHandle(const IceInternal::Handle<T> & _data) :
+      m_data(_data) {}
+
+    const T * operator->() const {
+      return m_data.operator->();
+    }
+
+    const T & operator*() const {
+      return *m_data;
+    }
+
+    const T * get() const {
+      return m_data.get();
+    }
+
+    operator bool() const {
+      return m_data;
+    }
+
+    /**
+     * Access the shared handle. This is for passing the object on to
+     * working memory or Ice, and must not be used to modify it.
+     */
+    const IceInternal::Handle<T> & shared() const {
+      return m_data;
+    }
+
+  private:
+    IceInternal::Handle<T> m_data;
+  };
+
+  /**
+   * Mark an object as immutable. After this call the object must not
+   * be changed through _data.
+   */
+  template <class T>
+  ReadOnlyHandle<T>
+  freeze(const IceInternal::Handle<T> & _data) {
+    return ReadOnlyHandle<T>(_data);
+  }
+
+  /**
+   * Get a private, modifiable copy of a shared object.
+   */
+  template <class T>
+  IceInternal::Handle<T>
+  mutableCopy(const ReadOnlyHandle<T> & _data) {
+    if(!_data) {
+      return IceInternal::Handle<T>();
+    }
+    return IceInternal::Handle<T>::dynamicCast(_data->ice_clone());
+  }
+
+} //namespace cast
+
+#endif
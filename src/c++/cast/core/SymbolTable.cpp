@@ -0,0 +1,349 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#include "SymbolTable.hpp"
+
+#include <cast/core/StringMap.hpp>
+
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <cassert>
+
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/locks.hpp>
+
+using namespace std;
+
+namespace cast {
+
+  namespace {
+
+    struct Table {
+
+      boost::shared_mutex access;
+
+      StringMap<Symbol>::map symbols;
+
+      //deque so references to names stay valid as it grows
+      deque<string> names;
+
+      //indexed by most derived type symbol, null until an entry of
+      //the type is seen
+      vector<TypeHierarchy *> hierarchies;
+
+      //hierarchies of changes, keyed by their super types, which are
+      //different for every type
+      map<vector<string>, TypeHierarchy *> bySuperTypes;
+
+      //hierarchies of compact changes, keyed by the subarchitecture
+      //of the change and its hierarchy id, as ids are only meaningful
+      //to the working memory which gave them
+      map<pair<Symbol, int>, const TypeHierarchy *> byID;
+
+      //indexed by stored type symbol, hierarchies holding only that
+      //type, used for compact changes until the real one is known
+      vector<TypeHierarchy *> provisional;
+
+      Table() {
+	symbols[""] = EMPTY_SYMBOL;
+	names.push_back("");
+      }
+
+      /**
+       * Lookup without adding. Caller must hold at least a shared lock.
+       */
+      bool find(const string & _name, Symbol & _symbol) const {
+	StringMap<Symbol>::map::const_iterator i = symbols.find(_name);
+	if(i == symbols.end()) {
+	  return false;
+	}
+	_symbol = i->second;
+	return true;
+      }
+
+      /**
+       * Lookup and add. Caller must hold an exclusive lock.
+       */
+      Symbol intern(const string & _name) {
+	Symbol symbol;
+	if(!find(_name, symbol)) {
+	  symbol = names.size();
+	  names.push_back(_name);
+	  symbols[_name] = symbol;
+	}
+	return symbol;
+      }
+
+      /**
+       * Caller must hold at least a shared lock.
+       */
+      const TypeHierarchy * findHierarchy(const Symbol & _type) const {
+	if(_type < static_cast<Symbol>(hierarchies.size())) {
+	  return hierarchies[_type];
+	}
+	return NULL;
+      }
+
+      /**
+       * Caller must hold at least a shared lock.
+       */
+      const TypeHierarchy * findHierarchy(const vector<string> & _superTypes) const {
+	map<vector<string>, TypeHierarchy *>::const_iterator i = bySuperTypes.find(_superTypes);
+	if(i == bySuperTypes.end()) {
+	  return NULL;
+	}
+	return i->second;
+      }
+
+      /**
+       * Caller must hold at least a shared lock.
+       */
+      const TypeHierarchy * findHierarchy(const Symbol & _subarch, 
+					  const int & _id) const {
+	map<pair<Symbol, int>, const TypeHierarchy *>::const_iterator i = 
+	  byID.find(make_pair(_subarch, _id));
+	if(i == byID.end()) {
+	  return NULL;
+	}
+	return i->second;
+      }
+
+      /**
+       * Build a hierarchy, starting with _type if it is not
+       * EMPTY_SYMBOL. Caller must hold an exclusive lock.
+       */
+      TypeHierarchy *
+      buildHierarchy(const Symbol & _type,
+		     const vector<string> & _superTypes) {
+	TypeHierarchy * hierarchy = new TypeHierarchy();
+	hierarchy->ids = _superTypes;
+	if(_type != EMPTY_SYMBOL) {
+	  hierarchy->types.push_back(_type);
+	}
+	for(vector<string>::const_iterator i = _superTypes.begin();
+	    i < _superTypes.end(); ++i) {
+	  Symbol superType = intern(*i);
+	  if(superType != _type) {
+	    hierarchy->types.push_back(superType);
+	  }
+	}
+
+	Symbol largest = hierarchy->types.empty() ? EMPTY_SYMBOL :
+	  *max_element(hierarchy->types.begin(), hierarchy->types.end());
+	hierarchy->members.resize(largest + 1, false);
+	for(vector<Symbol>::const_iterator i = hierarchy->types.begin();
+	    i < hierarchy->types.end(); ++i) {
+	  hierarchy->members[*i] = true;
+	}
+	return hierarchy;
+      }
+
+      /**
+       * Caller must hold an exclusive lock.
+       */
+      const TypeHierarchy *
+      internHierarchy(const Symbol & _type,
+		      const vector<string> & _superTypes) {
+	const TypeHierarchy * existing = findHierarchy(_type);
+	if(existing) {
+	  return existing;
+	}
+	if(_type >= static_cast<Symbol>(hierarchies.size())) {
+	  hierarchies.resize(_type + 1, NULL);
+	}
+	hierarchies[_type] = buildHierarchy(_type, _superTypes);
+	return hierarchies[_type];
+      }
+
+      /**
+       * Caller must hold an exclusive lock.
+       */
+      const TypeHierarchy *
+      internHierarchy(const vector<string> & _superTypes) {
+	TypeHierarchy *& hierarchy(bySuperTypes[_superTypes]);
+	if(!hierarchy) {
+	  hierarchy = buildHierarchy(EMPTY_SYMBOL, _superTypes);
+	}
+	return hierarchy;
+      }
+
+      /**
+       * Caller must hold an exclusive lock.
+       */
+      const TypeHierarchy *
+      provisionalHierarchy(const Symbol & _type) {
+	if(_type >= static_cast<Symbol>(provisional.size())) {
+	  provisional.resize(_type + 1, NULL);
+	}
+	if(!provisional[_type]) {
+	  TypeHierarchy * hierarchy = new TypeHierarchy();
+	  hierarchy->types.push_back(_type);
+	  hierarchy->members.resize(_type + 1, false);
+	  hierarchy->members[_type] = true;
+	  provisional[_type] = hierarchy;
+	}
+	return provisional[_type];
+      }
+
+    };
+
+    Table & table() {
+      static Table symbolTable;
+      return symbolTable;
+    }
+
+  }
+
+
+  Symbol
+  SymbolTable::intern(const string & _name) {
+    Table & t(table());
+    {
+      boost::shared_lock<boost::shared_mutex> lock(t.access);
+      Symbol symbol;
+      if(t.find(_name, symbol)) {
+	return symbol;
+      }
+    }
+    boost::lock_guard<boost::shared_mutex> lock(t.access);
+    return t.intern(_name);
+  }
+
+
+  const string &
+  SymbolTable::name(const Symbol & _symbol) {
+    Table & t(table());
+    boost::shared_lock<boost::shared_mutex> lock(t.access);
+    assert(_symbol >= 0 && _symbol < static_cast<Symbol>(t.names.size()));
+    return t.names[_symbol];
+  }
+
+
+  const TypeHierarchy &
+  SymbolTable::hierarchy(const vector<string> & _superTypes) {
+    Table & t(table());
+    {
+      boost::shared_lock<boost::shared_mutex> lock(t.access);
+      const TypeHierarchy * hierarchy = t.findHierarchy(_superTypes);
+      if(hierarchy) {
+	return *hierarchy;
+      }
+    }
+    boost::lock_guard<boost::shared_mutex> lock(t.access);
+    return *t.internHierarchy(_superTypes);
+  }
+
+
+  const TypeHierarchy &
+  SymbolTable::hierarchy(const Ice::ObjectPtr & _entry) {
+    Table & t(table());
+    const string & mostDerived(_entry->ice_id());
+    {
+      boost::shared_lock<boost::shared_mutex> lock(t.access);
+      Symbol type;
+      if(t.find(mostDerived, type)) {
+	const TypeHierarchy * hierarchy = t.findHierarchy(type);
+	if(hierarchy) {
+	  return *hierarchy;
+	}
+      }
+    }
+
+    //build outside the lock, as ice_ids() allocates
+    vector<string> superTypes(_entry->ice_ids());
+    boost::lock_guard<boost::shared_mutex> lock(t.access);
+    return *t.internHierarchy(t.intern(mostDerived), superTypes);
+  }
+
+
+  const TypeHierarchy *
+  SymbolTable::findHierarchy(const Symbol & _type) {
+    Table & t(table());
+    boost::shared_lock<boost::shared_mutex> lock(t.access);
+    return t.findHierarchy(_type);
+  }
+
+
+  void
+  SymbolTable::registerHierarchy(const string & _subarch,
+				 const int & _id,
+				 const TypeHierarchy & _hierarchy) {
+    Table & t(table());
+    {
+      boost::shared_lock<boost::shared_mutex> lock(t.access);
+      Symbol subarch;
+      if(t.find(_subarch, subarch) && t.findHierarchy(subarch, _id)) {
+	return;
+      }
+    }
+    boost::lock_guard<boost::shared_mutex> lock(t.access);
+    t.byID[make_pair(t.intern(_subarch), _id)] = &_hierarchy;
+  }
+
+
+  void
+  SymbolTable::intern(const cdl::WorkingMemoryChange & _wmc,
+		      InternedChange & _interned) {
+
+    _interned.operation = _wmc.operation;
+
+    //a compact change refers to its hierarchy by id
+    bool compact = _wmc.superTypes.empty() && _wmc.typeHierarchy != 0;
+
+    Table & t(table());
+
+    //the common case is that everything has been seen before
+    {
+      boost::shared_lock<boost::shared_mutex> lock(t.access);
+      if(t.find(_wmc.src, _interned.src) &&
+	 t.find(_wmc.address.subarchitecture, _interned.subarchitecture) &&
+	 t.find(_wmc.type, _interned.type)) {
+	_interned.hierarchy = compact ?
+	  t.findHierarchy(_interned.subarchitecture, _wmc.typeHierarchy) :
+	  t.findHierarchy(_wmc.superTypes);
+	if(_interned.hierarchy) {
+	  return;
+	}
+      }
+    }
+
+    boost::lock_guard<boost::shared_mutex> lock(t.access);
+    _interned.src = t.intern(_wmc.src);
+    _interned.subarchitecture = t.intern(_wmc.address.subarchitecture);
+    _interned.type = t.intern(_wmc.type);
+
+    //a compact change whose hierarchy id is not known yet must not fix
+    //a hierarchy for its type, as the type it was stored as says
+    //nothing about the entry's own type
+    if(compact) {
+      _interned.hierarchy = t.findHierarchy(_interned.subarchitecture, _wmc.typeHierarchy);
+      if(!_interned.hierarchy) {
+	_interned.hierarchy = t.provisionalHierarchy(_interned.type);
+      }
+    }
+    else {
+      _interned.hierarchy = t.internHierarchy(_wmc.superTypes);
+    }
+  }
+
+} //namespace cast
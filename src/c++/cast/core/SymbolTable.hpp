@@ -0,0 +1,150 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+#ifndef CAST_SYMBOL_TABLE_H_
+#define CAST_SYMBOL_TABLE_H_
+
+#include <cast/slice/CDL.hpp>
+
+#include <string>
+#include <vector>
+
+namespace cast {
+
+  /**
+   * A small integer standing for an interned string.
+   */
+  typedef int Symbol;
+
+  /**
+   * Symbol for the empty string, which is interned when the table is
+   * created.
+   */
+  const Symbol EMPTY_SYMBOL = 0;
+
+  /**
+   * The type hierarchy of a type, as interned symbols. Once built it
+   * is never changed or released, so it can be shared freely.
+   */
+  struct TypeHierarchy {
+
+    ///the type and all of its super types, starting with the type
+    ///itself if the hierarchy was built from an entry
+    std::vector<Symbol> types;
+
+    ///the super types as they were given, in sorted order
+    std::vector<std::string> ids;
+
+    ///types as a bitset for membership tests
+    std::vector<bool> members;
+
+    bool contains(const Symbol & _type) const {
+      return _type < static_cast<Symbol>(members.size()) && members[_type];
+    }
+  };
+
+  /**
+   * The parts of a change used for filtering, with the type,
+   * subarchitecture and source interned. Entry ids are not interned as
+   * there is no bound on how many there are.
+   */
+  struct InternedChange {
+    cdl::WorkingMemoryOperation operation;
+    Symbol src;
+    Symbol subarchitecture;
+    Symbol type;
+    const TypeHierarchy * hierarchy;
+  };
+
+  /**
+   * Process-wide table which maps strings that recur in change events
+   * (type ids, component ids and subarchitecture ids) to small
+   * integers, so they can be compared and hashed as integers. Symbols
+   * are never released, so this must not be used for unbounded sets of
+   * strings such as entry ids. All methods are thread safe.
+   *
+   * @author nah
+   */
+  class SymbolTable {
+
+  public:
+
+    /**
+     * Get the symbol for a string, adding it to the table if necessary.
+     */
+    static Symbol intern(const std::string & _name);
+
+    /**
+     * Get the string for a symbol.
+     */
+    static const std::string & name(const Symbol & _symbol);
+
+    /**
+     * Get the interned hierarchy of the type whose ids, as
+     * ice_ids() gives them, are _superTypes. No two types have the
+     * same ids, so this is the hierarchy of the entry's own type.
+     */
+    static const TypeHierarchy &
+    hierarchy(const std::vector<std::string> & _superTypes);
+
+    /**
+     * Get the interned hierarchy of the most derived type of _entry,
+     * only calling ice_ids() the first time the type is seen. The
+     * first of its types is the most derived type.
+     */
+    static const TypeHierarchy &
+    hierarchy(const Ice::ObjectPtr & _entry);
+
+    /**
+     * Get the interned hierarchy of a most derived type if an entry
+     * of it has been seen, else null.
+     */
+    static const TypeHierarchy *
+    findHierarchy(const Symbol & _type);
+
+    /**
+     * Record the hierarchy which _id stands for in compact changes
+     * from _subarch, so they can be filtered without their super
+     * types.
+     */
+    static void
+    registerHierarchy(const std::string & _subarch,
+		      const int & _id,
+		      const TypeHierarchy & _hierarchy);
+
+    /**
+     * Intern the filtered fields of a change under a single lock
+     * acquisition.
+     */
+    static void
+    intern(const cdl::WorkingMemoryChange & _wmc,
+	   InternedChange & _interned);
+
+  private:
+
+    SymbolTable();
+
+  };
+
+} //namespace cast
+
+#endif
@@ -100,6 +100,10 @@ namespace cast {
 	return m_tester.getComponentID();
       }
 
+      cdl::CASTTime getCASTTime() const {
+	return m_tester.getCASTTime();
+      }
+
       
       template <class T>
       void addToWorkingMemory(const std::string &_id, 
@@ -120,6 +124,12 @@ namespace cast {
 	m_tester.addToWorkingMemory(_wma,_data);
       }
 
+      template <class T>
+      void addToWorkingMemory(const std::string &_id, 
+			      const ReadOnlyHandle<T> & _data) {    	
+	m_tester.addToWorkingMemory(_id,_data);
+      }
+
       template <class T>
       void overwriteWorkingMemory(const std::string &_id, 
 				  IceInternal::Handle<T> _data) {    
@@ -141,14 +151,48 @@ namespace cast {
 
       
 
+      template <class T>
+      void patchWorkingMemory(const cdl::WorkingMemoryAddress & _wma,
+			      const ReadOnlyHandle<T> & _base,
+			      const int _baseVersion,
+			      IceInternal::Handle<T> _data) {    
+	m_tester.patchWorkingMemory(_wma,_base,_baseVersion,_data);
+      }
+
+      template <class T>
+      bool overwriteIfVersion(const cdl::WorkingMemoryAddress & _wma,
+			      int & _version,
+			      IceInternal::Handle<T> & _data) {    
+	return m_tester.overwriteIfVersion(_wma,_version,_data);
+      }
+
       void deleteFromWorkingMemory(const cdl::WorkingMemoryAddress & _wma) {    
 	m_tester.deleteFromWorkingMemory(_wma );
       }
 
 
+      template <class T>
+      void addToBatch(cdl::WorkingMemoryBatchItemSeq & _items,
+		      const std::string &_id, 
+		      IceInternal::Handle<T> _data) {    
+	m_tester.addToBatch(_items,_id,_data);
+      }
+
+      cdl::WorkingMemoryBatchResultSeq 
+      addToWorkingMemoryBatch(const std::string &_subarchitecture, 
+			      const cdl::WorkingMemoryBatchItemSeq & _items) {    
+	return m_tester.addToWorkingMemoryBatch(_subarchitecture,_items);
+      }
+
+
       bool existsOnWorkingMemory(const cdl::WorkingMemoryAddress & _wma) {
 	return m_tester.existsOnWorkingMemory(_wma);
       }
+
+      void trackLatestVersion(const std::string & _id,
+			      const std::string & _subarch) {
+	m_tester.trackLatestVersion(_id,_subarch);
+      }
       
 
 
@@ -169,6 +213,28 @@ namespace cast {
 	return m_tester.getMemoryEntry<T>(_id,_subarch);
       }
 
+      template <class T>
+      IceInternal::Handle<T> getMemoryEntry(const cdl::WorkingMemoryChange & _wmc) {
+	return m_tester.getMemoryEntry<T>(_wmc);
+      }
+
+      template <class T>
+      CASTData<T> getMemoryEntryWithData(const cdl::WorkingMemoryAddress & _wma) {
+	return m_tester.getMemoryEntryWithData<T>(_wma);
+      }
+
+      template <class T>
+      ReadOnlyHandle<T> getMemoryEntrySnapshot(const cdl::WorkingMemoryAddress & _wma) {
+	return m_tester.getMemoryEntrySnapshot<T>(_wma);
+      }
+
+      template <class T>
+      CASTData<T> getPatchedMemoryEntry(const cdl::WorkingMemoryChange & _wmc,
+					const ReadOnlyHandle<T> & _base,
+					const int _baseVersion) {
+	return m_tester.getPatchedMemoryEntry(_wmc,_base,_baseVersion);
+      }
+
       template <class T>
       void  getMemoryEntries(std::vector < IceInternal::Handle<T> > & _results) {
 	m_tester.getMemoryEntries(_results);
@@ -182,8 +248,25 @@ namespace cast {
       }
 
       void addChangeFilter(const cdl::WorkingMemoryChangeFilter & _filter,
-			   WorkingMemoryChangeReceiver * _pReceiver) {
-	m_tester.addChangeFilter(_filter, _pReceiver);
+			   WorkingMemoryChangeReceiver * _pReceiver,
+			   const ChangeReceiverQueueing & _queueing = QUEUE_ALL) {
+	m_tester.addChangeFilter(_filter, _pReceiver, ChangeReceiverPriority(MEDIUM), _queueing);
+      }
+
+      unsigned long getCoalescedChangeCount() const {
+	return m_tester.getCoalescedChangeCount();
+      }
+
+      unsigned long getDroppedChangeCount() const {
+	return m_tester.getDroppedChangeCount();
+      }
+
+      unsigned long getReadCacheHits() const {
+	return m_tester.getReadCacheHits();
+      }
+
+      unsigned long getReadCacheMisses() const {
+	return m_tester.getReadCacheMisses();
       }
 
       void removeChangeFilter(const WorkingMemoryChangeReceiver * _pReceiver,
@@ -209,6 +292,19 @@ namespace cast {
 	m_tester.lockEntry(_id,_subarch,_permissions);
       }
 
+      bool lockEntry(const cdl::WorkingMemoryAddress & _wma,
+		     const cdl::WorkingMemoryPermissions & _permissions,
+		     const unsigned int & _timeoutMillis)
+	throw(DoesNotExistOnWMException) {
+	return m_tester.lockEntry(_wma,_permissions,_timeoutMillis);
+      }
+
+      void lockEntryAsync(const cdl::WorkingMemoryAddress & _wma,
+			  const cdl::WorkingMemoryPermissions & _permissions,
+			  WorkingMemoryLockReceiver * _receiver) {
+	m_tester.lockEntryAsync(_wma,_permissions,_receiver);
+      }
+
       bool tryLockEntry(const cdl::WorkingMemoryAddress & _wma,
 			const cdl::WorkingMemoryPermissions & _permissions)
 	throw(DoesNotExistOnWMException) {
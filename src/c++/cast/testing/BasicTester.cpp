@@ -2,6 +2,8 @@
 
 
 #include <ChangeFilterFactory.hpp>
+#include <cast/core/CASTTimer.hpp>
+#include <algorithm>
 
 using namespace std;
 using namespace boost;
@@ -295,6 +297,52 @@ namespace cast {
 
   }
 
+  void BasicTester::Snapshotter::startTest() {
+    
+    try {
+      addChangeFilter(createLocalTypeFilter<CASTTestStruct>(cdl::ADD), this);            
+    } catch (CASTException &e) {
+      cerr<<e.what()<<endl;     
+      testComplete(false);
+    }
+    
+  }
+
+  void BasicTester::Snapshotter::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    //only if it's not my change
+    if(_wmc.src != getComponentID()) {
+      
+      try {	
+	
+	ReadOnlyHandle<CASTTestStruct> read = getMemoryEntrySnapshot<CASTTestStruct>(_wmc.address);
+	
+	//a mutable copy must not share the snapshot
+	CASTTestStructPtr copy = mutableCopy(read);
+	if(copy.get() == read.get() || copy->count != read->count) {
+	  println("mutable copy does not match snapshot");
+	  testComplete(false);
+	  return;
+	}
+	copy->count++;
+	if(read->count == copy->count) {
+	  println("change to mutable copy visible in snapshot");
+	  testComplete(false);
+	  return;
+	}
+
+	//write the snapshot back without copying
+	addToWorkingMemory(newDataID(), read);
+	
+	testComplete(true);
+
+      } catch (CASTException &e) {
+	cerr<<e.what()<<endl;
+	testComplete(false);
+      }
+    }
+
+  }
+
   void BasicTester::Writer::startTest() {
     //sleep a little bit to allow others to get their filters up
     sleepComponent(1000);
@@ -334,6 +382,121 @@ namespace cast {
 
   }
 
+  void BasicTester::BatchWriter::startTest() {
+    //sleep a little bit to allow others to get their filters up
+    sleepComponent(1000);
+    
+    BasicTester * tester = dynamic_cast<BasicTester* >(&m_tester);
+    if(tester == NULL) {
+      throw(CASTException(exceptionMessage(__HERE__, "Unable to cast BasicTester")));
+    }
+    string targetSubarch(tester->m_targetSubarch);
+
+    cdl::WorkingMemoryBatchItemSeq firstBatch;
+
+    try {	
+      for (int i = 0; i < m_count; i += m_batchSize) {
+	
+	cdl::WorkingMemoryBatchItemSeq items;
+
+	for (int j = i; j < min(m_count, i + m_batchSize); j++) {
+	  string id(newDataID());
+	  
+	  CASTTestStructPtr wrote(new CASTTestStruct());
+	  wrote->count = j;
+	  wrote->change.operation = cdl::ADD;
+	  wrote->change.src = getComponentID();
+	  wrote->change.address.id = id;
+	  wrote->change.address.subarchitecture = targetSubarch;
+	  wrote->change.type = typeName<CASTTestStruct>();
+	  addToBatch(items, id, wrote);
+	}
+
+	cdl::WorkingMemoryBatchResultSeq results(addToWorkingMemoryBatch(targetSubarch, items));
+	for(cdl::WorkingMemoryBatchResultSeq::const_iterator r = results.begin();
+	    r < results.end(); ++r) {
+	  if(r->outcome != cdl::BATCHWRITTEN) {
+	    println("batch add failed with outcome %d", r->outcome);
+	    testComplete(false);
+	    return;
+	  }
+	}
+
+	if(firstBatch.empty()) {
+	  firstBatch = items;
+	}
+      }
+
+      //partial failures are reported per item
+      cdl::WorkingMemoryBatchResultSeq results(addToWorkingMemoryBatch(targetSubarch, firstBatch));
+      for(cdl::WorkingMemoryBatchResultSeq::const_iterator r = results.begin();
+	  r < results.end(); ++r) {
+	if(r->outcome != cdl::BATCHALREADYEXISTS) {
+	  println("batch re-add gave outcome %d", r->outcome);
+	  testComplete(false);
+	  return;
+	}
+      }
+    } 
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+      return;
+    }
+
+    //wait for a while to let everyone else finish
+    sleepComponent(3000);
+    testComplete(true);
+
+  }
+
+  void BasicTester::WriteRate::startTest() {
+    //sleep a little bit to allow others to get their filters up
+    sleepComponent(1000);
+    
+    BasicTester * tester = dynamic_cast<BasicTester* >(&m_tester);
+    if(tester == NULL) {
+      throw(CASTException(exceptionMessage(__HERE__, "Unable to cast BasicTester")));
+    }
+    string targetSubarch(tester->m_targetSubarch);
+
+    //create the entries first so only the writes are timed
+    vector<string> ids;
+    vector<CASTTestStructPtr> entries;
+    for (int i = 0; i < m_count; i++) {
+      string id(newDataID());
+      CASTTestStructPtr wrote(new CASTTestStruct());
+      wrote->count = i;
+      wrote->change.operation = cdl::ADD;
+      wrote->change.src = getComponentID();
+      wrote->change.address.id = id;
+      wrote->change.address.subarchitecture = targetSubarch;
+      wrote->change.type = typeName<CASTTestStruct>();
+      ids.push_back(id);
+      entries.push_back(wrote);
+    }
+
+    CASTTimer timer(true);
+    try {	
+      for (int i = 0; i < m_count; i++) {
+	addToWorkingMemory(ids[i], targetSubarch, entries[i]);
+      }
+    } 
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+      return;
+    }
+    double elapsed = timer.stop();
+
+    println("%d writes in %.3fs, %.0f writes/s", m_count, elapsed, m_count / elapsed);
+
+    //wait for a while to let everyone else finish
+    sleepComponent(3000);
+    testComplete(true);
+
+  }
+
   void BasicTester::Overwriter::startTest() {
     //sleep a little bit to allow others to get their filters up
     sleepComponent(1000);
@@ -357,6 +520,9 @@ namespace cast {
 
     try {	
       addToWorkingMemory(id, targetSubarch, wrote);
+      if(m_tracked) {
+	trackLatestVersion(id, targetSubarch);
+      }
     } 
     catch (const CASTException & e) {
       cout<<"exception: "<<e.what()<<endl;
@@ -496,6 +662,253 @@ namespace cast {
   }
 
   
+  void BasicTester::FastOverwriter::startTest() {
+    //sleep a little bit to allow others to get their filters up
+    sleepComponent(1000);
+
+    BasicTester * tester = dynamic_cast<BasicTester* >(&m_tester);
+    if(tester == NULL) {
+      throw(CASTException(exceptionMessage(__HERE__, "Unable to cast BasicTester")));
+    }
+
+    cdl::WorkingMemoryAddress wma;
+    wma.id = newDataID();
+    wma.subarchitecture = tester->m_targetSubarch;
+
+    CASTTestStructPtr wrote(new CASTTestStruct());
+    wrote->count = 0;
+    wrote->change.operation = cdl::ADD;
+    wrote->change.src = getComponentID();
+    wrote->change.address = wma;
+    wrote->change.type = typeName<CASTTestStruct>();
+
+    try {	
+      addToWorkingMemory(wma.id, wma.subarchitecture, wrote);
+      for (int i = 1; i <= m_count; i++) {
+	wrote->count = i;
+	overwriteWorkingMemory(wma, wrote);
+      }
+      deleteFromWorkingMemory(wma);
+    } 
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+      return;
+    }
+
+    //wait for a while to let everyone else finish
+    sleepComponent(3000);
+    testComplete(true);
+  }
+
+
+  void BasicTester::Patcher::startTest() {
+
+    cdl::WorkingMemoryAddress wma;
+    wma.id = newDataID();
+    wma.subarchitecture = getSubarchitectureID();
+
+    CASTTestStructPtr wrote(new CASTTestStruct());
+    wrote->count = 0;
+    wrote->change.operation = cdl::ADD;
+    wrote->change.src = getComponentID();
+    wrote->change.address = wma;
+    wrote->change.type = typeName<CASTTestStruct>();
+
+    try {	
+      cdl::WorkingMemoryChangeFilter filter(createLocalTypeFilter<CASTTestStruct>(cdl::OVERWRITE));
+      filter.payload = cdl::PATCHPAYLOAD;
+      addChangeFilter(filter, this);
+
+      addToWorkingMemory(wma.id, freeze(wrote));
+      m_base = getMemoryEntrySnapshot<CASTTestStruct>(wma);
+
+      //same version and length as the stored entry, different bytes
+      CASTTestStructPtr wrongBase(mutableCopy(m_base));
+      wrongBase->count = 5;
+      CASTTestStructPtr wrongPatched(mutableCopy(m_base));
+      wrongPatched->count = 6;
+      try {
+	patchWorkingMemory(wma, freeze(wrongBase), 0, wrongPatched);
+	println("patch against the wrong base was accepted");
+	testComplete(false);
+	return;
+      }
+      catch (const ConsistencyException &) {
+	//expected
+      }
+
+      CASTTestStructPtr patched(mutableCopy(m_base));
+      patched->count = 1;
+      patchWorkingMemory(wma, m_base, 0, patched);
+    } 
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+  void BasicTester::Patcher::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    try {
+      if(!_wmc.patch) {
+	println("overwrite did not carry a patch");
+	testComplete(false);
+	return;
+      }
+      CASTData<CASTTestStruct> patched(getPatchedMemoryEntry(_wmc, m_base, 0));
+      if(patched.getVersion() != 1 || patched.getData()->count != 1) {
+	println("patched entry has count %d at version %d", 
+		static_cast<int>(patched.getData()->count), patched.getVersion());
+	testComplete(false);
+	return;
+      }
+      testComplete(true);
+    }
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+
+  void BasicTester::ReadCacher::startTest() {
+    try {
+      //the filter must see overwrites and deletes for the entry to be cached
+      addChangeFilter(createLocalTypeFilter<CASTTestStruct>(), this);
+
+      CASTTestStructPtr wrote(new CASTTestStruct());
+      wrote->count = 0;
+      addToWorkingMemory(newDataID(), wrote);
+    } 
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+
+  void BasicTester::ReadCacher::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    if(_wmc.operation != cdl::ADD) {
+      return;
+    }
+
+    try {
+      CASTTestStructPtr first(getMemoryEntry<CASTTestStruct>(_wmc.address));
+      CASTTestStructPtr second(getMemoryEntry<CASTTestStruct>(_wmc.address));
+      if(first.get() == second.get()) {
+	println("cached entry was not copied");
+	testComplete(false);
+	return;
+      }
+      
+      second->count = 1;
+      overwriteWorkingMemory(_wmc.address, second);
+      CASTTestStructPtr third(getMemoryEntry<CASTTestStruct>(_wmc.address));
+
+      println("read cache hits: %lu, misses: %lu", getReadCacheHits(), 
+	      getReadCacheMisses());
+      testComplete(third->count == 1 && getReadCacheHits() == 1 
+		   && getReadCacheMisses() == 2);
+    }
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+
+  void BasicTester::CoalescingWatcher::startTest() {
+    try {
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD), this, COALESCE_OVERWRITES);
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::OVERWRITE), this, COALESCE_OVERWRITES);
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::DELETE), this, COALESCE_OVERWRITES);
+    }
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+
+  void BasicTester::CoalescingWatcher::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+
+    //be slow so that overwrites back up behind this receiver
+    sleepComponent(20);
+
+    if(_wmc.operation == cdl::ADD) {
+      ++m_adds;
+    }
+    else if(_wmc.operation == cdl::OVERWRITE) {
+      ++m_overwrites;
+    }
+    else if(_wmc.operation == cdl::DELETE) {
+      ++m_deletes;
+      if(m_deletes == m_expecting) {
+	println("adds: %d, overwrites: %d, deletes: %d, coalesced: %lu, dropped: %lu", 
+		m_adds, m_overwrites, m_deletes, getCoalescedChangeCount(),
+		getDroppedChangeCount());
+	testComplete(m_adds == m_expecting);
+      }
+    }
+  }
+
+
+  void BasicTester::LatencyReader::startTest() {
+    try {
+      cdl::WorkingMemoryChangeFilter filter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD));
+      if(m_inline) {
+	filter.payload = cdl::ENTRYPAYLOAD;
+      }
+      addChangeFilter(filter, this);
+    }
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+    }
+  }
+
+  void BasicTester::LatencyReader::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+
+    try {
+      if(_wmc.entry) {
+	++m_carried;
+      }
+
+      //this is what a receiver would normally do first
+      CASTTestStructPtr read(m_inline ? 
+			     getMemoryEntry<CASTTestStruct>(_wmc) : 
+			     getMemoryEntry<CASTTestStruct>(_wmc.address));
+      if(!read) {
+	println("no entry for %s", _wmc.address.id.c_str());
+	testComplete(false);
+	return;
+      }
+
+      cdl::CASTTime latency(getCASTTime() - _wmc.timestamp);
+      m_latencies.push_back(latency.s * 1000000.0 + latency.us);
+    }
+    catch (const CASTException & e) {
+      cout<<"exception: "<<e.what()<<endl;
+      testComplete(false);
+      return;
+    }
+
+    if(static_cast<int>(m_latencies.size()) == m_expecting) {
+      sort(m_latencies.begin(), m_latencies.end());
+      double total = 0;
+      for(vector<double>::const_iterator i = m_latencies.begin();
+	  i < m_latencies.end(); ++i) {
+	total += *i;
+      }
+      println("%s latency over %d adds (us): mean %.1f, median %.1f, p99 %.1f, carried %d", 
+	      m_inline ? "inline" : "get", m_expecting, total / m_expecting,
+	      m_latencies[m_expecting / 2], m_latencies[(m_expecting * 99) / 100],
+	      m_carried);
+      testComplete(!m_inline || m_carried == m_expecting);
+    }
+  }
+
+
   void BasicTester::Counter::startTest() {
     
     try {
@@ -637,6 +1050,8 @@ namespace cast {
     registerTest("read-write", readWrite);
     shared_ptr<Copier> copy(new Copier(*this));
     registerTest("copy", copy);
+    shared_ptr<Snapshotter> snapshot(new Snapshotter(*this));
+    registerTest("snapshot", snapshot);
 
     shared_ptr<Writer> write10(new Writer(*this, 10));
     registerTest("write-10", write10);
@@ -653,12 +1068,38 @@ namespace cast {
     shared_ptr<Counter> count1000(new Counter(*this, 1000));
     registerTest("count-1000", count1000);
 
+    shared_ptr<LatencyReader> latencyGet1000(new LatencyReader(*this, 1000, false));
+    registerTest("latency-get-1000", latencyGet1000);
+    shared_ptr<LatencyReader> latencyInline1000(new LatencyReader(*this, 1000, true));
+    registerTest("latency-inline-1000", latencyInline1000);
+
+    shared_ptr<BatchWriter> batchWrite100(new BatchWriter(*this, 100, 10));
+    registerTest("batch-write-100", batchWrite100);
+
+    shared_ptr<WriteRate> writeRate1000(new WriteRate(*this, 1000));
+    registerTest("write-rate-1000", writeRate1000);
+
+    shared_ptr<FastOverwriter> fastOverwrite100(new FastOverwriter(*this, 100));
+    registerTest("fast-overwrite-100", fastOverwrite100);
+    shared_ptr<CoalescingWatcher> coalesce3(new CoalescingWatcher(*this, 3));
+    registerTest("coalesce-3", coalesce3);
+    shared_ptr<Patcher> patcher(new Patcher(*this));
+    registerTest("patch", patcher);
+    shared_ptr<ReadCacher> readCacher(new ReadCacher(*this));
+    registerTest("read-cache", readCacher);
+
     shared_ptr<Overwriter> overwrite10(new Overwriter(*this, 10, true));
     registerTest("overwrite", overwrite10);
 
     shared_ptr<Overwriter> unsafeOverwrite10(new Overwriter(*this, 10, false));
     registerTest("unsafe-overwrite", unsafeOverwrite10);
 
+    shared_ptr<Overwriter> trackedOverwrite10(new Overwriter(*this, 10, true, true));
+    registerTest("tracked-overwrite", trackedOverwrite10);
+
+    shared_ptr<Overwriter> trackedUnsafeOverwrite10(new Overwriter(*this, 10, false, true));
+    registerTest("tracked-unsafe-overwrite", trackedUnsafeOverwrite10);
+
     shared_ptr<Replacer> replace(new Replacer(*this));
     registerTest("replace", replace);
 
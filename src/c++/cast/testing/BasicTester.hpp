@@ -81,6 +81,17 @@ namespace cast {
       virtual void startTest();
     };
 
+    class Snapshotter : public AbstractTest, 
+			public WorkingMemoryChangeReceiver {
+    public:
+      Snapshotter(AbstractTester & _tester) : 
+	AbstractTest(_tester){};
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+      
+    protected:
+      virtual void startTest();
+    };
+
     class Replacer : public AbstractTest, 
 		     public WorkingMemoryChangeReceiver {
     public:
@@ -130,21 +141,158 @@ namespace cast {
       int m_count;
     };
 
+    /**
+     * Writes entries in batches, then checks that re-adding a batch
+     * reports every item as already existing.
+     */
+    class BatchWriter : public AbstractTest {
+    public:
+      BatchWriter(AbstractTester & _tester, const int & _count, const int & _batchSize) : 
+	AbstractTest(_tester),
+	m_count(_count),
+	m_batchSize(_batchSize){};
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+      int m_batchSize;
+    };
+
+    /**
+     * Times a run of writes and prints the rate, for comparing
+     * configurations such as --local-clock.
+     */
+    class WriteRate : public AbstractTest {
+    public:
+      WriteRate(AbstractTester & _tester, const int & _count) : 
+	AbstractTest(_tester),
+	m_count(_count){};
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+    };
+
     class Overwriter : public AbstractTest {
     public:
-      Overwriter(AbstractTester & _tester, const int & _count, bool _safe) : 
+      Overwriter(AbstractTester & _tester, const int & _count, bool _safe, 
+		 bool _tracked = false) : 
 	AbstractTest(_tester),
 	m_count(_count),
-	m_safe(_safe)
+	m_safe(_safe),
+	m_tracked(_tracked)
       {};
     protected:
       virtual void startTest();
     private:
       int m_count;
       bool m_safe;
+      ///check consistency against the locally tracked version
+      bool m_tracked;
+    };
+
+
+    /**
+     * Adds an entry, overwrites it as fast as possible, then deletes
+     * it.
+     */
+    class FastOverwriter : public AbstractTest {
+    public:
+      FastOverwriter(AbstractTester & _tester, const int & _count) : 
+	AbstractTest(_tester),
+	m_count(_count)
+      {};
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+    };
+
+    /**
+     * Overwrites an entry with a patch and checks that its own
+     * PATCHPAYLOAD filter receives the patch and can rebuild the
+     * entry from it. First checks that a patch made from a base which
+     * is not the stored entry is rejected.
+     */
+    class Patcher : public AbstractTest, 
+		    public WorkingMemoryChangeReceiver {
+    public:
+      Patcher(AbstractTester & _tester) : 
+	AbstractTest(_tester){};
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+    protected:
+      virtual void startTest();
+    private:
+      ReadOnlyHandle<cdl::testing::CASTTestStruct> m_base;
     };
 
+    /**
+     * Reads an entry twice with the read cache on, expecting the
+     * second read to be answered from the cache, then overwrites it
+     * and checks the next read sees the new entry. Needs --read-cache.
+     */
+    class ReadCacher : public AbstractTest, 
+		       public WorkingMemoryChangeReceiver {
+    public:
+      ReadCacher(AbstractTester & _tester) : 
+	AbstractTest(_tester){};
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+      
+    protected:
+      virtual void startTest();
+    };
 
+    /**
+     * Slow receiver using COALESCE_OVERWRITES, which checks that every
+     * add and delete gets through while overwrites are skipped.
+     */
+    class CoalescingWatcher : public AbstractTest, 
+			      public WorkingMemoryChangeReceiver {
+    public:
+      CoalescingWatcher(AbstractTester & _tester, const int & _entries) : 
+	AbstractTest(_tester),
+	m_expecting(_entries),
+	m_adds(0),
+	m_overwrites(0),
+	m_deletes(0){};
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+      
+    protected:
+      virtual void startTest();
+    private:
+      int m_expecting;
+      int m_adds;
+      int m_overwrites;
+      int m_deletes;
+    };
+
+
+    /**
+     * Receives ADD changes and prints the time from each change being
+     * signalled to the entry being available here. With _inline set
+     * the filter asks for ENTRYPAYLOAD, so the entry comes with the
+     * change instead of being read from working memory.
+     */
+    class LatencyReader : public AbstractTest, 
+			  public WorkingMemoryChangeReceiver {
+    public:
+      LatencyReader(AbstractTester & _tester, const int & _count, bool _inline) : 
+	AbstractTest(_tester),
+	m_expecting(_count),
+	m_inline(_inline),
+	m_carried(0){};
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+      
+    protected:
+      virtual void startTest();
+    private:
+      int m_expecting;
+      bool m_inline;
+      ///changes which arrived with their entry
+      int m_carried;
+      ///latencies in microseconds
+      std::vector<double> m_latencies;
+    };
     
     class Counter : public AbstractTest, 
 		    public WorkingMemoryChangeReceiver {
@@ -184,7 +332,12 @@ namespace cast {
     friend class SingleComponentReadWriteTest;
     friend class TwoComponentReadWriteTest;
     friend class Copier;
+    friend class Snapshotter;
+    friend class BatchWriter;
+    friend class WriteRate;
     friend class Overwriter;
+    friend class FastOverwriter;
+    friend class Patcher;
     friend class Replacer;
     friend class Deleter;
 
@@ -240,6 +240,218 @@ namespace cast {
   }
 
 
+  void LockTester::TimedLocker::startTest() {
+    try {
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD), 
+		      this);            
+    } 
+    catch (CASTException &e) {
+      println(e.what());     
+      testComplete(false);
+    }
+  }
+
+  void LockTester::TimedLocker::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+
+    // give the locker time to lock
+    sleepComponent(500);
+
+    try {
+      log("locking with timeout: %s",_wmc.address.id.c_str());
+      if(lockEntry(_wmc.address, LOCKEDODR, m_timeoutMillis)) {
+	log("lock incorrectly obtained");
+	unlockEntry(_wmc.address);
+	testComplete(false);
+      }
+      else {
+	log("lock correctly timed out");
+	testComplete(true);
+      }
+    }
+    catch (const SubarchitectureComponentException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+
+  void LockTester::AsyncLocker::startTest() {
+    try {
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD), 
+		      this);            
+    } 
+    catch (CASTException &e) {
+      println(e.what());     
+      testComplete(false);
+    }
+  }
+
+  void LockTester::AsyncLocker::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+
+    // give the locker time to lock
+    sleepComponent(500);
+
+    log("locking asynchronously: %s",_wmc.address.id.c_str());
+    m_waited.start();
+    lockEntryAsync(_wmc.address, LOCKEDODR, this);
+  }
+
+  void LockTester::AsyncLocker::entryLocked(const cdl::WorkingMemoryAddress & _wma) {
+    try {
+      println("locked %s after %.1f ms", _wma.id.c_str(), m_waited.stop() * 1000);
+      CASTTestStructPtr cts = getMemoryEntry<CASTTestStruct>(_wma);
+      cts->count++;
+      overwriteWorkingMemory<CASTTestStruct>(_wma, cts);
+      unlockEntry(_wma);
+      testComplete(true);
+    }
+    catch (const SubarchitectureComponentException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+  void LockTester::AsyncLocker::lockFailed(const cdl::WorkingMemoryAddress & _wma,
+					   const Ice::Exception & _e) {
+    println("lock failed on %s: %s", _wma.id.c_str(), _e.what());
+    testComplete(false);
+  }
+
+
+  void LockTester::LockCounter::startTest() {
+    try {
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::OVERWRITE), 
+		      this);            
+      m_elapsed.start();
+    } 
+    catch (CASTException &e) {
+      println(e.what());     
+      testComplete(false);
+    }
+  }
+
+  void LockTester::LockCounter::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    try {
+      CASTTestStructPtr cts = getMemoryEntry<CASTTestStruct>(_wmc.address);
+      if(cts->count >= m_count) {
+	println("%d locks in %.1f ms", cts->count, m_elapsed.stop() * 1000);
+	removeChangeFilter(this);
+	testComplete(true);
+      }
+    }
+    catch (const SubarchitectureComponentException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+
+  void LockTester::IncrementCounter::startTest() {
+    //sleep a little bit to allow others to get their filters up
+    sleepComponent(2000);
+    
+    LockTester * tester = dynamic_cast<LockTester* >(&m_tester);
+    if(tester == NULL) {
+      throw(CASTException(exceptionMessage(__HERE__, "Unable to cast LockTester")));
+    }
+    string targetSubarch(tester->m_targetSubarch);
+    string id(newDataID());
+
+    try {
+      addChangeFilter(createAddressFilter(id,targetSubarch, OVERWRITE), 
+		      this);
+
+      CASTTestStructPtr wrote(new CASTTestStruct());
+      wrote->count = 0;
+      wrote->change.operation = cdl::ADD;
+      wrote->change.src = getComponentID();
+      wrote->change.address.id = id;
+      wrote->change.address.subarchitecture  = targetSubarch;
+      wrote->change.type = typeName<CASTTestStruct>();	
+      m_elapsed.start();
+      addToWorkingMemory(id, targetSubarch, wrote);	
+    } 
+    catch (const CASTException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+  void LockTester::IncrementCounter::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    try {
+      CASTTestStructPtr cts = getMemoryEntry<CASTTestStruct>(_wmc.address);
+      if(cts->count > m_count) {
+	println("counted %d increments, expected %d", cts->count, m_count);
+	removeChangeFilter(this);
+	testComplete(false);
+      }
+      else if(cts->count == m_count) {
+	println("%d increments in %.1f ms", cts->count, m_elapsed.stop() * 1000);
+	removeChangeFilter(this);
+	testComplete(true);
+      }
+    }
+    catch (const SubarchitectureComponentException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+
+  void LockTester::Incrementer::startTest() {
+    try {
+      addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD), 
+		      this);            
+    } 
+    catch (CASTException &e) {
+      println(e.what());     
+      testComplete(false);
+    }
+  }
+
+  void LockTester::Incrementer::workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc) {
+    try {
+      CASTTimer elapsed;
+      int retries = 0;
+      elapsed.start();
+
+      if(m_optimistic) {
+	CASTData<CASTTestStruct> read(getMemoryEntryWithData<CASTTestStruct>(_wmc.address));
+	int version = read.getVersion();
+	CASTTestStructPtr cts = read.getData();
+	for (int i = 0; i < m_count; i++) {
+	  cts->count++;
+	  //on conflict cts is replaced by the current entry
+	  while(!overwriteIfVersion(_wmc.address, version, cts)) {
+	    cts->count++;
+	    retries++;
+	  }
+	}
+      }
+      else {
+	for (int i = 0; i < m_count; i++) {
+	  lockEntry(_wmc.address, LOCKEDODR);
+	  CASTTestStructPtr cts = getMemoryEntry<CASTTestStruct>(_wmc.address);
+	  cts->count++;
+	  overwriteWorkingMemory<CASTTestStruct>(_wmc.address, cts);
+	  unlockEntry(_wmc.address);
+	}
+      }
+
+      println("%s %d increments in %.1f ms with %d retries",
+	      m_optimistic ? "optimistic" : "locked",
+	      m_count, elapsed.stop() * 1000, retries);
+
+      removeChangeFilter(this);
+      testComplete(true);
+    } 
+    catch (const SubarchitectureComponentException & e) {
+      println(e.what());
+      testComplete(false);
+    }
+  }
+
+
   void LockTester::Sneaker::startTest() {
     try {
       addChangeFilter(createGlobalTypeFilter<CASTTestStruct>(cdl::ADD), 
@@ -349,6 +561,24 @@ namespace cast {
     shared_ptr<Locker> lockODR(new Locker(*this, cdl::LOCKEDODR));
     registerTest("lock-odr", lockODR);
 
+    shared_ptr<TimedLocker> timedLock(new TimedLocker(*this, 1000));
+    registerTest("timed-lock", timedLock);
+
+    shared_ptr<AsyncLocker> asyncLock(new AsyncLocker(*this));
+    registerTest("async-lock", asyncLock);
+
+    shared_ptr<LockCounter> countLocks50(new LockCounter(*this, 50));
+    registerTest("count-locks-50", countLocks50);
+
+    shared_ptr<IncrementCounter> countIncrements100(new IncrementCounter(*this, 100));
+    registerTest("count-increments-100", countIncrements100);
+
+    shared_ptr<Incrementer> lockIncrement25(new Incrementer(*this, 25, false));
+    registerTest("lock-increment-25", lockIncrement25);
+
+    shared_ptr<Incrementer> casIncrement25(new Incrementer(*this, 25, true));
+    registerTest("cas-increment-25", casIncrement25);
+
     shared_ptr<Sneaker> sneakO(new Sneaker(*this, cdl::OVERWRITE));
     registerTest("sneak-o", sneakO);
     shared_ptr<Sneaker> sneakOD(new Sneaker(*this, cdl::DELETE));
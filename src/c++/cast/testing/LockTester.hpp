@@ -87,6 +87,114 @@ namespace cast {
       cdl::WorkingMemoryPermissions m_permissions;
     };
 
+    /**
+     * Tries to lock entries held by a Locker with a timeout shorter
+     * than the Locker holds them for, and passes if the lock times
+     * out.
+     */
+    class TimedLocker : public AbstractTest,
+			public WorkingMemoryChangeReceiver {
+    public:
+      TimedLocker(AbstractTester & _tester, const unsigned int & _timeoutMillis) : 
+	AbstractTest(_tester),
+	m_timeoutMillis(_timeoutMillis)
+      {};
+      
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+    protected:
+      virtual void startTest();
+    private:
+      unsigned int m_timeoutMillis;
+    };
+
+    /**
+     * Asks for locks on entries held by a Locker without blocking,
+     * and reports how long each lock took to arrive. Run many of
+     * these against one Locker to measure contention.
+     */
+    class AsyncLocker : public AbstractTest,
+			public WorkingMemoryChangeReceiver,
+			public WorkingMemoryLockReceiver {
+    public:
+      AsyncLocker(AbstractTester & _tester) : 
+	AbstractTest(_tester)
+      {};
+      
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+      virtual void entryLocked(const cdl::WorkingMemoryAddress & _wma);
+      virtual void lockFailed(const cdl::WorkingMemoryAddress & _wma,
+			      const Ice::Exception & _e);
+    protected:
+      virtual void startTest();
+    private:
+      CASTTimer m_waited;
+    };
+
+    /**
+     * Completes when an entry has been overwritten a number of times,
+     * as each AsyncLocker does once.
+     */
+    class LockCounter : public AbstractTest,
+			public WorkingMemoryChangeReceiver {
+    public:
+      LockCounter(AbstractTester & _tester, const int & _count) : 
+	AbstractTest(_tester),
+	m_count(_count)
+      {};
+      
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+      CASTTimer m_elapsed;
+    };
+
+    /**
+     * Adds an entry for Incrementers to count on, and completes when
+     * the count reaches the total they should reach between them,
+     * reporting how long that took.
+     */
+    class IncrementCounter : public AbstractTest,
+			     public WorkingMemoryChangeReceiver {
+    public:
+      IncrementCounter(AbstractTester & _tester, const int & _count) : 
+	AbstractTest(_tester),
+	m_count(_count)
+      {};
+      
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+      CASTTimer m_elapsed;
+    };
+
+    /**
+     * Increments the count of an IncrementCounter's entry a number of
+     * times as fast as it can, either taking a lock for each increment
+     * or overwriting with overwriteIfVersion and retrying on conflict.
+     * Run several against one IncrementCounter to compare the two
+     * under contention.
+     */
+    class Incrementer : public AbstractTest,
+			public WorkingMemoryChangeReceiver {
+    public:
+      Incrementer(AbstractTester & _tester, const int & _count, bool _optimistic) : 
+	AbstractTest(_tester),
+	m_count(_count),
+	m_optimistic(_optimistic)
+      {};
+      
+      virtual void workingMemoryChanged(const cdl::WorkingMemoryChange & _wmc);
+    protected:
+      virtual void startTest();
+    private:
+      int m_count;
+      bool m_optimistic;
+    };
+
     class Sneaker : public AbstractTest,
 		    public WorkingMemoryChangeReceiver {
     public:
@@ -0,0 +1,351 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+
+/**
+ * Micro-benchmarks for the working memory internals. These run
+ * in-process without a CAST server, e.g.
+ *
+ * cast-wm-benchmark storage
+ * cast-wm-benchmark sync
+ * cast-wm-benchmark filters
+ *
+ * Run without arguments to run all of them.
+ */
+
+#include <cast/core/CASTWorkingMemory.hpp>
+#include <cast/core/CASTTimer.hpp>
+#include <cast/architecture/WorkingMemoryChangeFilterMap.hpp>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cast;
+using namespace cast::cdl;
+
+namespace {
+
+  string makeID(int _i) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%d:bench", _i);
+    return buffer;
+  }
+
+  /**
+   * The recency maintenance CASTWorkingMemory used before ids kept
+   * their list positions, for comparison.
+   */
+  class ListRemoveRecency {
+  public:
+    void add(const string & _id) {
+      m_ids.push_front(_id);
+    }
+    void overwrite(const string & _id) {
+      m_ids.remove(_id);
+      m_ids.push_front(_id);
+    }
+    void remove(const string & _id) {
+      m_ids.remove(_id);
+    }
+  private:
+    StringList m_ids;
+  };
+
+
+  /**
+   * Time overwrites and removes of random entries in a store of
+   * _entries entries.
+   */
+  void benchmarkStorage(int _entries, int _operations) {
+
+    vector<string> ids;
+    ids.reserve(_entries);
+    for(int i = 0; i < _entries; ++i) {
+      ids.push_back(makeID(i));
+    }
+
+    vector<int> targets;
+    targets.reserve(_operations);
+    srand(_entries);
+    for(int i = 0; i < _operations; ++i) {
+      targets.push_back(rand() % _entries);
+    }
+
+    vector<string> superTypes;
+    superTypes.push_back("::Ice::Object");
+    superTypes.push_back("::cast::bench::Entry");
+
+    CASTWorkingMemory wm;
+    ListRemoveRecency reference;
+    for(int i = 0; i < _entries; ++i) {
+      wm.add(ids[i], new WorkingMemoryEntry(ids[i], superTypes[1], 0, 0), superTypes);
+      reference.add(ids[i]);
+    }
+
+    CASTTimer timer;
+
+    timer.start();
+    for(int i = 0; i < _operations; ++i) {
+      const string & id(ids[targets[i]]);
+      wm.overwrite(id, new WorkingMemoryEntry(id, superTypes[1], 0, 0));
+    }
+    double wmOverwrite = timer.stop();
+
+    timer.restart();
+    for(int i = 0; i < _operations; ++i) {
+      reference.overwrite(ids[targets[i]]);
+    }
+    double refOverwrite = timer.stop();
+
+    //remove distinct entries from the end of the id range
+    int removals = min(_operations, _entries);
+
+    timer.restart();
+    for(int i = 0; i < removals; ++i) {
+      wm.remove(ids[_entries - 1 - i]);
+    }
+    double wmRemove = timer.stop();
+
+    timer.restart();
+    for(int i = 0; i < removals; ++i) {
+      reference.remove(ids[_entries - 1 - i]);
+    }
+    double refRemove = timer.stop();
+
+    printf("storage %7d entries: overwrite %8.3f us/op (list::remove %8.3f us/op), "
+	   "remove %8.3f us/op (list::remove %8.3f us/op)\n",
+	   _entries,
+	   1e6 * wmOverwrite / _operations, 1e6 * refOverwrite / _operations,
+	   1e6 * wmRemove / removals, 1e6 * refRemove / removals);
+  }
+
+  void benchmarkStorage() {
+    benchmarkStorage(10000, 2000);
+    benchmarkStorage(100000, 2000);
+  }
+
+
+  void readEntries(CASTWorkingMemory * _wm, 
+		   const vector<string> * _ids, 
+		   int _reads) {
+    size_t n = _ids->size();
+    for(int i = 0; i < _reads; ++i) {
+      _wm->get((*_ids)[i % n]);
+    }
+  }
+
+  /**
+   * Time concurrent gets from _threads threads under the given sync
+   * strategy.
+   */
+  double benchmarkSync(CASTWorkingMemory::SyncStrategy _sync, 
+		       int _threads, int _reads,
+		       const vector<string> & _ids) {
+
+    CASTWorkingMemory wm(_sync);
+    for(vector<string>::const_iterator i = _ids.begin();
+	i < _ids.end(); ++i) {
+      wm.add(*i, new WorkingMemoryEntry(*i, "::cast::bench::Entry", 0, 0));
+    }
+
+    CASTTimer timer(true);
+    boost::thread_group readers;
+    for(int i = 0; i < _threads; ++i) {
+      readers.create_thread(boost::bind(&readEntries, &wm, &_ids, _reads));
+    }
+    readers.join_all();
+    return timer.stop();
+  }
+
+  void benchmarkSync() {
+    
+    vector<string> ids;
+    for(int i = 0; i < 10000; ++i) {
+      ids.push_back(makeID(i));
+    }
+
+    const int reads = 200000;
+    unsigned int cores = max(1u, boost::thread::hardware_concurrency());
+
+    for(unsigned int threads = 1; threads <= cores; threads *= 2) {
+      double exclusive = benchmarkSync(CASTWorkingMemory::SYNC_EXCLUSIVE,
+				       threads, reads, ids);
+      double shared = benchmarkSync(CASTWorkingMemory::SYNC_SHARED,
+				    threads, reads, ids);
+      double none = benchmarkSync(CASTWorkingMemory::SYNC_NONE,
+				  threads, reads, ids);
+      printf("sync %2d threads: exclusive %10.0f gets/s, shared %10.0f gets/s, "
+	     "none %10.0f gets/s\n",
+	     threads, 
+	     threads * reads / exclusive, 
+	     threads * reads / shared,
+	     threads * reads / none);
+    }
+  }
+
+
+  /**
+   * The matching WorkingMemoryChangeFilterMap::get did before it was
+   * indexed, for comparison.
+   */
+  void linearGet(const map<WorkingMemoryChangeFilter, vector<string>, 
+		 WorkingMemoryChangeFilterComparator> & _filters,
+		 const WorkingMemoryChange & _wmc,
+		 vector<string> & _receivers) {
+    for(map<WorkingMemoryChangeFilter, vector<string>, 
+	  WorkingMemoryChangeFilterComparator>::const_iterator i = _filters.begin();
+	i != _filters.end(); ++i) {
+      if (WorkingMemoryChangeFilterComparator::allowsChange(i->first, _wmc)) {
+	vector<string> receivers = i->second;
+	_receivers.insert(_receivers.end(), receivers.begin(), receivers.end());
+      }
+    }
+  }
+
+  string makeType(int _i) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "::cast::bench::Type%d", _i);
+    return buffer;
+  }
+
+  /**
+   * Time matching changes against _filterCount filters, with a mix
+   * of type, address and wildcard filters as registered by typical
+   * components.
+   */
+  void benchmarkFilters(int _filterCount, int _changes) {
+
+    const int types = 50;
+    const int entries = 1000;
+
+    srand(_filterCount);
+
+    WorkingMemoryChangeFilterMap<string> indexed;
+    map<WorkingMemoryChangeFilter, vector<string>, 
+      WorkingMemoryChangeFilterComparator> linear;
+
+    for(int i = 0; i < _filterCount; ++i) {
+      WorkingMemoryChangeFilter filter;
+      filter.operation = static_cast<WorkingMemoryOperation>(rand() % (WILDCARD + 1));
+      filter.restriction = LOCALSA;
+      filter.address.subarchitecture = "bench.sa";
+      filter.origin = makeID(i);
+      filter.payload = NOPAYLOAD;
+      
+      int kind = rand() % 10;
+      if(kind < 7) {
+	filter.type = makeType(rand() % types);
+      }
+      else if(kind < 9) {
+	filter.address.id = makeID(rand() % entries);
+      }
+      //else match everything in the subarchitecture
+
+      indexed.put(filter, filter.origin, 0);
+      linear[filter].push_back(filter.origin);
+    }
+
+    vector<WorkingMemoryChange> changes(_changes);
+    for(int i = 0; i < _changes; ++i) {
+      WorkingMemoryChange & wmc(changes[i]);
+      wmc.operation = static_cast<WorkingMemoryOperation>(rand() % (GET + 1));
+      wmc.src = "bench.writer";
+      wmc.address.id = makeID(rand() % entries);
+      wmc.address.subarchitecture = "bench.sa";
+      wmc.type = makeType(rand() % types);
+      wmc.superTypes.push_back("::Ice::Object");
+      wmc.superTypes.push_back(wmc.type);
+      sort(wmc.superTypes.begin(), wmc.superTypes.end());
+    }
+
+    size_t matched = 0;
+    CASTTimer timer(true);
+    for(int i = 0; i < _changes; ++i) {
+      vector<string> receivers;
+      indexed.get(changes[i], receivers);
+      matched += receivers.size();
+    }
+    double indexedTime = timer.stop();
+
+    size_t linearMatched = 0;
+    timer.restart();
+    for(int i = 0; i < _changes; ++i) {
+      vector<string> receivers;
+      linearGet(linear, changes[i], receivers);
+      linearMatched += receivers.size();
+    }
+    double linearTime = timer.stop();
+
+    //sanity check the two agree
+    for(int i = 0; i < _changes; ++i) {
+      vector<string> a, b;
+      indexed.get(changes[i], a);
+      linearGet(linear, changes[i], b);
+      if(a != b) {
+	printf("filters %4d: MISMATCH for change %d\n", _filterCount, i);
+	exit(1);
+      }
+    }
+
+    printf("filters %4d: indexed %8.3f us/change, linear %8.3f us/change (%.2f receivers/change)\n",
+	   _filterCount, 
+	   1e6 * indexedTime / _changes, 
+	   1e6 * linearTime / _changes,
+	   double(matched) / _changes);
+  }
+
+  void benchmarkFilters() {
+    benchmarkFilters(10, 100000);
+    benchmarkFilters(100, 100000);
+    benchmarkFilters(1000, 20000);
+  }
+
+}
+
+
+int main(int _argc, char * _argv[]) {
+
+  string which(_argc > 1 ? _argv[1] : "");
+
+  if(which.empty() || which == "storage") {
+    benchmarkStorage();
+  }
+
+  if(which.empty() || which == "sync") {
+    benchmarkSync();
+  }
+
+  if(which.empty() || which == "filters") {
+    benchmarkFilters();
+  }
+
+  return 0;
+}
@@ -3,6 +3,7 @@
  */
 package cast.architecture;
 
+import cast.cdl.ChangePayload;
 import cast.cdl.FilterRestriction;
 import cast.cdl.WorkingMemoryAddress;
 import cast.cdl.WorkingMemoryChangeFilter;
@@ -81,7 +82,7 @@ public class ChangeFilterFactory {
 			String _changeSA, FilterRestriction _restriction) {
 		return new WorkingMemoryChangeFilter(_op, _src,
 				new WorkingMemoryAddress(_changeID, _changeSA), _type,
-				_restriction, "");
+				_restriction, "", ChangePayload.NOPAYLOAD);
 
 	}
 
@@ -22,28 +22,41 @@ import java.util.LinkedList;
 import java.util.List;
 import java.util.Map;
 import java.util.Queue;
+import java.util.concurrent.ExecutorService;
+import java.util.concurrent.Executors;
 import java.util.concurrent.locks.Lock;
 import java.util.concurrent.locks.ReentrantReadWriteLock;
 
 import Ice.Current;
 import cast.AlreadyExistsOnWMException;
+import cast.CASTException;
 import cast.ConsistencyException;
 import cast.DoesNotExistOnWMException;
+import cast.PermissionException;
 import cast.UnknownSubarchitectureException;
 import cast.cdl.IGNORESAKEY;
+import cast.cdl.LockStatistics;
+import cast.cdl.ReaderLag;
 import cast.cdl.WMIDSKEY;
 import cast.cdl.WorkingMemoryAddress;
+import cast.cdl.WorkingMemoryBatchItem;
+import cast.cdl.WorkingMemoryBatchOutcome;
+import cast.cdl.WorkingMemoryBatchResult;
 import cast.cdl.WorkingMemoryChange;
 import cast.cdl.WorkingMemoryChangeFilter;
 import cast.cdl.WorkingMemoryEntry;
 import cast.cdl.WorkingMemoryEntrySeqHolder;
 import cast.cdl.WorkingMemoryOperation;
+import cast.cdl.WorkingMemoryPatch;
 import cast.cdl.WorkingMemoryPermissions;
 import cast.core.CASTUtils;
 import cast.core.CASTWMPermissionMap;
 import cast.core.CASTWorkingMemory;
 import cast.core.CASTWorkingMemoryInterface;
+import cast.core.EntryPatch;
 import cast.core.SubarchitectureComponent;
+import cast.interfaces.AMD_WorkingMemory_lockEntry;
+import cast.interfaces.AMD_WorkingMemory_lockEntryWithTimeout;
 import cast.interfaces.WorkingMemoryPrx;
 import cast.interfaces.WorkingMemoryPrxHelper;
 import cast.interfaces.WorkingMemoryReaderComponentPrx;
@@ -95,6 +108,12 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 	private final Lock m_readLock;
 	private final Lock m_writeLock;
 
+	/**
+	 * Runs lockEntry calls, which may wait for a long time, so they do not
+	 * hold Ice dispatch threads that other calls need.
+	 */
+	private final ExecutorService m_lockWaiters;
+
 	/**
 	 * Construct new object with a unique id. Name should be created with
 	 * createName.
@@ -116,11 +135,19 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 		// sub-architectures
 		setSendXarchChangeNotifications(true);
 		m_readers = new ArrayList<WorkingMemoryReaderComponentPrx>();
+		m_readerLag = new ArrayList<ReaderLag>();
 		m_workingMemories = new HashMap<String, WorkingMemoryPrx>();
 		m_workingMemories_oneway = new HashMap<String, WorkingMemoryPrx>();
 		m_readWriteLock = new ReentrantReadWriteLock();
 		m_readLock = m_readWriteLock.readLock();
 		m_writeLock = m_readWriteLock.writeLock();
+		m_lockWaiters = Executors.newCachedThreadPool();
+	}
+
+	@Override
+	protected void stopInternal() {
+		super.stopInternal();
+		m_lockWaiters.shutdownNow();
 	}
 
 	/*
@@ -229,6 +256,12 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 	private final ArrayList<WorkingMemoryReaderComponentPrx> m_readers;
 
+	/**
+	 * Changes sent to each reader in m_readers and its last report of
+	 * progress. Also guards additions to m_readers.
+	 */
+	private final ArrayList<ReaderLag> m_readerLag;
+
 	/**
 	 * Add some data to working memory. If the given id already exists in the
 	 * working memory then the data isn't added and false is returned.
@@ -544,7 +577,8 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 		WorkingMemoryChange wmc = new WorkingMemoryChange(_op, _src,
 				new WorkingMemoryAddress(_id, getSubarchitectureID()), _type,
-				_typeHierarchy, getCASTTime());
+				_typeHierarchy, getCASTTime(), null, null, 0,
+				m_workingMemory.getOverwriteCount(_id));
 
 		// if (m_logger.getLevel().isGreaterOrEqual(Level.TRACE)) {
 		debug("SAWN.sigCh: " + CASTUtils.toString(wmc));
@@ -553,8 +587,9 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 		// signal change locally if allowed
 		if (isAllowedChange(wmc)) {
 			// send locally
-			for (WorkingMemoryReaderComponentPrx reader : m_readers) {
-				reader.receiveChangeEvent(wmc);
+			for (int i = 0; i < m_readers.size(); i++) {
+				m_readers.get(i).receiveChangeEvent(wmc);
+				countSent(i, 1);
 			}
 		} else {
 			// debug("SAWN.sigCh: not sending locally");
@@ -604,9 +639,63 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 	public void addReader(WorkingMemoryReaderComponentPrx _reader,
 			Current __current) {
 		// convert to one-way proxies for speed
-		m_readers.add(WorkingMemoryReaderComponentPrxHelper
-				.uncheckedCast(_reader.ice_oneway()));
+		WorkingMemoryReaderComponentPrx oneway = WorkingMemoryReaderComponentPrxHelper
+				.uncheckedCast(_reader.ice_oneway());
+
+		// readers report progress using their id
+		String readerID;
+		try {
+			readerID = _reader.getID();
+		} catch (Ice.LocalException e) {
+			readerID = oneway.toString();
+		}
+
+		synchronized (m_readerLag) {
+			m_readers.add(oneway);
+			m_readerLag.add(new ReaderLag(readerID, 0, 0, 0, 0));
+		}
+
+	}
+
+	/**
+	 * Count changes sent to the reader at the given index of m_readers.
+	 */
+	private void countSent(int _reader, long _count) {
+		synchronized (m_readerLag) {
+			m_readerLag.get(_reader).sent += _count;
+		}
+	}
+
+	public void reportReaderProgress(String _component, long _processed,
+			long _dropped, boolean _overflowing, Current __current) {
+		synchronized (m_readerLag) {
+			for (ReaderLag lag : m_readerLag) {
+				// oneway reports may arrive out of order
+				if (lag.component.equals(_component)
+						&& _processed >= lag.processed) {
+					lag.processed = _processed;
+					lag.dropped = _dropped;
+					if (_overflowing) {
+						lag.overflows++;
+						println("reader " + _component
+								+ " has a full change queue: "
+								+ (lag.sent - lag.processed - lag.dropped)
+								+ " changes behind, " + lag.dropped
+								+ " dropped");
+					}
+				}
+			}
+		}
+	}
 
+	public ReaderLag[] getReaderLag(Current __current) {
+		synchronized (m_readerLag) {
+			ReaderLag[] lags = new ReaderLag[m_readerLag.size()];
+			for (int i = 0; i < lags.length; i++) {
+				lags[i] = (ReaderLag) m_readerLag.get(i).clone();
+			}
+			return lags;
+		}
 	}
 
 	private final WorkingMemoryPrx getWorkingMemory(String _subarch)
@@ -622,6 +711,11 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 	private final HashMap<String, WorkingMemoryPrx> m_workingMemories;
 	private final HashMap<String, WorkingMemoryPrx> m_workingMemories_oneway;
 
+	/**
+	 * Super types for compact changes forwarded from C++ working memories.
+	 */
+	private final TypeHierarchyCache m_typeHierarchies = new TypeHierarchyCache();
+
 	public void addToWorkingMemory(String _id, String _subarch, String _type,
 			String _component, Ice.Object _entry, Current __current)
 			throws AlreadyExistsOnWMException, UnknownSubarchitectureException {
@@ -658,6 +752,149 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 	}
 
+	/**
+	 * Whether a lock held by another component prevents _component from
+	 * overwriting (or deleting if _delete is true) the entry.
+	 */
+	private boolean isLockedAgainst(String _id, String _component,
+			boolean _delete) {
+		if (!m_permissions.isLocked(_id)) {
+			return false;
+		}
+		WorkingMemoryPermissions permissions = m_permissions
+				.getPermissions(_id);
+		boolean allowed = _delete ? CASTUtils.deleteAllowed(permissions)
+				: CASTUtils.overwriteAllowed(permissions);
+		return !allowed && !m_permissions.isLockHolder(_id, _component);
+	}
+
+	private WorkingMemoryBatchResult batchResult(String _id,
+			WorkingMemoryBatchOutcome _outcome) {
+		int version = -1;
+		if (m_workingMemory.hasContained(_id)) {
+			version = m_workingMemory.getOverwriteCount(_id);
+		}
+		return new WorkingMemoryBatchResult(_outcome, version);
+	}
+
+	public WorkingMemoryBatchResult[] addToWorkingMemoryBatch(String _subarch,
+			String _component, WorkingMemoryBatchItem[] _items,
+			Current __current) throws UnknownSubarchitectureException {
+
+		if (!getSubarchitectureID().equals(_subarch)) {
+			return getWorkingMemory(_subarch).addToWorkingMemoryBatch(
+					_subarch, _component, _items);
+		}
+
+		WorkingMemoryBatchResult[] results = new WorkingMemoryBatchResult[_items.length];
+		m_writeLock.lock();
+		try {
+			for (int i = 0; i < _items.length; i++) {
+				WorkingMemoryBatchItem item = _items[i];
+				WorkingMemoryBatchOutcome outcome;
+				if (m_workingMemory.contains(item.id)) {
+					outcome = WorkingMemoryBatchOutcome.BATCHALREADYEXISTS;
+				} else if (item.entry == null) {
+					outcome = WorkingMemoryBatchOutcome.BATCHNOENTRY;
+				} else {
+					boolean result = addToWorkingMemory(item.id,
+							new WorkingMemoryEntry(item.id, item.type, 0,
+									item.entry));
+					// sanity check
+					assert (result);
+					signalChange(WorkingMemoryOperation.ADD, _component,
+							item.id, item.type, item.entry.ice_ids());
+					outcome = WorkingMemoryBatchOutcome.BATCHWRITTEN;
+				}
+				results[i] = batchResult(item.id, outcome);
+			}
+		} finally {
+			m_writeLock.unlock();
+		}
+		return results;
+	}
+
+	public WorkingMemoryBatchResult[] overwriteWorkingMemoryBatch(
+			String _subarch, String _component,
+			WorkingMemoryBatchItem[] _items, Current __current)
+			throws UnknownSubarchitectureException {
+
+		if (!getSubarchitectureID().equals(_subarch)) {
+			return getWorkingMemory(_subarch).overwriteWorkingMemoryBatch(
+					_subarch, _component, _items);
+		}
+
+		WorkingMemoryBatchResult[] results = new WorkingMemoryBatchResult[_items.length];
+		m_writeLock.lock();
+		try {
+			for (int i = 0; i < _items.length; i++) {
+				WorkingMemoryBatchItem item = _items[i];
+				WorkingMemoryBatchOutcome outcome;
+				if (!m_workingMemory.contains(item.id)) {
+					outcome = WorkingMemoryBatchOutcome.BATCHDOESNOTEXIST;
+				} else if (isLockedAgainst(item.id, _component, false)) {
+					outcome = WorkingMemoryBatchOutcome.BATCHLOCKED;
+				} else if (item.entry == null) {
+					outcome = WorkingMemoryBatchOutcome.BATCHNOENTRY;
+				} else {
+					try {
+						overwriteWorkingMemory(item.id, new WorkingMemoryEntry(
+								item.id, item.type, 0, item.entry), _component);
+					} catch (DoesNotExistOnWMException e) {
+						// checked above
+						throw new RuntimeException(e);
+					}
+					signalChange(WorkingMemoryOperation.OVERWRITE, _component,
+							item.id, item.type, item.entry.ice_ids());
+					outcome = WorkingMemoryBatchOutcome.BATCHWRITTEN;
+				}
+				results[i] = batchResult(item.id, outcome);
+			}
+		} finally {
+			m_writeLock.unlock();
+		}
+		return results;
+	}
+
+	public WorkingMemoryBatchResult[] deleteFromWorkingMemoryBatch(
+			String _subarch, String _component, String[] _ids,
+			Current __current) throws UnknownSubarchitectureException {
+
+		if (!getSubarchitectureID().equals(_subarch)) {
+			return getWorkingMemory(_subarch).deleteFromWorkingMemoryBatch(
+					_subarch, _component, _ids);
+		}
+
+		WorkingMemoryBatchResult[] results = new WorkingMemoryBatchResult[_ids.length];
+		m_writeLock.lock();
+		try {
+			for (int i = 0; i < _ids.length; i++) {
+				String id = _ids[i];
+				WorkingMemoryBatchOutcome outcome;
+				if (!m_workingMemory.contains(id)) {
+					outcome = WorkingMemoryBatchOutcome.BATCHDOESNOTEXIST;
+				} else if (isLockedAgainst(id, _component, true)) {
+					outcome = WorkingMemoryBatchOutcome.BATCHLOCKED;
+				} else {
+					WorkingMemoryEntry entry;
+					try {
+						entry = deleteFromWorkingMemory(id, _component);
+					} catch (DoesNotExistOnWMException e) {
+						// checked above
+						throw new RuntimeException(e);
+					}
+					signalChange(WorkingMemoryOperation.DELETE, _component,
+							id, entry.type, entry.entry.ice_ids());
+					outcome = WorkingMemoryBatchOutcome.BATCHWRITTEN;
+				}
+				results[i] = batchResult(id, outcome);
+			}
+		} finally {
+			m_writeLock.unlock();
+		}
+		return results;
+	}
+
 	public void deleteFromWorkingMemory(String _id, String _subarch,
 			String _component, Current __current)
 			throws DoesNotExistOnWMException, UnknownSubarchitectureException {
@@ -817,9 +1054,41 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 	}
 
-	public void lockEntry(String _id, String _subarch, String _component,
-			WorkingMemoryPermissions _perm, Current __current)
-			throws DoesNotExistOnWMException, UnknownSubarchitectureException {
+	public void lockEntry_async(final AMD_WorkingMemory_lockEntry __cb,
+			final String _id, final String _subarch, final String _component,
+			final WorkingMemoryPermissions _perm, Current __current) {
+		m_lockWaiters.execute(new Runnable() {
+			public void run() {
+				try {
+					lockEntry(_id, _subarch, _component, _perm);
+					__cb.ice_response();
+				} catch (Ice.UserException e) {
+					__cb.ice_exception(e);
+				}
+			}
+		});
+	}
+
+	public void lockEntryWithTimeout_async(
+			final AMD_WorkingMemory_lockEntryWithTimeout __cb,
+			final String _id, final String _subarch, final String _component,
+			final WorkingMemoryPermissions _perm, final int _timeout,
+			Current __current) {
+		m_lockWaiters.execute(new Runnable() {
+			public void run() {
+				try {
+					__cb.ice_response(lockEntryWithTimeout(_id, _subarch,
+							_component, _perm, _timeout));
+				} catch (Ice.UserException e) {
+					__cb.ice_exception(e);
+				}
+			}
+		});
+	}
+
+	private void lockEntry(String _id, String _subarch, String _component,
+			WorkingMemoryPermissions _perm) throws DoesNotExistOnWMException,
+			UnknownSubarchitectureException {
 		// if this is for me
 		if (getSubarchitectureID().equals(_subarch)) {
 
@@ -920,7 +1189,146 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 	}
 
+	/**
+	 * Overwrite an entry only if it is still at the expected version,
+	 * checking and writing under the write lock. Returns null on success,
+	 * else the current entry.
+	 */
+	public WorkingMemoryEntry overwriteIfVersion(String _id, String _subarch,
+			String _type, String _component, int _expectedVersion,
+			Ice.Object _entry, Ice.IntHolder _version, Current __current)
+			throws DoesNotExistOnWMException, PermissionException,
+			UnknownSubarchitectureException {
+		// if this is for me
+		if (getSubarchitectureID().equals(_subarch)) {
+			m_writeLock.lock();
+			try {
+				WorkingMemoryEntry current = m_workingMemory.get(_id);
+				if (current == null) {
+					throw new DoesNotExistOnWMException(
+							"Entry does not exist to overwrite. Was trying to overwrite id "
+									+ _id + " in subarchitecture "
+									+ getSubarchitectureID(),
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+				if (isLockedAgainst(_id, _component, false)) {
+					throw new PermissionException(
+							"Overwrite not allowed on locked item: " + _id
+									+ ":" + getSubarchitectureID(),
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+				int version = m_workingMemory.getOverwriteCount(_id);
+				if (version != _expectedVersion) {
+					_version.value = version;
+					return current;
+				}
+
+				boolean result = overwriteWorkingMemory(_id,
+						new WorkingMemoryEntry(_id, _type, 0, _entry),
+						_component);
+				// sanity check
+				assert (result);
+				signalChange(WorkingMemoryOperation.OVERWRITE, _component, _id,
+						_type, _entry.ice_ids());
+				_version.value = m_workingMemory.getOverwriteCount(_id);
+				return null;
+			} finally {
+				m_writeLock.unlock();
+			}
+		} else {
+			// send on to the one that really cares
+			return getWorkingMemory(_subarch).overwriteIfVersion(_id, _subarch,
+					_type, _component, _expectedVersion, _entry, _version);
+		}
+	}
+
+	/**
+	 * Overwrite an entry by patching the version it holds. Readers are sent
+	 * the overwrite without the patch.
+	 */
+	public void patchWorkingMemory(String _id, String _subarch, String _type,
+			String _component, WorkingMemoryPatch _patch, Current __current)
+			throws DoesNotExistOnWMException, ConsistencyException,
+			UnknownSubarchitectureException {
+		// if this is for me
+		if (getSubarchitectureID().equals(_subarch)) {
+			m_writeLock.lock();
+			try {
+				WorkingMemoryEntry current = m_workingMemory.get(_id);
+				if (current == null) {
+					throw new DoesNotExistOnWMException(
+							"Entry does not exist to patch. Was trying to patch id "
+									+ _id + " in subarchitecture "
+									+ getSubarchitectureID(),
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+				if (_patch == null) {
+					throw new ConsistencyException("Null patch for " + _id
+							+ ":" + getSubarchitectureID(),
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+				int version = m_workingMemory.getOverwriteCount(_id);
+				if (version != _patch.baseVersion) {
+					throw new ConsistencyException("Patch for " + _id + ":"
+							+ getSubarchitectureID() + " is against version "
+							+ _patch.baseVersion
+							+ ", but the entry is at version " + version,
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+
+				Ice.Object entry;
+				try {
+					entry = EntryPatch.unmarshalEntry(getCommunicator(),
+							EntryPatch.applyPatch(_patch, EntryPatch
+									.marshalEntry(getCommunicator(),
+											current.entry)));
+				} catch (CASTException e) {
+					throw new ConsistencyException(e.message,
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				} catch (Ice.MarshalException e) {
+					throw new ConsistencyException(
+							"Unable to unmarshal patched entry for " + _id
+									+ ":" + getSubarchitectureID() + ": " + e,
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+				if (entry == null) {
+					throw new ConsistencyException("Patch for " + _id + ":"
+							+ getSubarchitectureID()
+							+ " produced a null entry",
+							new WorkingMemoryAddress(_id,
+									getSubarchitectureID()));
+				}
+
+				boolean result = overwriteWorkingMemory(_id,
+						new WorkingMemoryEntry(_id, _type, 0, entry),
+						_component);
+				// sanity check
+				assert (result);
+				signalChange(WorkingMemoryOperation.OVERWRITE, _component, _id,
+						_type, entry.ice_ids());
+			} finally {
+				m_writeLock.unlock();
+			}
+		} else {
+			// send on to the one that really cares
+			getWorkingMemory(_subarch).patchWorkingMemory(_id, _subarch, _type,
+					_component, _patch);
+		}
+	}
+
 	public void receiveChangeEvent(WorkingMemoryChange _wmc, Current __current) {
+		// changes from C++ working memories may only carry a hierarchy id,
+		// which Java filters cannot match on
+		m_typeHierarchies.expand(_wmc,
+				m_workingMemories.get(_wmc.address.subarchitecture));
+
 		lockComponent();
 
 		// if the filters require external changes, allow them to be
@@ -933,8 +1341,9 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 			// debug(outStream.str());
 			// }
 
-			for (WorkingMemoryReaderComponentPrx reader : m_readers) {
-				reader.receiveChangeEvent(_wmc);
+			for (int i = 0; i < m_readers.size(); i++) {
+				m_readers.get(i).receiveChangeEvent(_wmc);
+				countSent(i, 1);
 			}
 
 		}
@@ -943,6 +1352,25 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 
 	}
 
+	public void receiveChangeEvents(WorkingMemoryChange[] _wmcs,
+			Current __current) {
+		for (WorkingMemoryChange wmc : _wmcs) {
+			m_typeHierarchies.expand(wmc,
+					m_workingMemories.get(wmc.address.subarchitecture));
+		}
+
+		lockComponent();
+
+		if (!m_componentFilters.localFiltersOnly()) {
+			for (int i = 0; i < m_readers.size(); i++) {
+				m_readers.get(i).receiveChangeEvents(_wmcs);
+				countSent(i, _wmcs.length);
+			}
+		}
+
+		unlockComponent();
+	}
+
 	public void registerComponentFilter(WorkingMemoryChangeFilter _filter,
 			int _priority, Current __current) {
 		debug("SubarchitectureWorkingMemory.registerComponentFilter()");
@@ -1052,6 +1480,75 @@ public class SubarchitectureWorkingMemory extends SubarchitectureComponent
 		}
 	}
 
+	private boolean lockEntryWithTimeout(String _id, String _subarch,
+			String _component, WorkingMemoryPermissions _perm, int _timeout)
+			throws DoesNotExistOnWMException, UnknownSubarchitectureException {
+		// if this is for me
+		if (getSubarchitectureID().equals(_subarch)) {
+			if (!m_workingMemory.contains(_id)) {
+				throw new DoesNotExistOnWMException(
+						"Entry does not exist to lock. Component " + _component
+								+ "  was looking in subarch " + _subarch
+								+ " for id " + _id, new WorkingMemoryAddress(
+								_id, _subarch));
+			}
+
+			boolean locked = false;
+			try {
+				locked = m_permissions.lock(_id, _component, _perm, _timeout);
+			} catch (InterruptedException e) {
+				logException(e);
+			}
+
+			if (!locked) {
+				return false;
+			}
+
+			// now check that it still exists, because it could've been
+			// deleted before the lock was released
+			m_readLock.lock();
+			try {
+				if (!m_workingMemory.contains(_id)) {
+					m_permissions.unlock(_id, _component);
+					throw new DoesNotExistOnWMException(
+							"Entry deleted while waiting for lock. Component "
+									+ _component + "  was looking in subarch "
+									+ _subarch + " for id " + _id,
+							new WorkingMemoryAddress(_id, _subarch));
+				}
+			} finally {
+				m_readLock.unlock();
+			}
+			return true;
+		} else {
+			return getWorkingMemory(_subarch).lockEntryWithTimeout(_id,
+					_subarch, _component, _perm, _timeout);
+		}
+	}
+
+	/**
+	 * Lock times are not yet measured by the Java working memory.
+	 */
+	public LockStatistics[] getLockStatistics(Current __current) {
+		return new LockStatistics[0];
+	}
+
+	/**
+	 * The Java working memory always sends super types with its changes,
+	 * so never gives out type hierarchy ids of its own.
+	 */
+	public String[] getTypeHierarchy(String _subarch, int _typeHierarchy,
+			Current __current) throws UnknownSubarchitectureException {
+		// if this is for me
+		if (getSubarchitectureID().equals(_subarch)) {
+			return new String[0];
+		} else {
+			// send on to the one that really cares
+			return getWorkingMemory(_subarch).getTypeHierarchy(_subarch,
+					_typeHierarchy);
+		}
+	}
+
 	public void unlockEntry(String _id, String _subarch, String _component,
 			Current __current) throws ConsistencyException,
 			DoesNotExistOnWMException, UnknownSubarchitectureException {
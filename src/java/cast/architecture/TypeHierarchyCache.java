@@ -0,0 +1,102 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit Copyright (C) 2006-2007
+ * Nick Hawes This library is free software; you can redistribute it
+ * and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either version
+ * 2.1 of the License, or (at your option) any later version. This
+ * library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details. You should have
+ * received a copy of the GNU Lesser General Public License along with
+ * this library; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+package cast.architecture;
+
+import java.util.HashMap;
+
+import cast.cdl.WorkingMemoryChange;
+import cast.interfaces.WorkingMemoryPrx;
+
+/**
+ * Super types for the type hierarchy ids carried by changes from C++
+ * working memories, which only send a type's super types on request. Each
+ * hierarchy is fetched once with WorkingMemory.getTypeHierarchy and then
+ * copied into every change which refers to it, so filters and receivers
+ * see the super types as they did before. Thread safe.
+ *
+ * @author nah
+ */
+public class TypeHierarchyCache {
+
+	private final HashMap<String, String[]> m_superTypes;
+
+	public TypeHierarchyCache() {
+		m_superTypes = new HashMap<String, String[]>();
+	}
+
+	/**
+	 * Whether a change refers to its type hierarchy by id instead of
+	 * carrying its super types.
+	 */
+	public static boolean isCompact(WorkingMemoryChange _wmc) {
+		return (_wmc.superTypes == null || _wmc.superTypes.length == 0)
+				&& _wmc.typeHierarchy != 0;
+	}
+
+	/**
+	 * Fill in the super types of a compact change. If they cannot be found
+	 * the change is left as it is.
+	 *
+	 * @param _wmc
+	 *            The change.
+	 * @param _wm
+	 *            The working memory to ask if the hierarchy is not cached.
+	 *            It must be able to reach the subarchitecture of the
+	 *            change. If null the change is left as it is.
+	 */
+	public void expand(WorkingMemoryChange _wmc, WorkingMemoryPrx _wm) {
+		if (_wm == null || !isCompact(_wmc)) {
+			return;
+		}
+
+		String key = _wmc.address.subarchitecture + ":" + _wmc.typeHierarchy;
+		String[] superTypes;
+		synchronized (m_superTypes) {
+			superTypes = m_superTypes.get(key);
+		}
+
+		if (superTypes == null) {
+			// not holding the lock while waiting for working memory
+			try {
+				superTypes = _wm.getTypeHierarchy(
+						_wmc.address.subarchitecture, _wmc.typeHierarchy);
+			} catch (Exception e) {
+				return;
+			}
+
+			// unknown ids are not cached, so they are asked about again
+			if (superTypes == null || superTypes.length == 0) {
+				return;
+			}
+
+			synchronized (m_superTypes) {
+				m_superTypes.put(key, superTypes);
+			}
+		}
+
+		_wmc.superTypes = superTypes;
+	}
+
+	/**
+	 * Fill in the super types of all compact changes in an array.
+	 */
+	public void expand(WorkingMemoryChange[] _wmcs, WorkingMemoryPrx _wm) {
+		for (WorkingMemoryChange wmc : _wmcs) {
+			expand(wmc, _wm);
+		}
+	}
+
+}
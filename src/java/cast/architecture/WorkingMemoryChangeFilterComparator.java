@@ -127,6 +127,12 @@ public class WorkingMemoryChangeFilterComparator implements
 			return comparison;
 		}
 
+		// payload
+		comparison = _f1.payload.compareTo(_f2.payload);
+		if (comparison != EQUAL) {
+			return comparison;
+		}
+
 		// all comparisons have yielded equality
 		// verify that compareTo is consistent with equals
 		// (optional)
@@ -423,10 +423,26 @@ public abstract class WorkingMemoryReaderComponent extends
 		}
 
 		/**
-		 * Add change structs to the queue for forwarding.
+		 * Add a sequence of changes to the queue in order, then wake the
+		 * thread once.
 		 * 
 		 * @param _changes
-		 *            A list of change structs.
+		 *            The changes in the order they occurred.
+		 */
+		public void queueChanges(WorkingMemoryChange[] _changes) {
+			synchronized (m_changes) {
+				for (WorkingMemoryChange change : _changes) {
+					m_changes.add(change);
+				}
+			}
+			m_changeSemaphore.release();
+		}
+
+		/**
+		 * Add a change struct to the queue for forwarding.
+		 * 
+		 * @param _change
+		 *            The change struct.
 		 */
 		public void queueChange(WorkingMemoryChange _change) {
 
@@ -537,6 +553,11 @@ public abstract class WorkingMemoryReaderComponent extends
 	 */
 	private WorkingMemoryPrx m_workingMemoryForRead;
 
+	/**
+	 * Super types for compact changes from C++ working memories.
+	 */
+	private final TypeHierarchyCache m_typeHierarchies = new TypeHierarchyCache();
+
 	/**
 	 * Construct a new processing component with the given unique ID. Set queue
 	 * behaviour to DISCARD, and xarch change event receiving to false.
@@ -1076,11 +1097,22 @@ public abstract class WorkingMemoryReaderComponent extends
 
 			// prefer to use change objects
 			if (m_changeObjects != null) {
+				m_typeHierarchies.expand(_wmc, m_workingMemory);
 				m_wmChangeRunnable.queueChange(_wmc);
 			}
 		}
 	}
 
+	public void receiveChangeEvents(WorkingMemoryChange[] _wmcs,
+			Current __current) {
+		if (isRunning() && m_bReceivingChanges) {
+			if (m_changeObjects != null && _wmcs.length > 0) {
+				m_typeHierarchies.expand(_wmcs, m_workingMemory);
+				m_wmChangeRunnable.queueChanges(_wmcs);
+			}
+		}
+	}
+
 	/**
 	 * Start this component running. This overridden method also starts the
 	 * encapsulated thread that forwards change information.
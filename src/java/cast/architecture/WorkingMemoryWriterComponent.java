@@ -32,6 +32,9 @@ import cast.PermissionException;
 import cast.UnknownSubarchitectureException;
 import cast.cdl.COMPONENTNUMBERKEY;
 import cast.cdl.WorkingMemoryAddress;
+import cast.cdl.WorkingMemoryBatchItem;
+import cast.cdl.WorkingMemoryBatchOutcome;
+import cast.cdl.WorkingMemoryBatchResult;
 import cast.core.CASTUtils;
 import cast.core.logging.ComponentLogger;
 import cast.interfaces.WorkingMemoryPrx;
@@ -507,6 +510,135 @@ public abstract class WorkingMemoryWriterComponent extends
 		logOverwrite(_id, _subarch, type, getStoredVersionNumber(_id));
 	}
 
+	/**
+	 * Create an entry for a batch to be written with addToWorkingMemoryBatch
+	 * or overwriteWorkingMemoryBatch.
+	 * 
+	 * @param _id
+	 *            The id the data will be stored with.
+	 * @param _data
+	 *            The data itself
+	 * @return The batch item.
+	 */
+	public <T extends Ice.Object> WorkingMemoryBatchItem batchItem(String _id,
+			T _data) {
+		assert _id.length() > 0 : "id must not be empty";
+		return new WorkingMemoryBatchItem(_id, CASTUtils.typeName(_data),
+				_data);
+	}
+
+	public WorkingMemoryBatchResult[] addToWorkingMemoryBatch(
+			WorkingMemoryBatchItem[] _items)
+			throws UnknownSubarchitectureException {
+		return addToWorkingMemoryBatch(getSubarchitectureID(), _items);
+	}
+
+	/**
+	 * Add a batch of new entries to working memory in a single call. All
+	 * entries are added under one working memory lock.
+	 * 
+	 * @param _subarch
+	 *            The subarchitecture to write to.
+	 * @param _items
+	 *            The entries to add, created with batchItem.
+	 * @return The result for each item, in the same order as _items. Items
+	 *         which already exist are reported as BATCHALREADYEXISTS rather
+	 *         than thrown, and items with a null entry as BATCHNOENTRY.
+	 * @throws UnknownSubarchitectureException
+	 */
+	public WorkingMemoryBatchResult[] addToWorkingMemoryBatch(String _subarch,
+			WorkingMemoryBatchItem[] _items)
+			throws UnknownSubarchitectureException {
+
+		assert _subarch.length() > 0 : "subarchitecture id must not be empty";
+
+		WorkingMemoryBatchResult[] results = m_workingMemoryForWrite
+				.addToWorkingMemoryBatch(_subarch, getComponentID(), _items);
+
+		for (int i = 0; i < _items.length; i++) {
+			if (results[i].outcome == WorkingMemoryBatchOutcome.BATCHWRITTEN) {
+				// the wm reports the version, so there is no need to ask for
+				// it when re-adding as addToWorkingMemory does
+				storeVersionNumber(_items[i].id, results[i].version);
+				logAdd(_items[i].id, _subarch, _items[i].type,
+						results[i].version);
+			}
+		}
+		return results;
+	}
+
+	public WorkingMemoryBatchResult[] overwriteWorkingMemoryBatch(
+			WorkingMemoryBatchItem[] _items)
+			throws UnknownSubarchitectureException {
+		return overwriteWorkingMemoryBatch(getSubarchitectureID(), _items);
+	}
+
+	/**
+	 * Overwrite a batch of entries in a single call. Unlike
+	 * overwriteWorkingMemory this does not check the consistency of each
+	 * entry with a separate call, the overwrites are applied in the order
+	 * given. Entries locked by another component are reported as BATCHLOCKED,
+	 * missing entries as BATCHDOESNOTEXIST and items with a null entry as
+	 * BATCHNOENTRY.
+	 * 
+	 * @param _subarch
+	 *            The subarchitecture to write to.
+	 * @param _items
+	 *            The entries to overwrite, created with batchItem.
+	 * @return The result for each item, in the same order as _items.
+	 * @throws UnknownSubarchitectureException
+	 */
+	public WorkingMemoryBatchResult[] overwriteWorkingMemoryBatch(
+			String _subarch, WorkingMemoryBatchItem[] _items)
+			throws UnknownSubarchitectureException {
+
+		assert _subarch.length() > 0 : "subarchitecture id must not be empty";
+
+		WorkingMemoryBatchResult[] results = m_workingMemoryForWrite
+				.overwriteWorkingMemoryBatch(_subarch, getComponentID(), _items);
+
+		for (int i = 0; i < _items.length; i++) {
+			if (results[i].outcome == WorkingMemoryBatchOutcome.BATCHWRITTEN) {
+				storeVersionNumber(_items[i].id, results[i].version);
+				logOverwrite(_items[i].id, _subarch, _items[i].type,
+						results[i].version);
+			}
+		}
+		return results;
+	}
+
+	public WorkingMemoryBatchResult[] deleteFromWorkingMemoryBatch(
+			String[] _ids) throws UnknownSubarchitectureException {
+		return deleteFromWorkingMemoryBatch(getSubarchitectureID(), _ids);
+	}
+
+	/**
+	 * Delete a batch of entries in a single call.
+	 * 
+	 * @param _subarch
+	 *            The subarchitecture to delete from.
+	 * @param _ids
+	 *            The ids of the entries to delete.
+	 * @return The result for each id, in the same order as _ids.
+	 * @throws UnknownSubarchitectureException
+	 */
+	public WorkingMemoryBatchResult[] deleteFromWorkingMemoryBatch(
+			String _subarch, String[] _ids)
+			throws UnknownSubarchitectureException {
+
+		assert _subarch.length() > 0 : "subarchitecture id must not be empty";
+
+		WorkingMemoryBatchResult[] results = m_workingMemoryForWrite
+				.deleteFromWorkingMemoryBatch(_subarch, getComponentID(), _ids);
+
+		for (int i = 0; i < _ids.length; i++) {
+			if (results[i].outcome == WorkingMemoryBatchOutcome.BATCHWRITTEN) {
+				logDelete(_ids[i], _subarch);
+			}
+		}
+		return results;
+	}
+
 	/**
 	 * Overrides setWorkingMemory to create a local copy of the wm pro
 	 */
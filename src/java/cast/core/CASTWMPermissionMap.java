@@ -2,6 +2,7 @@ package cast.core;
 
 import java.util.HashMap;
 import java.util.concurrent.Semaphore;
+import java.util.concurrent.TimeUnit;
 
 import org.apache.log4j.Logger;
 
@@ -76,7 +77,7 @@ public class CASTWMPermissionMap {
 		lockMap();
 		assert (!m_permissions.containsKey(_id));
 		m_permissions.put(_id, new PermissionsStruct(
-				WorkingMemoryPermissions.UNLOCKED, new Semaphore(1), "", 0,
+				WorkingMemoryPermissions.UNLOCKED, new Semaphore(1, true), "", 0,
 				false));
 		unlockMap();
 	}
@@ -90,6 +91,21 @@ public class CASTWMPermissionMap {
 	 */
 	public void lock(String _id, String _component,
 			WorkingMemoryPermissions _permission) throws InterruptedException {
+		lock(_id, _component, _permission, -1);
+	}
+
+	/**
+	 * Acquires the lock for the entry given by the id, waiting for at most
+	 * _timeoutMillis, or for ever if it is negative. Waiting components
+	 * get the lock in the order they asked for it.
+	 * 
+	 * @param _id
+	 * @return false if the wait timed out.
+	 * @throws InterruptedException
+	 */
+	public boolean lock(String _id, String _component,
+			WorkingMemoryPermissions _permission, long _timeoutMillis)
+			throws InterruptedException {
 
 		Semaphore mutex = null;
 
@@ -97,7 +113,7 @@ public class CASTWMPermissionMap {
 		// if this is an invalid entry, return;
 		if (!live(_id)) {
 			unlockMap();
-			return;
+			return true;
 		}
 
 		PermissionsStruct ps = m_permissions.get(_id);
@@ -109,7 +125,7 @@ public class CASTWMPermissionMap {
 			assert (ps.m_lockCount > 0);
 			ps.m_lockCount++;
 			unlockMap();
-			return;
+			return true;
 		}
 
 		mutex = ps.m_mutex;
@@ -117,7 +133,11 @@ public class CASTWMPermissionMap {
 		unlockMap();
 
 		// block until mutex is locked
-		mutex.acquire();
+		if (_timeoutMillis < 0) {
+			mutex.acquire();
+		} else if (!mutex.tryAcquire(_timeoutMillis, TimeUnit.MILLISECONDS)) {
+			return false;
+		}
 
 		lockMap();
 		// if this is now invalid entry, return;
@@ -134,7 +154,7 @@ public class CASTWMPermissionMap {
 			assert (m_permissions.get(_id).m_permissions.equals(_permission));
 		}
 		unlockMap();
-
+		return true;
 	}
 
 	private boolean live(String _id) {
@@ -0,0 +1,130 @@
+/*
+ * CAST - The CoSy Architecture Schema Toolkit
+ *
+ * Copyright (C) 2006-2007 Nick Hawes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * as published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ *
+ */
+package cast.core;
+
+import Ice.Communicator;
+import Ice.InputStream;
+import Ice.OutputStream;
+import Ice.ReadObjectCallback;
+import cast.CASTException;
+import cast.cdl.WorkingMemoryPatch;
+import cast.cdl.WorkingMemoryPatchSegment;
+
+/**
+ * Applies working memory patches. A patch is a set of changes to the Ice
+ * stream encoding of an entry. See EntryPatch.hpp in the C++ tree for the
+ * code that creates them.
+ * 
+ * @author nah
+ */
+public class EntryPatch {
+
+	private EntryPatch() {
+	}
+
+	/**
+	 * Write an entry in the Ice stream encoding.
+	 */
+	public static byte[] marshalEntry(Communicator _communicator,
+			Ice.Object _entry) {
+		OutputStream out = Ice.Util.createOutputStream(_communicator);
+		out.writeObject(_entry);
+		out.writePendingObjects();
+		byte[] bytes = out.finished();
+		out.destroy();
+		return bytes;
+	}
+
+	/**
+	 * Read an entry written by marshalEntry.
+	 */
+	public static Ice.Object unmarshalEntry(Communicator _communicator,
+			byte[] _bytes) {
+		InputStream in = Ice.Util.createInputStream(_communicator, _bytes);
+		final Ice.Object[] entry = new Ice.Object[1];
+		in.readObject(new ReadObjectCallback() {
+			public void invoke(Ice.Object _object) {
+				entry[0] = _object;
+			}
+		});
+		in.readPendingObjects();
+		in.destroy();
+		return entry[0];
+	}
+
+	/**
+	 * A 32 bit FNV-1a hash of a marshalled entry, the same as entryHash in
+	 * EntryPatch.hpp.
+	 */
+	public static int entryHash(byte[] _bytes) {
+		int hash = 0x811c9dc5;
+		for (byte b : _bytes) {
+			hash ^= (b & 0xff);
+			hash *= 16777619;
+		}
+		return hash;
+	}
+
+	/**
+	 * Whether _bytes are the marshalled entry a patch was computed against.
+	 */
+	public static boolean isPatchBase(WorkingMemoryPatch _patch, byte[] _bytes) {
+		return _patch.baseLength == _bytes.length
+				&& _patch.baseHash == entryHash(_bytes);
+	}
+
+	/**
+	 * Apply a patch to the marshalled entry it was computed against.
+	 * 
+	 * @return the patched bytes
+	 * @throws CASTException
+	 *             if the patch was computed against different bytes or does
+	 *             not fit the entry
+	 */
+	public static byte[] applyPatch(WorkingMemoryPatch _patch, byte[] _bytes)
+			throws CASTException {
+		if (_patch.length < 0) {
+			throw new CASTException("invalid patch length: " + _patch.length);
+		}
+		if (!isPatchBase(_patch, _bytes)) {
+			throw new CASTException("patch is against " + _patch.baseLength
+					+ " bytes with hash " + _patch.baseHash + ", not "
+					+ _bytes.length + " bytes with hash " + entryHash(_bytes));
+		}
+		byte[] patched = new byte[_patch.length];
+		System.arraycopy(_bytes, 0, patched, 0, Math.min(_bytes.length,
+				_patch.length));
+		for (WorkingMemoryPatchSegment segment : _patch.segments) {
+			if (segment.offset < 0
+					|| segment.offset + segment.data.length > _patch.length) {
+				throw new CASTException("patch segment at " + segment.offset
+						+ " of " + segment.data.length
+						+ " bytes does not fit entry of " + _patch.length
+						+ " bytes");
+			}
+			System.arraycopy(segment.data, 0, patched, segment.offset,
+					segment.data.length);
+		}
+		return patched;
+	}
+
+}
@@ -8,6 +8,7 @@ import org.apache.log4j.helpers.LogLog;
 import org.apache.log4j.spi.LoggingEvent;
 
 import Ice.Current;
+import cast.cdl.SerialisedLogEvent;
 import cast.interfaces._LoggingServerDisp;
 
 public class CASTLogServer extends _LoggingServerDisp {
@@ -53,4 +54,17 @@ public class CASTLogServer extends _LoggingServerDisp {
 		}
 	}
 
+	@Override
+	public void logSerialisedEvents(SerialisedLogEvent[] _events,
+			Current _current) {
+		for (SerialisedLogEvent event : _events) {
+			if (event.id.length() == 0) {
+				logSerialisedEvent(event.event, _current);
+			} else {
+				logSerialisedEventWithAdditions(event.event, event.id,
+						event.saID, event.colourStart, _current);
+			}
+		}
+	}
+
 }